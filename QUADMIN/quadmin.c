@@ -51,6 +51,16 @@
 
 
 #include <time.h>
+#include <stdarg.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
 
 #define	YES	1
 #define	NO	0
@@ -60,6 +70,33 @@
 #define LANG_ENG	0
 #define LANG_FRA	1
 
+#define REPORT_TEXT	0	/* Q_REPORT_FORMAT */
+#define REPORT_CSV	1
+#define REPORT_JSONL	2
+
+/* phases of the statistics of the jobs (QUADMIN_STATS), see phase_names */
+
+#define PH_JOB		0
+#define PH_GET_SER	1
+#define PH_DATES	2
+#define PH_BENCHMOD	3
+#define PH_QINVW	4
+#define PH_WQINVW	5
+#define PH_INVERSE	6
+#define PH_MATMULT	7
+#define PH_ROUND	8
+#define PH_UPDATE	9
+#define PH_REPORTS	10
+#define PH_CFMSINP	11	/* the Fame calls, up to the last phase */
+#define PH_CFMFAME	12
+#define PH_CFMSRNG	13
+#define PH_CFMRRNG	14
+#define PH_CFMWRNG	15
+#define NB_PHASES	16
+
+#define STAT_BEGIN(phase)	(stats_on ? stat_begin(phase) : (void)0)
+#define STAT_END(phase)		(stats_on ? stat_end(phase) : (void)0)
+
 
 /* these defines are for NA, NC or ND */
 
@@ -67,6 +104,12 @@
 #define	MISSND	-999998.9999
 #define	MISSNA	-999997.9999
 
+/* with QUADMIN_MISSING=NAN, quiet NaNs with these payloads instead */
+
+#define	NAN_NC	1
+#define	NAN_ND	2
+#define	NAN_NA	3
+
 
 
 /*
@@ -98,6 +141,12 @@ struct s_algo
 	bool mean;
 	bool stock;
 	bool zero;
+	bool incremental;
+	bool whatif;
+	char statefile[BUFSIZ];
+	double rho;
+	bool legacydiff;
+	bool controlled;
 };
 
 struct s_reports
@@ -109,6 +158,33 @@ struct s_reports
 	bool fact;
 	bool gr;
 	int  lag;
+	int  format;
+	bool diagcodes;            /* Q_DIAG_CODES: codes left in WORK'Q_DIAG_CODES */
+	char vintagefrom[7];
+	char sweep[BUFSIZ];
+	char rhogrid[BUFSIZ];
+};
+
+struct s_stats                  /* statistics of a job or of the session */
+{
+	double time[NB_PHASES];         /* seconds */
+	long   calls[NB_PHASES];
+	double bytes_read;
+	double bytes_written;
+	long   allocs;
+	int    tt;
+	int    mm;
+};
+
+struct s_analytics              /* measures of the reports, see report_analytics */
+{
+	int     cap;
+	double *buf;
+	double *fac;
+	double *ddist;
+	double *dtrget;
+	double *grdist;
+	double *grtrget;
 };
 
 struct s_series
@@ -116,6 +192,9 @@ struct s_series
 	char benchid[65];
 	char distributorid[65];
 	char targetid[65];
+	int  nbbatch;              /* series of Q_BATCHID, benchmarked with the job */
+	int  capbatch;
+	char (*batchid)[3][65];
 };
 
 struct s_options
@@ -126,6 +205,66 @@ struct s_options
 	struct s_series   series;
 };
 
+/*
+ * Solver state kept between jobs of a session when the incremental
+ * option is on.  qinvw is stored row major with mcap columns (not
+ * transposed as in benchmod, see WQ_TILE) and chol holds the lower Cholesky factor of wqinvw (mcap x mcap).  cor and
+ * invy are the last correction and solution, before apply_corr.
+ * infl is the tt x mm influence matrix qinvw * wqinvw^-1 of the what-if
+ * mode, NULL until it is built.
+ */
+
+struct s_solver_state
+{
+	char    key[3*MAX_FAME_NAME];
+	long    stamp;
+	int     valid;
+	int     prop;
+	double  rho;
+	int     tt;
+	int     mm;
+	int     tcap;
+	int     mcap;
+	int    *tau;
+	int    *kappa;
+	double  xbar;
+	double *x;
+	double *qinvw;
+	double *chol;
+	double *invy;
+	double *cor;
+	double *infl;
+};
+
+/*
+ * Workspace of distribround: the deviation of a rounded value and its
+ * index, one per value rounded together.
+ */
+
+struct s_rank
+{
+	double diff;
+	int    seqno;
+};
+
+/*
+ * A segment of the target rounded to a control total by round_segments.
+ * The total is given, or if sumlen > 0 it is the sum of the sumlen
+ * values from sumstart at the time the segment is rounded.  Segments
+ * of the same level must not overlap and are rounded in any order (in
+ * parallel when compiled with OpenMP); the levels are done in order.
+ */
+
+struct s_segment
+{
+	int    start;
+	int    length;
+	int    sumstart;
+	int    sumlen;
+	int    level;
+	double total;
+};
+
 
 
 /*
@@ -137,7 +276,21 @@ void init_ser_info(struct s_ser_info *pnt);
 void init_algo(struct s_algo *pnt, struct s_ser_info *ser_pnt);
 void init_reports(struct s_reports *pnt);
 void send_warning(struct s_options *opt, int setnum, int langnum, int messnum, char **parm, int nb_parm);
+void flush_diagnostics(struct s_options *opt);
+void stat_init(void);
+void stat_begin(int phase);
+void stat_end(int phase);
+void trace_span(const char *name, const char *target, double start, double stop, int tid);
+void stat_add(void);
+void stat_job(struct s_options *opt);
+void stat_summary(void);
+void *qm_malloc(size_t size);
+void *qm_calloc(size_t nb, size_t size);
+void *qm_realloc(void *ptr, size_t size);
 void open_output_file(char *file_name);
+void close_output_files(void);
+int output_header(void);
+void output_text(void);
 int read_fame_line(struct s_options *opt, char[]);
 int get_fame_input(struct s_options *opt, int *still_job);
 void end_fame(void);
@@ -147,8 +300,22 @@ int write_ser(char *base, char *targetid, char *from, char *to, int freq, double
 void prnt_warnings(double *dist, double *trget, int nbdist, struct s_options *opt, char *bfrom);
 void prnt_w_mess(struct s_options *opt, int num, char *mess1, char *mess2, int nbmess);
 void roundser(double *trget, double *bench, int *tau, int *kappa, int nbbench, int nbdist, struct s_options *opt, char bto[]);
-void print_reports(double *bench, double *dist, double *trget, int nbdist, int nbbench, struct s_options *opt, int *tau, int *kappa, double *af);
+void print_reports(double *bench, double *dist, double *trget, int nbdist, int nbbench, struct s_options *opt, int *tau, int *kappa);
+void print_records(double *dist, double *trget, int nbdist, int nbbench, struct s_options *opt, int *tau, int *kappa, int div);
+void revision_study(struct s_options *opt, double *bench, double *dist, int *tau, int *kappa, double *w, int nbdist, int nbbench, int prop, int diff, int index);
+void sweep_study(struct s_options *opt, double *bench, double *dist, int *tau, int *kappa, double *w, int nbdist, int nbbench);
+void rho_study(struct s_options *opt, double *bench, double *dist, int *tau, int *kappa, double *w, int nbdist, int nbbench, int prop, int diff, int index);
+void print_comparison(struct s_options *opt, char **labels, bool *ratio, double *out, int nbvar, double *dist, int nbdist);
+int benchmark_batch(struct s_options *opt, double *bench, double *dist, double *trget, double *cor, int *tau, int *kappa, double *w, int nbdist, int nbbench, int prop, int diff, int index, char bfrom[], char bto[], bool shifted);
+int batch_update(struct s_options *opt, double *trget);
 void prnt_replace(char **parm, int setnum, int langnum, int messnum, char *title, int nb_parm);
+void rep_puts(const char *s);
+void rep_printf(const char *format, ...);
+void rep_fixed(double value, int width, int ndec);
+void rep_flush(void);
+void rep_close(void);
+void rep_record(char *kind, char *from, char *to, char *flag, int ndecs, double dist, double trget, double fac, double dif, double *gr);
+void rep_field(double value, int ndec);
 void cal_tau_kappa(int *tau, int *kappa, struct s_options *options, char bfrom[], char bto[]);
 void add_date(char date[], int freq, int val);
 int cal_nb_points(char from[], char to[], int freq, int freq2);
@@ -158,9 +325,26 @@ int divide(int per, int freq);
 int get_ser(struct s_options *options, double **bench, double **dist, char bfrom[], char bto[]);
 int read_series(char *base_name, int freq, char *from, char *to, double *out, char *ser_name);
 void cal_fac(double *result, double *trget, double *dist, int nbdist, char prop);
+int report_analytics(struct s_analytics *an, double *dist, double *trget, int nbdist, char prop, int lag);
 void send_error(struct s_options *opt, char *short_buf);
-
-extern void benchmod(double *x, double *b, double *cor, double *y, int *tau, int *kappa, double *w, int *prop, int *diff, int *index, int tt, int mm);
+struct s_solver_state *get_state(struct s_options *opt);
+void keep_state(struct s_options *opt, struct s_solver_state *st);
+int load_state(char *file_name, struct s_solver_state *st);
+int save_state(char *file_name, struct s_solver_state *st);
+
+extern void benchmod(double *x, double *b, double *cor, double *y, int *tau, int *kappa, double *w, int *prop, int *diff, int *index, double rho, int tt, int mm);
+extern int benchmod_inc(struct s_solver_state *st, double *x, double *b, double *cor, double *y, int *tau, int *kappa, double *w, int *prop, int *diff, int *index, double rho, int tt, int mm);
+extern int benchmod_whatif(struct s_solver_state *st, double *x, double *b, double *cor, double *y, int *tau, int *kappa, double *w, int *prop, int *diff, int *index, double rho, int tt, int mm);
+extern int state_alloc(struct s_solver_state *st, int tt, int mm);
+extern void free_state(struct s_solver_state *st);
+extern int benchmod_vintages(double *x, double *y, int *tau, int *kappa, double *w, int prop, int diff, int index, double rho, int tt, int mm, int nbvint, int *ttv, double *out);
+extern int benchmod_batch(int nbl, int lanes, double *x, double *b, double *cor, double *y, int *tau, int *kappa, double *w, int prop, int diff, int index, double rho, int tt, int mm);
+extern int batch_lanes(void);
+extern int any_negative(double *x, int n);
+extern int any_nonpositive(double *x, int n);
+extern int any_missing(double *x, int n);
+double nan_payload(int payload);
+extern int benchmod_sweep(double *x, double *y, int *tau, int *kappa, double *w, int nbvar, int *vprop, int *vdiff, int *vindex, double rho, int tt, int mm, double *out);
 extern void print_default(double *dist, double *trget, char from[], int freq, int benchfreq, int nbpoints, int ndecs, int div, char stock, char *prnt);
 extern void print_fisc(double *dist, double *trget, int *tau, int *kappa, int nbpoint, int nbbench, int ndecs, int freq, int benchfreq, char from[], int div, char stock, char *prnt);
 extern void prnt_data(char start[], int nbpoints, int freq, int nbdecs, double *series, char arates, char printsum);
@@ -170,17 +354,26 @@ extern void firstdiff(int *nbdist, int *lag, double *dist, double *result);
 extern void percent(int *nbdist, int *lag, double *dist, double *result);
 
 extern char title[];
-extern char *lookup_message(int setnum, int lang_num, int messnum);
-extern char* replace(char *message, int nbtokens, char **tokens);
+extern const char *lookup_message(int setnum, int lang_num, int messnum);
+extern int format_message(char *buf, size_t size, int setnum, int langnum, int messnum, char **parm, int nb_parm);
 
-int distribround(double *in, double sum, int nvalue, int ndec, double *out);
+int distribround(double *in, double sum, int nvalue, int ndec, double *out, struct s_rank *work);
+int round_segments(double *trget, struct s_segment *seg, int nbseg, int ndec);
+int controlled_round(double **comp, double **bench, int nbcomp, double *agg, int *tau, int *kappa, int nbbench, int nbdist, bool linked, int ndec);
 
 
 int lang = 0;
 int MAXTRY = 1000;
 int workkey;
 FILE *tables;
+int report_format = REPORT_TEXT;	/* format of print_default and print_fisc */
+char *report_kind = "";			/* kind of their records */
+char *report_series = "";		/* series of their records */
+struct s_analytics analytics;		/* buffer of report_analytics */
 double mistt[3];
+bool nan_missing = NO;			/* QUADMIN_MISSING=NAN */
+int stats_on = 0;			/* QUADMIN_STATS, QUADMIN_STATS_CSV */
+struct s_stats job_stats;
 
 
 
@@ -210,10 +403,14 @@ main()
 
 	lang = LANG_ENG;
 
+	stat_init();
 	init_base(&options);
 	init_ser_info(&options.ser_info);
 	init_algo(&options.algo, &options.ser_info);
 	init_reports(&options.reports);
+	options.series.nbbatch = 0;
+	options.series.capbatch = 0;
+	options.series.batchid = NULL;
 
 	/**********
 	* The process is executed until the still job pointer is set to
@@ -229,20 +426,42 @@ main()
 			break;
 		}
 		if (!get_fame_input(&options, &still_job))
+		{
+			flush_diagnostics(NULL);
 			continue;
+		}
 
 		loop_ctr = 0;
 
 		if (still_job == 0)
 			break;
 
-		if (options.reports.display)
+		STAT_BEGIN(PH_JOB);
+		if (options.reports.display || options.reports.vintagefrom[0] || options.reports.sweep[0] || options.reports.rhogrid[0])
 			open_output_file(options.reports.file_name);
 
+		STAT_BEGIN(PH_DATES);
 		ret_dates(&options, bfrom, bto);
+		STAT_END(PH_DATES);
 
 		benchmark(&options, bfrom, bto);
+		flush_diagnostics(&options);
+		STAT_END(PH_JOB);
+		stat_job(&options);
+
+		/**********
+		* the studies and the batch series are asked for one job at a
+		* time, the procedure only sends their options when they are given
+		**********/
+
+		strcpy(options.reports.vintagefrom, "");
+		strcpy(options.reports.sweep, "");
+		strcpy(options.reports.rhogrid, "");
+		options.series.nbbatch = 0;
+		options.algo.controlled = NO;
 	}
+	free(options.series.batchid);
+	free(analytics.buf);
 	end_fame();
 }
 
@@ -252,7 +471,10 @@ main()
  *
  * - Initialize the necessary chli function to interact with Fame
  * - Open workdatabase for process
- * - Translate missing values table
+ * - Translate missing values table: NC, ND and NA are read as MISSNC,
+ *   MISSND and MISSNA, or as quiet NaNs (payloads NAN_NC, NAN_ND and
+ *   NAN_NA) when the environment variable QUADMIN_MISSING is NAN, so
+ *   that no value of a series can be taken for a missing one
  *
  * returns: 1 if everything o.k.
  * Otherwise exit the program
@@ -261,6 +483,7 @@ main()
 int init_base(struct s_options *opt)
 {
 	char short_buf[SHORT_BUF_SIZE];
+	char *env;
 	int status;
 
 	cfmini(&status);
@@ -284,7 +507,13 @@ int init_base(struct s_options *opt)
 		exit(-1);
 	}
 
-	cfmspm(&status, MISSNC, MISSND, MISSNA, mistt);
+	if ((env = getenv("QUADMIN_MISSING")) != NULL && strcmp(env, "NAN") == 0)
+		nan_missing = YES;
+
+	if (nan_missing)
+		cfmspm(&status, nan_payload(NAN_NC), nan_payload(NAN_ND), nan_payload(NAN_NA), mistt);
+	else
+		cfmspm(&status, MISSNC, MISSND, MISSNA, mistt);
 
 	if (status != HSUCC)
 	{
@@ -301,6 +530,26 @@ int init_base(struct s_options *opt)
 
 
 
+/**********
+ *
+ * double nan_payload(int payload)
+ *
+ * returns the quiet NaN carrying payload in the low bits of its mantissa.
+ *
+ **********/
+
+double nan_payload(int payload)
+{
+	unsigned long long bits;
+	double value;
+
+	bits = 0x7ff8000000000000ULL | (unsigned long long)payload;
+	memcpy(&value, &bits, sizeof(value));
+	return(value);
+}
+
+
+
 /**********
  *
  * void init_ser_info(struct s_ser_info *pnt)
@@ -341,6 +590,12 @@ void init_algo(struct s_algo *pnt, struct s_ser_info *ser_pnt)
 	strcpy(pnt->updatefrom, ser_pnt->from);
 	pnt->mean   = NO;
 	pnt->stock  = NO;
+	pnt->incremental = NO;
+	pnt->whatif = NO;
+	strcpy(pnt->statefile, "");
+	pnt->rho = 0.99999999;
+	pnt->legacydiff = NO;
+	pnt->controlled = NO;
 }
 
 
@@ -362,6 +617,11 @@ void init_reports(struct s_reports *pnt)
 	pnt->fact = NO;
 	pnt->gr = NO;
 	pnt->lag = 1;
+	pnt->format = REPORT_TEXT;
+	pnt->diagcodes = NO;
+	strcpy(pnt->vintagefrom, "");
+	strcpy(pnt->sweep, "");
+	strcpy(pnt->rhogrid, "");
 }
 
 
@@ -383,6 +643,9 @@ void init_reports(struct s_reports *pnt)
 int get_fame_input(struct s_options *opt, int *still_job)
 {
 	static char input_line[SHORT_BUF_SIZE];
+	double value;
+	char (*batchid)[3][65];
+	int n;
 	int c = 0;
 
 	do
@@ -438,6 +701,34 @@ int get_fame_input(struct s_options *opt, int *still_job)
 			continue;
 		}
 
+		if (strncmp(input_line,"Q_BATCHID",9) == 0)
+		{
+			if (opt->series.nbbatch == opt->series.capbatch)
+			{
+				n = (opt->series.capbatch > 0) ? 2 * opt->series.capbatch : 16;
+				batchid = realloc(opt->series.batchid, n * sizeof(*batchid));
+				if (batchid == NULL)
+					continue;
+				opt->series.batchid = batchid;
+				opt->series.capbatch = n;
+			}
+
+			if (sscanf(&input_line[20], " %64[^, ] %*[, ]%64[^, ] %*[, ]%64s",
+					opt->series.batchid[opt->series.nbbatch][0],
+					opt->series.batchid[opt->series.nbbatch][1],
+					opt->series.batchid[opt->series.nbbatch][2]) == 3)
+			{
+				/**********
+				* a job may list thousands of batch series, they are
+				* not counted by the loop guard
+				**********/
+
+				opt->series.nbbatch++;
+				c--;
+			}
+			continue;
+		}
+
 		if (strncmp(input_line,"Q_DISTRIBUTORID",15) == 0)
 		{
 			strcpy(opt->series.distributorid,&input_line[20]);
@@ -474,6 +765,12 @@ int get_fame_input(struct s_options *opt, int *still_job)
 			continue;
 		}
 
+		if (strncmp(input_line,"Q_CONTROLLED",12) == 0)
+		{
+			opt->algo.controlled = (input_line[20] == 'Y');
+			continue;
+		}
+
 		if (strncmp(input_line,"Q_DECS",6) == 0)
 		{
 			opt->algo.decs = atoi(&input_line[20]);
@@ -492,6 +789,12 @@ int get_fame_input(struct s_options *opt, int *still_job)
 			continue;
 		}
 
+		if (strncmp(input_line,"Q_LEGACYDIFF",12) == 0)
+		{
+			opt->algo.legacydiff = (input_line[20] == 'Y');
+			continue;
+		}
+
 		if (strncmp(input_line,"Q_UPDATE",8) == 0)
 		{
 			if (strncmp(input_line,"Q_UPDATEFROM",12) == 0)
@@ -524,6 +827,38 @@ int get_fame_input(struct s_options *opt, int *still_job)
 			continue;
 		}
 
+		if (strncmp(input_line,"Q_RHOGRID",9) == 0)
+		{
+			strcpy(opt->reports.rhogrid, &input_line[20]);
+			continue;
+		}
+
+		if (strncmp(input_line,"Q_RHO",5) == 0)
+		{
+			value = atof(&input_line[20]);
+			if (value > 0 && value < 1)
+				opt->algo.rho = value;
+			continue;
+		}
+
+		if (strncmp(input_line,"Q_INCREMENTAL",13) == 0)
+		{
+			opt->algo.incremental = (input_line[20] == 'Y');
+			continue;
+		}
+
+		if (strncmp(input_line,"Q_WHATIF",8) == 0)
+		{
+			opt->algo.whatif = (input_line[20] == 'Y');
+			continue;
+		}
+
+		if (strncmp(input_line,"Q_STATEFILE",11) == 0)
+		{
+			strcpy(opt->algo.statefile, &input_line[20]);
+			continue;
+		}
+
 		if (strncmp(input_line,"Q_DISPLAY",9) == 0)
 		{
 			opt->reports.display = (input_line[20] == 'Y');
@@ -536,6 +871,23 @@ int get_fame_input(struct s_options *opt, int *still_job)
 			continue;
 		}
 
+		if (strncmp(input_line,"Q_DIAG_CODES",12) == 0)
+		{
+			opt->reports.diagcodes = (input_line[20] == 'Y');
+			continue;
+		}
+
+		if (strncmp(input_line,"Q_REPORT_FORMAT",15) == 0)
+		{
+			if (input_line[20] == 'C')
+				opt->reports.format = REPORT_CSV;
+			else if (input_line[20] == 'J')
+				opt->reports.format = REPORT_JSONL;
+			else
+				opt->reports.format = REPORT_TEXT;
+			continue;
+		}
+
 		if (strncmp(input_line,"Q_ARATES",8) == 0)
 		{
 			opt->reports.arates = (input_line[20] == 'Y');
@@ -560,6 +912,19 @@ int get_fame_input(struct s_options *opt, int *still_job)
 			continue;
 		}
 
+		if (strncmp(input_line,"Q_VINTAGEFROM",13) == 0)
+		{
+			strncpy(opt->reports.vintagefrom, &input_line[20], 6);
+			opt->reports.vintagefrom[6] = '\0';
+			continue;
+		}
+
+		if (strncmp(input_line,"Q_SWEEP",7) == 0)
+		{
+			strcpy(opt->reports.sweep, &input_line[20]);
+			continue;
+		}
+
 		if (strncmp(input_line,"Q_LAG",5) == 0)
 		{
 			opt->reports.lag = atoi(&input_line[20]);
@@ -603,7 +968,9 @@ int read_fame_line(struct s_options *opt,char input_line[])
 	char short_buf[SHORT_BUF_SIZE];
 	int status;
 
+	STAT_BEGIN(PH_CFMSINP);
 	cfmsinp(&status, input_line);
+	STAT_END(PH_CFMSINP);
 
 	if (status != HSUCC)
 	{
@@ -630,11 +997,34 @@ int read_fame_line(struct s_options *opt,char input_line[])
  * If the file does not contain a dot, the extension ".txt" will be added to
  * the file name.
  *
+ * The files are kept open for the session, with a buffer of
+ * OUTFILE_BUF: the jobs that print to a file already opened reuse its
+ * handle.  They are closed by close_output_files.  If there is no
+ * memory to keep the handle, the file is closed and the reports go to
+ * stdout, as when the file cannot be opened.
+ *
  **********/
 
+#define OUTFILE_BUF (1 << 20)
+
+struct s_outfile
+{
+	char *name;
+	FILE *fp;
+	bool header;        /* the file does not need a CSV header */
+};
+
+struct s_outfile *outfiles = NULL;
+int nboutfiles = 0;
+int capoutfiles = 0;
+bool stdout_header = NO;	/* stdout does not need a CSV header */
+FILE *text_file = NULL;		/* last file marked by output_text */
+
 void open_output_file(char *file_name)
 {
+	struct s_outfile *grown;
 	char fname[BUFSIZ];
+	int i, n;
 
 	if (strcmp(file_name, "") != 0)
 	{
@@ -643,8 +1033,47 @@ void open_output_file(char *file_name)
 		if (strchr(fname, '.') == NULL)
 			strcat(fname, ".txt");
 
+		for (i = 0; i < nboutfiles; i++)
+		{
+			if (strcmp(outfiles[i].name, fname) == 0)
+			{
+				tables = outfiles[i].fp;
+				return;
+			}
+		}
+
 		if ((tables = fopen(fname, "a")) == NULL)
+		{
+			tables = stdout;
+			return;
+		}
+
+		setvbuf(tables, NULL, _IOFBF, OUTFILE_BUF);
+
+		if (nboutfiles == capoutfiles)
+		{
+			n = (capoutfiles > 0) ? 2 * capoutfiles : 8;
+			if ((grown = (struct s_outfile *)realloc(outfiles, n * sizeof(struct s_outfile))) == NULL)
+			{
+				fclose(tables);
+				tables = stdout;
+				return;
+			}
+			outfiles = grown;
+			capoutfiles = n;
+		}
+
+		if ((outfiles[nboutfiles].name = (char *)malloc(strlen(fname) + 1)) == NULL)
+		{
+			fclose(tables);
 			tables = stdout;
+			return;
+		}
+		strcpy(outfiles[nboutfiles].name, fname);
+		outfiles[nboutfiles].fp = tables;
+		fseek(tables, 0L, SEEK_END);
+		outfiles[nboutfiles].header = (ftell(tables) > 0);
+		nboutfiles++;
 	}
 	else
 		tables = stdout;
@@ -653,6 +1082,102 @@ void open_output_file(char *file_name)
 
 
 
+/**********
+ *
+ * int output_header(void)
+ *
+ * returns 1 the first time it is called for the report file, if the
+ * file was empty when opened and no text report was written to it, 0
+ * else.  The CSV reports print their header line only then.
+ *
+ **********/
+
+int output_header(void)
+{
+	int i;
+
+	if (tables == stdout)
+	{
+		if (stdout_header)
+			return(0);
+		stdout_header = YES;
+		return(1);
+	}
+
+	for (i = 0; i < nboutfiles; i++)
+	{
+		if (outfiles[i].fp == tables)
+		{
+			if (outfiles[i].header)
+				return(0);
+			outfiles[i].header = YES;
+			return(1);
+		}
+	}
+
+	return(0);
+}
+
+
+
+/**********
+ *
+ * void output_text(void)
+ *
+ * tells that a text report is written to the report file, so that a
+ * CSV header is not printed after it (output_header).  rep_write calls
+ * it when the file is not text_file.
+ *
+ **********/
+
+void output_text(void)
+{
+	int i;
+
+	text_file = tables;
+	if (tables == stdout)
+	{
+		stdout_header = YES;
+		return;
+	}
+
+	for (i = 0; i < nboutfiles; i++)
+		if (outfiles[i].fp == tables)
+			outfiles[i].header = YES;
+}
+
+
+
+/**********
+ *
+ * void close_output_files(void)
+ *
+ * writes the reports left (rep_close) and closes the files opened by
+ * open_output_file.
+ *
+ **********/
+
+void close_output_files(void)
+{
+	int i;
+
+	rep_close();
+	tables = stdout;
+
+	for (i = 0; i < nboutfiles; i++)
+	{
+		fclose(outfiles[i].fp);
+		free(outfiles[i].name);
+	}
+
+	free(outfiles);
+	outfiles = NULL;
+	nboutfiles = 0;
+	capoutfiles = 0;
+}
+
+
+
 /**********
  *
  * ret_dates(struct s_options *pnt, char bfrom[], char bto[])
@@ -881,10 +1406,14 @@ int benchmark(struct s_options *opt, char bfrom[], char bto[])
 	int *kappa;
 	int i, nbdist, nbbench, j;
 	int prop, diff, index;
+	bool shifted;
+	struct s_solver_state *st;
 	char short_buf[SHORT_BUF_SIZE];
+	int got;
 
+	shifted = NO;
 	prop = (opt->algo.prop  ? 0 : 1);
-	diff = (opt->algo.first ? 1 : 2);
+	diff = (opt->algo.first ? 1 : (opt->algo.legacydiff ? 3 : 2));
 	index = (opt->algo.mean  ? 1 : 0);
 
 
@@ -892,7 +1421,10 @@ int benchmark(struct s_options *opt, char bfrom[], char bto[])
 	* read the series
 	**********/
 
-	if (!get_ser(opt, &bench, &dist, bfrom, bto))
+	STAT_BEGIN(PH_GET_SER);
+	got = get_ser(opt, &bench, &dist, bfrom, bto);
+	STAT_END(PH_GET_SER);
+	if (!got)
 		return(0);
 
 	nbdist = cal_nb_points(opt->ser_info.from, opt->ser_info.to, opt->ser_info.freq, opt->ser_info.freq);
@@ -900,11 +1432,14 @@ int benchmark(struct s_options *opt, char bfrom[], char bto[])
 	if (opt->algo.linked)
 		nbbench++;
 
-	tau     =    (int *)malloc(nbbench * sizeof(int));
-	kappa   =    (int *)malloc(nbbench * sizeof(int));
-	cor     = (double *)malloc(nbdist  * sizeof(double));
-	trget   = (double *)malloc(nbdist  * sizeof(double));
-	weights = (double *)malloc((nbdist+1)  * sizeof(double));
+	job_stats.tt = nbdist;
+	job_stats.mm = nbbench;
+
+	tau     =    (int *)qm_malloc(nbbench * sizeof(int));
+	kappa   =    (int *)qm_malloc(nbbench * sizeof(int));
+	cor     = (double *)qm_malloc(nbdist  * sizeof(double));
+	trget   = (double *)qm_malloc(nbdist  * sizeof(double));
+	weights = (double *)qm_malloc((nbdist+1)  * sizeof(double));
 
 
 	if (!(tau && kappa && cor && trget && weights))
@@ -922,7 +1457,9 @@ int benchmark(struct s_options *opt, char bfrom[], char bto[])
 	* calculate reference points
 	**********/
 
+	STAT_BEGIN(PH_DATES);
 	cal_tau_kappa(tau, kappa, opt, bfrom, bto);
+	STAT_END(PH_DATES);
 
 	for (i = 0; i < (nbdist+1); i++)
 		weights[i] = 1.0;
@@ -947,21 +1484,57 @@ int benchmark(struct s_options *opt, char bfrom[], char bto[])
 		}
 
 		nbbench--;
+		shifted = YES;
 	}
 
 	/**********
-	* benchmarking algorithm
+	* benchmarking algorithm.  With the incremental option the solver
+	* state of the previous run of the same series is reused and only
+	* the appended periods and benchmarks are computed.  In what-if mode
+	* the influence matrix of the series is kept and a new set of
+	* benchmark values only costs one product.  The series of Q_BATCHID
+	* are benchmarked together with this one, one per vector lane; not
+	* with the two options above, which keep the state of one series.
 	**********/
 
-	(void)benchmod(dist, trget, cor, bench, tau, kappa, weights, &prop, &diff, &index, nbdist, nbbench);
+	if ((opt->algo.whatif || opt->algo.incremental) && opt->series.nbbatch > 0)
+	{
+		if (lang == LANG_FRA)
+			sprintf(short_buf, "Les series de Q_BATCHID ne sont pas etalonnees avec Q_WHATIF ou Q_INCREMENTAL. Seule la serie du travail a ete etalonnee.");
+		else
+			sprintf(short_buf, "The series of Q_BATCHID are not benchmarked with Q_WHATIF or Q_INCREMENTAL. Only the series of the job was benchmarked.");
+
+		send_error(opt, short_buf);
+	}
+
+	STAT_BEGIN(PH_BENCHMOD);
+	if (opt->algo.whatif)
+	{
+		st = get_state(opt);
+		(void)benchmod_whatif(st, dist, trget, cor, bench, tau, kappa, weights, &prop, &diff, &index, opt->algo.rho, nbdist, nbbench);
+		keep_state(opt, st);
+	}
+	else if (opt->algo.incremental)
+	{
+		st = get_state(opt);
+		(void)benchmod_inc(st, dist, trget, cor, bench, tau, kappa, weights, &prop, &diff, &index, opt->algo.rho, nbdist, nbbench);
+		keep_state(opt, st);
+	}
+	else if (opt->series.nbbatch > 0)
+		(void)benchmark_batch(opt, bench, dist, trget, cor, tau, kappa, weights, nbdist, nbbench, prop, diff, index, bfrom, bto, shifted);
+	else
+		(void)benchmod(dist, trget, cor, bench, tau, kappa, weights, &prop, &diff, &index, opt->algo.rho, nbdist, nbbench);
+	STAT_END(PH_BENCHMOD);
 
 	/**********
 	* round if needed
 	*********/
 
-	if (opt->algo.round)
+	if (opt->algo.round && !(opt->algo.controlled && opt->series.nbbatch > 0 && !opt->algo.whatif && !opt->algo.incremental))
 	{
+		STAT_BEGIN(PH_ROUND);
 		roundser(trget, bench, tau, kappa, nbbench, nbdist, opt, bto);
+		STAT_END(PH_ROUND);
 	}
 
 	/**********
@@ -992,14 +1565,43 @@ int benchmark(struct s_options *opt, char bfrom[], char bto[])
 	**********/
 
 	if (opt->algo.update)
+	{
+		STAT_BEGIN(PH_UPDATE);
 		upd_ser(opt, trget);
+		STAT_END(PH_UPDATE);
+	}
 
 	/**********
 	* print the reports if needed
 	**********/
 
 	if (opt->reports.display)
-		print_reports(bench, dist, trget, nbdist, nbbench, opt, tau, kappa, cor);
+	{
+		STAT_BEGIN(PH_REPORTS);
+		print_reports(bench, dist, trget, nbdist, nbbench, opt, tau, kappa);
+		STAT_END(PH_REPORTS);
+	}
+
+	/**********
+	* print the revision study if asked
+	**********/
+
+	if (opt->reports.vintagefrom[0])
+		revision_study(opt, bench, dist, tau, kappa, weights, nbdist, nbbench, prop, diff, index);
+
+	/**********
+	* compare the variants of the sweep if asked
+	**********/
+
+	if (opt->reports.sweep[0])
+		sweep_study(opt, bench, dist, tau, kappa, weights, nbdist, nbbench);
+
+	/**********
+	* compare the values of rho of the grid if asked
+	**********/
+
+	if (opt->reports.rhogrid[0])
+		rho_study(opt, bench, dist, tau, kappa, weights, nbdist, nbbench, prop, diff, index);
 
 	free(bench);
 	free(dist);
@@ -1016,53 +1618,555 @@ int benchmark(struct s_options *opt, char bfrom[], char bto[])
 
 /**********
  *
- * int  get_ser(struct s_options *options, double **bench, double **dist,
- *              char bfrom[], char bto[])
- *
- * Function that reads the series from the work database.
- *
- * returns: 1 if everything o.k.
- *          0 else
+ * int benchmark_batch(struct s_options *opt, double *bench, double *dist,
+ *                     double *trget, double *cor, int *tau, int *kappa, double *w,
+ *                     int nbdist, int nbbench, int prop, int diff,
+ *                     int index, char bfrom[], char bto[], bool shifted)
+ *
+ * benchmarks the series of the job together with the series of
+ * Q_BATCHID ("bench,dist,target").  The batch series must have the
+ * dates of the job: their benchmarks are read from bfrom to bto and
+ * their distributors over the range of the job.  A batch series that
+ * cannot be read that way is reported and left out.  shifted tells
+ * that the second benchmark of a stock series was dropped (see
+ * benchmark), the same is done for the batch series.
+ *
+ * The series are solved by groups of batch_lanes(), one per vector
+ * lane (benchmod_batch).  The batch series are rounded, zeroed and
+ * updated here; the series of the job is returned in trget and goes
+ * through the usual steps with its corrections in cor.  With
+ * Q_CONTROLLED the batch series are the components of the series of
+ * the job and are rounded together (controlled_round), after option
+ * zero; the series of the job is returned rounded, as the sum of the
+ * rounded components.  If a batch series was left out, the series are
+ * rounded one by one and an error is reported.
+ *
+ * returns the number of batch series benchmarked.
  *
  **********/
 
-int get_ser(struct s_options *options, double **bench, double **dist, char bfrom[], char bto[])
+int benchmark_batch(struct s_options *opt, double *bench, double *dist, double *trget, double *cor, int *tau, int *kappa, double *w, int nbdist, int nbbench, int prop, int diff, int index, char bfrom[], char bto[], bool shifted)
 {
-	struct s_ser_info *pnt;
-	int nbbench, nbdist;
-	int start;
-	char base[MAX_FAME_NAME];
-	char freq[3];
-	char minimum[7];
-	char cont;
-	char bench_bool;
-	char less;
-	char benchid[MAX_FAME_NAME];
-	char trgetid[MAX_FAME_NAME];
-	char distid[MAX_FAME_NAME];
-	char short_buf[SHORT_BUF_SIZE];
-
-	strcpy(benchid, options->series.benchid);
-	strcpy(trgetid, options->series.targetid);
-	strcpy(distid, options->series.distributorid);
-
-
-	start = 0;
-	pnt = &options->ser_info;
-	strcpy(base, pnt->base);
-	strcpy(freq, "* ");
+	struct s_series saved;
+	double *lbench;
+	double *ldist;
+	double *xs;
+	double *ys;
+	double *bs;
+	double *cs;
+	double **sbench;
+	double **sdist;
+	double **strget;
+	int    *sid;
+	int     nbser, lanes, nbl;
+	int     s, g, l, i, j;
+	int     done;
+	bool    together;
+	char    lbfrom[7];
+	char    lbto[7];
+	char    short_buf[SHORT_BUF_SIZE];
+
+	saved = opt->series;
+	lanes = batch_lanes();
+
+	sbench = (double **)qm_malloc((saved.nbbatch + 1) * sizeof(double *));
+	sdist  = (double **)qm_malloc((saved.nbbatch + 1) * sizeof(double *));
+	strget = (double **)qm_malloc((saved.nbbatch + 1) * sizeof(double *));
+	sid    = (int *)qm_malloc((saved.nbbatch + 1) * sizeof(int));
+
+	if (!(sbench && sdist && strget && sid))
+	{
+		if (lang == LANG_FRA)
+			sprintf(short_buf, "Le Program ecrit en C n'a pu allouer assez de memoire. Essayer des series plus courtes");
+		else
+			sprintf(short_buf, "The C program could not allocate memory. You might want to try smaller series");
 
+		send_error(opt, short_buf);
+		free(sbench);
+		free(sdist);
+		free(strget);
+		free(sid);
+		(void)benchmod(dist, trget, cor, bench, tau, kappa, w, &prop, &diff, &index, opt->algo.rho, nbdist, nbbench);
+		if (opt->algo.round && opt->algo.controlled)
+			roundser(trget, bench, tau, kappa, nbbench, nbdist, opt, bto);
+		return(0);
+	}
 
 	/**********
-	* calculate number of point to retrieve for benchmarks and dist.
+	* series 0 is the one of the job
 	**********/
 
-	nbbench = cal_nb_points(bfrom, bto, pnt->benchfreq, pnt->benchfreq);
-	nbdist = cal_nb_points(pnt->from, pnt->to, pnt->freq, pnt->freq);
+	sbench[0] = bench;
+	sdist[0] = dist;
+	strget[0] = trget;
+	sid[0] = -1;
+	nbser = 1;
 
-	/**********
-	* if linked, need to retrieve one more benchmark.
-	**********/
+	for (s = 0; s < saved.nbbatch; s++)
+	{
+		strcpy(opt->series.benchid, saved.batchid[s][0]);
+		strcpy(opt->series.distributorid, saved.batchid[s][1]);
+		strcpy(opt->series.targetid, saved.batchid[s][2]);
+		strcpy(lbfrom, bfrom);
+		strcpy(lbto, bto);
+
+		if (!get_ser(opt, &lbench, &ldist, lbfrom, lbto))
+			continue;
+
+		if (strcmp(lbto, bto) != 0 || (strget[nbser] = (double *)qm_malloc(nbdist * sizeof(double))) == NULL)
+		{
+			if (lang == LANG_FRA)
+				sprintf(short_buf, "La serie jalon n'a pu etre lue aux dates du travail. La serie n'a pas ete etalonnee avec le lot.");
+			else
+				sprintf(short_buf, "The benchmark series could not be read with the dates of the job. The series was not benchmarked with the batch.");
+
+			send_error(opt, short_buf);
+			free(lbench);
+			free(ldist);
+			continue;
+		}
+
+		if (shifted)
+			for (i = 2; i <= nbbench; i++)
+				lbench[i-1] = lbench[i];
+
+		sbench[nbser] = lbench;
+		sdist[nbser] = ldist;
+		sid[nbser] = s;
+		nbser++;
+	}
+
+	opt->series = saved;
+
+	xs = (double *)qm_malloc(nbdist * lanes * sizeof(double));
+	bs = (double *)qm_malloc(nbdist * lanes * sizeof(double));
+	cs = (double *)qm_malloc(nbdist * lanes * sizeof(double));
+	ys = (double *)qm_malloc(nbbench * lanes * sizeof(double));
+
+	if (!(xs && bs && cs && ys))
+	{
+		if (lang == LANG_FRA)
+			sprintf(short_buf, "Le Program ecrit en C n'a pu allouer assez de memoire. Essayer des series plus courtes");
+		else
+			sprintf(short_buf, "The C program could not allocate memory. You might want to try smaller series");
+
+		send_error(opt, short_buf);
+		for (s = 1; s < nbser; s++)
+		{
+			free(sbench[s]);
+			free(sdist[s]);
+			free(strget[s]);
+		}
+		lanes = 0;
+		nbser = 1;
+		(void)benchmod(dist, trget, cor, bench, tau, kappa, w, &prop, &diff, &index, opt->algo.rho, nbdist, nbbench);
+	}
+
+	for (g = 0; g < nbser && lanes > 0; g += lanes)
+	{
+		/**********
+		* lane l holds series g+l, the unused lanes repeat the
+		* first one of the group
+		**********/
+
+		nbl = (nbser - g < lanes) ? nbser - g : lanes;
+		for (l = 0; l < lanes; l++)
+		{
+			s = g + (l < nbl ? l : 0);
+			for (i = 0; i < nbdist; i++)
+				xs[i*lanes + l] = sdist[s][i];
+			for (i = 0; i < nbbench; i++)
+				ys[i*lanes + l] = sbench[s][i];
+		}
+
+		(void)benchmod_batch(nbl, lanes, xs, bs, cs, ys, tau, kappa, w, prop, diff, index, opt->algo.rho, nbdist, nbbench);
+
+		for (l = 0; l < nbl; l++)
+			for (i = 0; i < nbdist; i++)
+				strget[g + l][i] = bs[i*lanes + l];
+
+		if (g == 0)
+			for (i = 0; i < nbdist; i++)
+				cor[i] = cs[i*lanes];
+	}
+
+	/**********
+	* option zero on the batch series, before the rounding so that the
+	* rounded components still add up to the series of the job
+	**********/
+
+	if (opt->algo.zero)
+	{
+		for (s = 1; s < nbser; s++)
+		{
+			for (i = 0; i < nbbench; i++)
+			{
+				if (sbench[s][i] == 0)
+				{
+					for (j = tau[i] - 1; j <= kappa[i] - 1; j++)
+						strget[s][j] = 0;
+				}
+			}
+		}
+	}
+
+	/**********
+	* rounding: the batch series one by one, or with Q_CONTROLLED the
+	* batch series as the components of the series of the job, which
+	* is then their sum.  The components must all be there: if a batch
+	* series was left out, each series is rounded alone.
+	**********/
+
+	together = opt->algo.round && opt->algo.controlled && nbser > 1 && nbser - 1 == saved.nbbatch;
+
+	if (opt->algo.round && opt->algo.controlled && !together)
+	{
+		if (lanes > 0)
+		{
+			if (lang == LANG_FRA)
+				sprintf(short_buf, "Des series du lot n'ont pu etre lues. Les series ont ete arrondies une a une, sans arrondi controle.");
+			else
+				sprintf(short_buf, "Some series of the batch could not be read. The series were rounded one by one, without controlled rounding.");
+
+			send_error(opt, short_buf);
+		}
+		roundser(trget, bench, tau, kappa, nbbench, nbdist, opt, bto);
+	}
+	else if (together)
+	{
+		if ((i = controlled_round(&strget[1], &sbench[1], nbser - 1, trget, tau, kappa, nbbench, nbdist, opt->algo.linked, opt->algo.decs)) != 0)
+		{
+			if (i < 0 && lang == LANG_FRA)
+				sprintf(short_buf, "Le Program ecrit en C n'a pu allouer assez de memoire. Les series n'ont pas ete arrondies");
+			else if (i < 0)
+				sprintf(short_buf, "The C program could not allocate enough memory. The series were not rounded");
+			else if (lang == LANG_FRA)
+				sprintf(short_buf, "L'arrondi controle s'ecarte de plus d'une unite de la somme des composantes a %d periodes", i);
+			else
+				sprintf(short_buf, "The controlled rounding is more than one unit away from the sum of the components at %d periods", i);
+
+			send_error(opt, short_buf);
+		}
+	}
+
+	done = 0;
+	for (s = 1; s < nbser; s++)
+	{
+		strcpy(opt->series.benchid, saved.batchid[sid[s]][0]);
+		strcpy(opt->series.distributorid, saved.batchid[sid[s]][1]);
+		strcpy(opt->series.targetid, saved.batchid[sid[s]][2]);
+
+		if (opt->algo.round && !together)
+			roundser(strget[s], sbench[s], tau, kappa, nbbench, nbdist, opt, bto);
+
+		if (opt->algo.update)
+			(void)batch_update(opt, strget[s]);
+
+		done++;
+	}
+
+	opt->series = saved;
+
+	for (s = 1; s < nbser; s++)
+	{
+		free(sbench[s]);
+		free(sdist[s]);
+		free(strget[s]);
+	}
+
+	free(sbench);
+	free(sdist);
+	free(strget);
+	free(sid);
+	free(xs);
+	free(bs);
+	free(cs);
+	free(ys);
+
+	return(done);
+}
+
+
+
+/**********
+ *
+ * int batch_update(struct s_options *opt, double *trget)
+ *
+ * updates the target of a batch series.  The Fame procedure only
+ * copies WORK'Q_TMP_UPDATED_SER into the target of the job, so the
+ * copy is done here for the series of Q_BATCHID.
+ *
+ * returns:	1 if everything o.k.
+ *		    0 else
+ *
+ **********/
+
+int batch_update(struct s_options *opt, double *trget)
+{
+	int status;
+	char fame_cmd[BUFSIZ];
+	char short_buf[SHORT_BUF_SIZE];
+
+	upd_ser(opt, trget);
+
+	sprintf(fame_cmd, "frequency %s; date %d:%d to %d:%d; which not missing(WORK'Q_TMP_UPDATED_SER); set %s = WORK'Q_TMP_UPDATED_SER",
+		(opt->ser_info.freq == 12 ? "monthly" : "quarterly"),
+		atoi(opt->algo.updatefrom) / 100, atoi(opt->algo.updatefrom+4),
+		atoi(opt->ser_info.to) / 100, atoi(opt->ser_info.to+4),
+		opt->series.targetid);
+
+	STAT_BEGIN(PH_CFMFAME);
+	cfmfame(&status, fame_cmd);
+	STAT_END(PH_CFMFAME);
+
+	if (status != HSUCC)
+	{
+		if (lang == LANG_FRA)
+			sprintf(short_buf, "Le Program ecrit en C n'a pu mettre a jour la serie cible");
+		else
+			sprintf(short_buf, "The C Program could not update the target series");
+
+		send_error(opt, short_buf);
+		return(0);
+	}
+
+	return(1);
+}
+
+
+
+/**********
+ *
+ * struct s_solver_state *get_state(struct s_options *opt)
+ *
+ * Returns the solver state of the series of the job.  The states of
+ * the last MAX_STATES series processed in the session are kept in
+ * memory.  When a series is not found, the least recently used state
+ * is recycled and, if a state file was given, loaded from it.
+ *
+ * The key is the distributor and the target: the benchmark series may
+ * change from one job to the other (what-if values, revised benchmarks),
+ * benchmod_inc checks what can be kept.
+ *
+ **********/
+
+#define MAX_STATES 16
+
+static struct s_solver_state states[MAX_STATES];
+static long state_clock = 0;
+
+struct s_solver_state *get_state(struct s_options *opt)
+{
+	struct s_solver_state *st;
+	char key[3*MAX_FAME_NAME];
+	int i;
+
+	sprintf(key, "%s|%s", opt->series.distributorid, opt->series.targetid);
+
+	st = &states[0];
+	for (i = 0; i < MAX_STATES; i++)
+	{
+		if (strcmp(states[i].key, key) == 0)
+		{
+			st = &states[i];
+			st->stamp = ++state_clock;
+			return(st);
+		}
+
+		if (states[i].stamp < st->stamp)
+			st = &states[i];
+	}
+
+	free_state(st);
+	strcpy(st->key, key);
+	st->stamp = ++state_clock;
+
+	if (strcmp(opt->algo.statefile, "") != 0)
+		(void)load_state(opt->algo.statefile, st);
+
+	return(st);
+}
+
+
+
+/**********
+ *
+ * void keep_state(struct s_options *opt, struct s_solver_state *st)
+ *
+ * Writes the state to the state file of the job, if there is one, so
+ * the next session can start from it.
+ *
+ **********/
+
+void keep_state(struct s_options *opt, struct s_solver_state *st)
+{
+	char short_buf[SHORT_BUF_SIZE];
+
+	if (strcmp(opt->algo.statefile, "") == 0 || !st->valid)
+		return;
+
+	if (!save_state(opt->algo.statefile, st))
+	{
+		if (lang == LANG_FRA)
+			snprintf(short_buf, sizeof(short_buf), "Le Program ecrit en C n'a pu ecrire le fichier d'etat %.*s", SHORT_BUF_SIZE - 80, opt->algo.statefile);
+		else
+			snprintf(short_buf, sizeof(short_buf), "The C Program could not write the state file %.*s", SHORT_BUF_SIZE - 80, opt->algo.statefile);
+
+		send_error(opt, short_buf);
+	}
+}
+
+
+
+/**********
+ *
+ * int save_state(char *file_name, struct s_solver_state *st)
+ * int load_state(char *file_name, struct s_solver_state *st)
+ *
+ * Write and read a solver state.  The file is binary, it starts with
+ * STATE_MAGIC and the key of the series, then the sizes and the arrays
+ * (only the used part of qinvw and of the factor).  A file written for
+ * another series or by another version is ignored.
+ *
+ * returns: 1 if everything o.k.
+ *          0 else
+ *
+ **********/
+
+#define STATE_MAGIC "QUADMIN STATE 2"
+
+int save_state(char *file_name, struct s_solver_state *st)
+{
+	FILE *fp;
+	int r;
+	int ok;
+
+	if ((fp = fopen(file_name, "wb")) == NULL)
+		return(0);
+
+	ok = fwrite(STATE_MAGIC, sizeof(STATE_MAGIC), 1, fp) == 1;
+	ok = ok && fwrite(st->key, sizeof(st->key), 1, fp) == 1;
+	ok = ok && fwrite(&st->prop, sizeof(int), 1, fp) == 1;
+	ok = ok && fwrite(&st->rho, sizeof(double), 1, fp) == 1;
+	ok = ok && fwrite(&st->tt, sizeof(int), 1, fp) == 1;
+	ok = ok && fwrite(&st->mm, sizeof(int), 1, fp) == 1;
+	ok = ok && fwrite(&st->xbar, sizeof(double), 1, fp) == 1;
+	ok = ok && fwrite(st->tau, sizeof(int), st->mm, fp) == (size_t)st->mm;
+	ok = ok && fwrite(st->kappa, sizeof(int), st->mm, fp) == (size_t)st->mm;
+	ok = ok && fwrite(st->x, sizeof(double), st->tt, fp) == (size_t)st->tt;
+	ok = ok && fwrite(st->cor, sizeof(double), st->tt, fp) == (size_t)st->tt;
+	ok = ok && fwrite(st->invy, sizeof(double), st->mm, fp) == (size_t)st->mm;
+
+	for (r = 0; r < st->tt && ok; r++)
+		ok = fwrite(&st->qinvw[r*st->mcap], sizeof(double), st->mm, fp) == (size_t)st->mm;
+
+	for (r = 0; r < st->mm && ok; r++)
+		ok = fwrite(&st->chol[r*st->mcap], sizeof(double), r + 1, fp) == (size_t)(r + 1);
+
+	if (fclose(fp) != 0)
+		ok = 0;
+
+	return(ok);
+}
+
+int load_state(char *file_name, struct s_solver_state *st)
+{
+	FILE *fp;
+	char magic[sizeof(STATE_MAGIC)];
+	char key[sizeof(st->key)];
+	int prop, tt, mm;
+	double rho;
+	int r;
+	int ok;
+
+	if ((fp = fopen(file_name, "rb")) == NULL)
+		return(0);
+
+	ok = fread(magic, sizeof(magic), 1, fp) == 1 && memcmp(magic, STATE_MAGIC, sizeof(magic)) == 0;
+	ok = ok && fread(key, sizeof(key), 1, fp) == 1 && strcmp(key, st->key) == 0;
+	ok = ok && fread(&prop, sizeof(int), 1, fp) == 1;
+	ok = ok && fread(&rho, sizeof(double), 1, fp) == 1;
+	ok = ok && fread(&tt, sizeof(int), 1, fp) == 1;
+	ok = ok && fread(&mm, sizeof(int), 1, fp) == 1;
+	ok = ok && tt > 0 && mm > 0 && state_alloc(st, tt, mm);
+	ok = ok && fread(&st->xbar, sizeof(double), 1, fp) == 1;
+	ok = ok && fread(st->tau, sizeof(int), mm, fp) == (size_t)mm;
+	ok = ok && fread(st->kappa, sizeof(int), mm, fp) == (size_t)mm;
+	ok = ok && fread(st->x, sizeof(double), tt, fp) == (size_t)tt;
+	ok = ok && fread(st->cor, sizeof(double), tt, fp) == (size_t)tt;
+	ok = ok && fread(st->invy, sizeof(double), mm, fp) == (size_t)mm;
+
+	for (r = 0; r < tt && ok; r++)
+		ok = fread(&st->qinvw[r*st->mcap], sizeof(double), mm, fp) == (size_t)mm;
+
+	for (r = 0; r < mm && ok; r++)
+		ok = fread(&st->chol[r*st->mcap], sizeof(double), r + 1, fp) == (size_t)(r + 1);
+
+	fclose(fp);
+
+	if (ok)
+	{
+		st->prop = prop;
+		st->rho = rho;
+		st->tt = tt;
+		st->mm = mm;
+		st->valid = 1;
+	}
+
+	return(ok);
+}
+
+
+
+/**********
+ *
+ * int  get_ser(struct s_options *options, double **bench, double **dist,
+ *              char bfrom[], char bto[])
+ *
+ * Function that reads the series from the work database.
+ *
+ * returns: 1 if everything o.k.
+ *          0 else
+ *
+ **********/
+
+int get_ser(struct s_options *options, double **bench, double **dist, char bfrom[], char bto[])
+{
+	struct s_ser_info *pnt;
+	int nbbench, nbdist;
+	int start;
+	char base[MAX_FAME_NAME];
+	char freq[3];
+	char minimum[7];
+	char cont;
+	char bench_bool;
+	char less;
+	char benchid[MAX_FAME_NAME];
+	char trgetid[MAX_FAME_NAME];
+	char distid[MAX_FAME_NAME];
+	char short_buf[SHORT_BUF_SIZE];
+
+	strcpy(benchid, options->series.benchid);
+	strcpy(trgetid, options->series.targetid);
+	strcpy(distid, options->series.distributorid);
+
+
+	start = 0;
+	pnt = &options->ser_info;
+	strcpy(base, pnt->base);
+	strcpy(freq, "* ");
+
+
+	/**********
+	* calculate number of point to retrieve for benchmarks and dist.
+	**********/
+
+	nbbench = cal_nb_points(bfrom, bto, pnt->benchfreq, pnt->benchfreq);
+	nbdist = cal_nb_points(pnt->from, pnt->to, pnt->freq, pnt->freq);
+
+	/**********
+	* if linked, need to retrieve one more benchmark.
+	**********/
 
 	if (options->algo.linked)
 	{
@@ -1074,8 +2178,8 @@ int get_ser(struct s_options *options, double **bench, double **dist, char bfrom
 	* Allocate space.
 	**********/
 
-	*bench = (double *) malloc((size_t)(nbbench * sizeof(double)));
-	*dist  = (double *) malloc((size_t)(nbdist  * sizeof(double)));
+	*bench = (double *) qm_malloc((size_t)(nbbench * sizeof(double)));
+	*dist  = (double *) qm_malloc((size_t)(nbdist  * sizeof(double)));
 
 
 	if (!(*bench && *dist))
@@ -1227,8 +2331,6 @@ int read_series(char *base_name, int freq, char *from, char *to, double *out, ch
 	int status;
 	int tfreq;
 	int range[3];
-	int i;
-	bool missing;
 	char fame_cmd[BUFSIZ];
 	char tmp_ser_name[MAX_FAME_NAME];
 
@@ -1259,13 +2361,17 @@ int read_series(char *base_name, int freq, char *from, char *to, double *out, ch
 
 	sprintf(fame_cmd, "date %04.4d to %04.04d; copy <overwrite on> %s as Q_TMP_SER to WORK", syear, eyear, ser_name);
 
+	STAT_BEGIN(PH_CFMFAME);
 	cfmfame(&status, fame_cmd);
+	STAT_END(PH_CFMFAME);
 
 	if (status != HSUCC)
 		return(0);
 
 
+	STAT_BEGIN(PH_CFMSRNG);
 	cfmsrng(&status, tfreq, &syear, &sprd, &eyear, &eprd, range, &numobs);
+	STAT_END(PH_CFMSRNG);
 
 	if (status != HSUCC)
 		return(0);
@@ -1273,8 +2379,9 @@ int read_series(char *base_name, int freq, char *from, char *to, double *out, ch
 
 	strcpy(tmp_ser_name, "Q_TMP_SER");
 
+	STAT_BEGIN(PH_CFMRRNG);
 	cfmrrng(&status, workkey, tmp_ser_name, range, out, HTMIS, mistt);
-
+	STAT_END(PH_CFMRRNG);
 
 	if (status != HSUCC)
 	{
@@ -1282,11 +2389,10 @@ int read_series(char *base_name, int freq, char *from, char *to, double *out, ch
 	}
 	else
 	{
-		missing = 0;
-		for (i = 0; i < numobs && missing == 0; i++)
-			missing = (out[i] == MISSNC || out[i] == MISSND || out[i] == MISSNA);
+		if (stats_on)
+			job_stats.bytes_read += (double)numobs * sizeof(double);
 
-		if (missing)
+		if (any_missing(out, numobs))
 			ret_val = 2;
 	}
 
@@ -1407,6 +2513,8 @@ void cal_tau_kappa(int *tau, int *kappa, struct s_options *options, char bfrom[]
  * We loop and call distribround with every benchmark and corresponding
  * target values.  For target values that are not covered by benchmark
  * we pass the Yearly (or quaterly) sum.
+ * The three kinds of periods are put in a table of segments and rounded
+ * in one sweep by round_segments.
  *
  * tau and kappa give the reference periods of the benchmark on the
  * targets. tau = start period. kappa = end period.
@@ -1421,77 +2529,105 @@ void roundser(double *trget, double *bench, int *tau, int *kappa, int nbbench, i
 {
 	int start;
 	int initial_start;
-	int nvalue, ndecs;
-	int i,j;
+	int nvalue;
+	int i;
 	int len;
 	int remain;
-	unsigned int stcrounding;
-	double result[12];
-	double sum;
+	int nbseg;
+	int level;
+	struct s_segment *seg;
+	char short_buf[SHORT_BUF_SIZE];
 
 	start = 0;
 	if (opt->algo.linked)
 		start = 1;
 	initial_start = start;
-	stcrounding = 0;
-	ndecs = opt->algo.decs;
 
+	if (nbbench <= start)
+		return;
 
+	nvalue = kappa[nbbench-1] - tau[nbbench-1] + 1;
+	len = (nbdist - kappa[nbbench-1] + nvalue - 1) / nvalue;
+	if (len < 0)
+		len = 0;
 
-	/**********
-	* periods that are covered by benchmarks
-	**********/
+	seg = (struct s_segment *)qm_malloc((nbbench + len + 1) * sizeof(struct s_segment));
 
-	for (i = start; i < nbbench; i++)
+	if (!seg)
 	{
-		start = tau[i] -1;
-		nvalue = kappa[i] - start;
+		if (lang == LANG_FRA)
+			sprintf(short_buf, "Le Program ecrit en C n'a pu allouer assez de memoire. La serie n'a pas ete arrondie");
+		else
+			sprintf(short_buf, "The C program could not allocate enough memory. The series was not rounded");
 
-		distribround(&trget[start], bench[i], nvalue, ndecs, result);
-		for (j = 0; j < nvalue; j++)
-		{
-			trget[start+j] = result[j];
-		}
+		send_error(opt, short_buf);
+		return;
 	}
 
+	nbseg = 0;
+
 	/**********
-	* periods not complete before benchmarks
+	* periods that are covered by benchmarks
 	**********/
 
+	for (i = start; i < nbbench; i++, nbseg++)
+	{
+		seg[nbseg].start = tau[i] - 1;
+		seg[nbseg].length = kappa[i] - tau[i] + 1;
+		seg[nbseg].sumlen = 0;
+		seg[nbseg].level = 0;
+		seg[nbseg].total = bench[i];
+	}
+
+	/**********
+	* periods not complete before benchmarks, after the benchmarks
+	* they may overlap
+	**********/
+
+	level = 0;
 	remain = (tau[initial_start] -1) % nvalue;
 	if (remain != 0)
 	{
-		for (j = 0, sum = 0; j < remain; j++)
-			sum += (double)trget[initial_start+j];
-
-		distribround(&trget[initial_start], sum, nvalue, ndecs, result);
-		for (j = 0; j < nvalue; j++)
-			trget[initial_start+j] = result[j];
+		level = 1;
+		seg[nbseg].start = initial_start;
+		seg[nbseg].length = nvalue;
+		seg[nbseg].sumstart = initial_start;
+		seg[nbseg].sumlen = remain;
+		seg[nbseg].level = level;
+		nbseg++;
 	}
 
 	/**********
-	* periods that are not covered by benchmarks
+	* periods that are not covered by benchmarks, by groups of the
+	* width of the last benchmark
 	*********/
 
-	len = (nbdist - (start+j)) / nvalue;
-	remain = (nbdist - (start+j)) % nvalue;
-	if (remain != 0)
-		len++;
-
-	start = start + nvalue;
+	start = kappa[nbbench-1];
+	if (level == 1 && start < initial_start + nvalue)
+		level = 2;
+	else
+		level = 0;
 
-	for (i = 0 ; i < len ; i++, start +=  nvalue)
+	for (i = 0; i < len; i++, start += nvalue, nbseg++)
 	{
-		if (i == len -1  && remain != 0)
-			nvalue = remain;
+		seg[nbseg].start = start;
+		seg[nbseg].length = (start + nvalue <= nbdist) ? nvalue : nbdist - start;
+		seg[nbseg].sumstart = start;
+		seg[nbseg].sumlen = seg[nbseg].length;
+		seg[nbseg].level = level;
+	}
 
-		for (j = 0, sum = 0; j < nvalue; j++)
-			sum += (double)trget[start+j];
+	if (!round_segments(trget, seg, nbseg, opt->algo.decs))
+	{
+		if (lang == LANG_FRA)
+			sprintf(short_buf, "Le Program ecrit en C n'a pu allouer assez de memoire. La serie n'a pas ete arrondie");
+		else
+			sprintf(short_buf, "The C program could not allocate enough memory. The series was not rounded");
 
-		distribround(&trget[start], sum, nvalue, ndecs, result);
-		for (j = 0; j < nvalue; j++)
-			trget[start+j] = result[j];
+		send_error(opt, short_buf);
 	}
+
+	free(seg);
 }
 
 
@@ -1499,22 +2635,21 @@ void roundser(double *trget, double *bench, int *tau, int *kappa, int nbbench, i
 /**********
  *
  * print_reports(double *bench, double *dist, double *trget, int nbdist,
- *               int nbbench, struct s_options *opt, int *tau, int *kappa,
- *               double *af)
+ *               int nbbench, struct s_options *opt, int *tau, int *kappa)
  *
  * Procedure to print the reports.  One report is  printed by
  * default and there 3 other kind of reports that can be printed if
- * asked for.
+ * asked for.  With Q_REPORT_FORMAT CSV or JSONL the reports are
+ * records instead (print_records).  The factors, differences and
+ * growth rates are computed once by report_analytics.
  *
  **********/
 
-void print_reports(double *bench, double *dist, double *trget, int nbdist, int nbbench, struct s_options *opt, int *tau, int *kappa, double *af)
+void print_reports(double *bench, double *dist, double *trget, int nbdist, int nbbench, struct s_options *opt, int *tau, int *kappa)
 {
-	double *result;
-	int lag;
 	int benchfreq, freq;
 	int ndec;
-	int i, div, start;
+	int div, start;
 	int setnum;
 	char from[7];
 	char title[BUFSIZ];
@@ -1538,6 +2673,23 @@ void print_reports(double *bench, double *dist, double *trget, int nbdist, int n
 			div = 3;
 	}
 
+	if (!report_analytics(&analytics, dist, trget, nbdist, opt->algo.prop, opt->reports.lag))
+	{
+		if (lang == LANG_FRA)
+			sprintf(title, "Le Program ecrit en C n'a pu allouer assez de memoire. Les rapports n'ont pas ete imprimes");
+		else
+			sprintf(title, "The C program could not allocate enough memory. The reports were not printed");
+
+		send_error(opt, title);
+		return;
+	}
+
+	if (opt->reports.format != REPORT_TEXT)
+	{
+		print_records(dist, trget, nbdist, nbbench, opt, tau, kappa, div);
+		return;
+	}
+
 	parameter = (char **)malloc(1 * sizeof(char *));
 	setnum = 4;
 
@@ -1546,26 +2698,24 @@ void print_reports(double *bench, double *dist, double *trget, int nbdist, int n
 	ndec = opt->algo.decs;
 	freq = opt->ser_info.freq;
 	benchfreq = opt->ser_info.benchfreq;
-	lag = 1;
-	result = (double *)malloc(nbdist * sizeof(double));
 
 	/**********
 	* print default report
 	**********/
 
-	fprintf(tables, " \n");
+	rep_puts(" \n");
 
 	prnt_replace(parameter, setnum, lang, 7, title, 0);
-	fprintf(tables, " BENCHID       = %s\n", opt->series.benchid);
-	fprintf(tables, " DISTRIBUTORID = %s\n", opt->series.distributorid);
-	fprintf(tables, " TARGETID      = %s\n\n", opt->series.targetid);
+	rep_printf(" BENCHID       = %s\n", opt->series.benchid);
+	rep_printf(" DISTRIBUTORID = %s\n", opt->series.distributorid);
+	rep_printf(" TARGETID      = %s\n\n", opt->series.targetid);
 	prnt_replace(parameter, setnum, lang, 16, title, 0);
 	print_default(dist, trget, from, freq, benchfreq, nbdist, ndec, div,
 				  opt->algo.stock, &prnt);
 	if (prnt)
 		prnt_replace(parameter, setnum, lang, 13, title, 0);
 
-	fprintf(tables, "\n\n\n");
+	rep_puts("\n\n\n");
 
 	if (opt->ser_info.fiscallag)
 	{
@@ -1588,7 +2738,7 @@ void print_reports(double *bench, double *dist, double *trget, int nbdist, int n
 		if (prnt)
 			prnt_replace(parameter, setnum, lang, 14, title, 0);
 
-		fprintf(tables, "\n\n\n");
+		rep_puts("\n\n\n");
 
 		if (opt->algo.linked)
 			nbbench++;
@@ -1598,7 +2748,7 @@ void print_reports(double *bench, double *dist, double *trget, int nbdist, int n
 	prnt_replace(parameter, setnum, lang, 6, title, 1);
 
 	prnt_data(from, nbdist, freq, ndec, dist, opt->reports.arates, (char)1);
-	fprintf(tables, "\n\n\n");
+	rep_puts("\n\n\n");
 
 	parameter[0] = opt->series.targetid;
 	prnt_replace(parameter, setnum, lang, 9, title, 1);
@@ -1611,14 +2761,10 @@ void print_reports(double *bench, double *dist, double *trget, int nbdist, int n
 
 	if (opt->reports.fact)
 	{
-		fprintf(tables, "\n\n\n");
-		cal_fac(af, trget, dist, nbdist, opt->algo.prop);
-		for (i = 0; i < nbdist; i++)
-			result[i] = af[i];
-
+		rep_puts("\n\n\n");
 		prnt_replace(parameter, setnum, lang, 10, title, 0);
 
-		prnt_data(from, nbdist, freq, ndec, result, (char)NO, (char)NO);
+		prnt_data(from, nbdist, freq, ndec, analytics.fac, (char)NO, (char)NO);
 	}
 
 	/**********
@@ -1627,22 +2773,20 @@ void print_reports(double *bench, double *dist, double *trget, int nbdist, int n
 
 	if (opt->reports.diff)
 	{
-		fprintf(tables, "\n\n\n");
+		rep_puts("\n\n\n");
 		prnt_replace(parameter, setnum, lang, 11, title, 0);
 		parameter[0] = opt->series.distributorid;
 		prnt_replace(parameter, setnum, lang, 18, title, 1);
 
-		firstdiff(&nbdist, &lag, dist, result);
-		prnt_data(from, nbdist, freq, ndec, result, (char)NO, (char)NO);
+		prnt_data(from, nbdist, freq, ndec, analytics.ddist, (char)NO, (char)NO);
 
-		fprintf(tables, "\n\n\n");
+		rep_puts("\n\n\n");
 		prnt_replace(parameter, setnum, lang, 11, title, 0);
 
 		parameter[0] = opt->series.targetid;
 		prnt_replace(parameter, setnum, lang, 19, title, 1);
 
-		firstdiff(&nbdist, &lag, trget, result);
-		prnt_data(from, nbdist, freq, ndec, result, (char)NO, (char)NO);
+		prnt_data(from, nbdist, freq, ndec, analytics.dtrget, (char)NO, (char)NO);
 	}
 
 	/**********
@@ -1651,31 +2795,468 @@ void print_reports(double *bench, double *dist, double *trget, int nbdist, int n
 
 	if (opt->reports.gr)
 	{
-		lag = opt->reports.lag;
-
-		fprintf(tables, "\n\n\n");
+		rep_puts("\n\n\n");
 		prnt_replace(parameter, setnum, lang, 12, title, 0);
 
 		parameter[0] = opt->series.distributorid;
 		prnt_replace(parameter, setnum, lang, 18, title, 1);
 
-		percent(&nbdist, &lag, dist, result);
-		prnt_data(from, nbdist, freq, 2, result, (char)NO, (char)NO);
+		prnt_data(from, nbdist, freq, 2, analytics.grdist, (char)NO, (char)NO);
 
-		fprintf(tables, "\n\n\n");
+		rep_puts("\n\n\n");
 		prnt_replace(parameter, setnum, lang, 12, title, 0);
 
 		parameter[0] = opt->series.targetid;
 		prnt_replace(parameter, setnum, lang, 19, title, 1);
 
-		percent(&nbdist, &lag, trget, result);
-		prnt_data(from, nbdist, freq, 2, result, (char)NO, (char)NO);
+		prnt_data(from, nbdist, freq, 2, analytics.grtrget, (char)NO, (char)NO);
 		printf("\n");
 	}
 
 	free(parameter);
-	free(result);
-	fflush(tables);
+	rep_flush();
+}
+
+
+
+/**********
+ *
+ * print_records(double *dist, double *trget, int nbdist, int nbbench,
+ *               struct s_options *opt, int *tau, int *kappa, int div)
+ *
+ * The reports of print_reports as records, one per line, in CSV or
+ * JSON Lines (Q_REPORT_FORMAT): the totals of the default report
+ * (kind "total") and of the fiscal report (kind "fiscal"), with the
+ * same periods and flags as the text, then one record per period
+ * (kind "period") with the factors and growth rates of
+ * report_analytics.  The CSV header is printed once per file.
+ *
+ **********/
+
+void print_records(double *dist, double *trget, int nbdist, int nbbench, struct s_options *opt, int *tau, int *kappa, int div)
+{
+	double gr[2];
+	int start, i;
+	char date[7];
+	char prnt;
+
+	if (opt->reports.format == REPORT_CSV && output_header())
+		rep_puts("series,kind,from,to,flag,dist,trget,factor,difference,dist_growth,trget_growth\n");
+
+	report_format = opt->reports.format;
+	report_series = opt->series.targetid;
+
+	report_kind = "total";
+	print_default(dist, trget, opt->ser_info.from, opt->ser_info.freq, opt->ser_info.benchfreq,
+				  nbdist, opt->algo.decs, div, opt->algo.stock, &prnt);
+
+	if (opt->ser_info.fiscallag)
+	{
+		start = opt->algo.linked ? 1 : 0;
+		report_kind = "fiscal";
+		print_fisc(dist, trget, &tau[start], &kappa[start], nbdist, nbbench - start, opt->algo.decs,
+				   opt->ser_info.freq, opt->ser_info.benchfreq, opt->ser_info.from, div, opt->algo.stock, &prnt);
+	}
+
+	strcpy(date, opt->ser_info.from);
+	for (i = 0; i < nbdist; i++, add_date(date, opt->ser_info.freq, 1))
+	{
+		gr[0] = analytics.grdist[i];
+		gr[1] = analytics.grtrget[i];
+
+		rep_record("period", date, date, "", opt->algo.decs, dist[i], trget[i], analytics.fac[i], trget[i] - dist[i],
+				   (i >= opt->reports.lag) ? gr : NULL);
+	}
+
+	report_format = REPORT_TEXT;
+	rep_flush();
+}
+
+
+
+/**********
+ *
+ * void revision_study(struct s_options *opt, double *bench, double *dist,
+ *                     int *tau, int *kappa, double *w, int nbdist,
+ *                     int nbbench, int prop, int diff, int index)
+ *
+ * benchmarks the series again for every cutoff date from vintagefrom to
+ * the to date, as if the job had been run with that cutoff as to date,
+ * and prints the values by cutoff followed by the revisions with
+ * respect to the last cutoff.  The values are not rounded.
+ *
+ **********/
+
+void revision_study(struct s_options *opt, double *bench, double *dist, int *tau, int *kappa, double *w, int nbdist, int nbbench, int prop, int diff, int index)
+{
+	double *out;
+	int *ttv;
+	int nbvint, last;
+	int r, v;
+	int ndec, freq;
+	char date[7];
+	char title[BUFSIZ];
+	char short_buf[SHORT_BUF_SIZE];
+	char **parameter;
+
+	freq = opt->ser_info.freq;
+	ndec = opt->algo.decs;
+
+	nbvint = cal_nb_points(opt->reports.vintagefrom, opt->ser_info.to, freq, freq);
+	if (nbvint < 1)
+		return;
+	if (nbvint > nbdist)
+		nbvint = nbdist;
+	last = nbvint - 1;
+
+	out = (double *)qm_malloc(nbdist * nbvint * sizeof(double));
+	ttv = (int *)qm_malloc(nbvint * sizeof(int));
+	parameter = (char **)malloc(1 * sizeof(char *));
+
+	if (!(out && ttv && parameter))
+	{
+		if (lang == LANG_FRA)
+			sprintf(short_buf, "Le Program ecrit en C n'a pu allouer assez de memoire. Essayer des series plus courtes");
+		else
+			sprintf(short_buf, "The C program could not allocate memory. You might want to try smaller series");
+
+		send_error(opt, short_buf);
+		free(out);
+		free(ttv);
+		free(parameter);
+		return;
+	}
+
+	/**********
+	* cutoffs in increasing order, the last one is the to date
+	**********/
+
+	for (v = 0; v < nbvint; v++)
+		ttv[v] = nbdist - last + v;
+
+	(void)benchmod_vintages(dist, bench, tau, kappa, w, prop, diff, index, opt->algo.rho, nbdist, nbbench, nbvint, ttv, out);
+
+	rep_puts("\n\n\n");
+	parameter[0] = opt->series.targetid;
+	prnt_replace(parameter, 4, lang, 20, title, 1);
+
+	rep_puts("        ");
+	for (v = 0; v < nbvint; v++)
+	{
+		strcpy(date, opt->ser_info.from);
+		add_date(date, freq, ttv[v] - 1);
+		rep_printf(" %13s", date);
+	}
+	rep_puts("\n");
+
+	strcpy(date, opt->ser_info.from);
+	for (r = 0; r < nbdist; r++, add_date(date, freq, 1))
+	{
+		rep_printf(" %6s ", date);
+		for (v = 0; v < nbvint; v++)
+		{
+			if (r < ttv[v])
+			{
+				rep_puts(" ");
+				rep_fixed(out[r*nbvint + v], 13, ndec);
+			}
+			else
+				rep_printf(" %13s", "");
+		}
+		rep_puts("\n");
+	}
+
+	rep_puts("\n\n\n");
+	prnt_replace(parameter, 4, lang, 21, title, 0);
+
+	strcpy(date, opt->ser_info.from);
+	for (r = 0; r < nbdist; r++, add_date(date, freq, 1))
+	{
+		rep_printf(" %6s ", date);
+		for (v = 0; v < nbvint; v++)
+		{
+			if (r < ttv[v])
+			{
+				rep_puts(" ");
+				rep_fixed(out[r*nbvint + last] - out[r*nbvint + v], 13, ndec);
+			}
+			else
+				rep_printf(" %13s", "");
+		}
+		rep_puts("\n");
+	}
+
+	free(out);
+	free(ttv);
+	free(parameter);
+	rep_flush();
+}
+
+
+
+/**********
+ *
+ * void sweep_study(struct s_options *opt, double *bench, double *dist,
+ *                  int *tau, int *kappa, double *w, int nbdist, int nbbench)
+ *
+ * solves the variants listed in Q_SWEEP with the series already read
+ * and prints the comparison table.  A variant is written as a letter
+ * for the method, P (proportional) or A (additive), a digit for the
+ * difference, 1 or 2, and an optional M when the benchmarks are means,
+ * ex: "P1 P2 A1 A2".  Unknown variants are ignored.
+ *
+ * The target series of the job is not changed.
+ *
+ **********/
+
+#define MAX_VARIANTS 8
+
+void sweep_study(struct s_options *opt, double *bench, double *dist, int *tau, int *kappa, double *w, int nbdist, int nbbench)
+{
+	double *out;
+	int vprop[MAX_VARIANTS];
+	int vdiff[MAX_VARIANTS];
+	int vindex[MAX_VARIANTS];
+	bool ratio[MAX_VARIANTS];
+	char code[MAX_VARIANTS][4];
+	char *labels[MAX_VARIANTS];
+	char *pnt;
+	int nbvar, i;
+	char short_buf[SHORT_BUF_SIZE];
+
+	nbvar = 0;
+	pnt = opt->reports.sweep;
+
+	while (*pnt && nbvar < MAX_VARIANTS)
+	{
+		while (*pnt == ' ' || *pnt == ',')
+			pnt++;
+		if (!*pnt)
+			break;
+
+		for (i = 0; pnt[i] && pnt[i] != ' ' && pnt[i] != ','; i++)
+			;
+
+		if ((i == 2 || (i == 3 && toupper(pnt[2]) == 'M')) &&
+			(toupper(pnt[0]) == 'P' || toupper(pnt[0]) == 'A') &&
+			(pnt[1] == '1' || pnt[1] == '2'))
+		{
+			ratio[nbvar]  = (toupper(pnt[0]) == 'P');
+			vprop[nbvar]  = (ratio[nbvar] ? 0 : 1);
+			vdiff[nbvar]  = (pnt[1] == '1' ? 1 : (opt->algo.legacydiff ? 3 : 2));
+			vindex[nbvar] = (i == 3);
+			code[nbvar][0] = (char)toupper(pnt[0]);
+			code[nbvar][1] = pnt[1];
+			code[nbvar][2] = (char)(i == 3 ? 'M' : '\0');
+			code[nbvar][3] = '\0';
+			labels[nbvar] = code[nbvar];
+			nbvar++;
+		}
+
+		pnt += i;
+	}
+
+	if (nbvar == 0)
+		return;
+
+	out = (double *)qm_malloc(nbvar * nbdist * sizeof(double));
+
+	if (!out)
+	{
+		if (lang == LANG_FRA)
+			sprintf(short_buf, "Le Program ecrit en C n'a pu allouer assez de memoire. Essayer des series plus courtes");
+		else
+			sprintf(short_buf, "The C program could not allocate memory. You might want to try smaller series");
+
+		send_error(opt, short_buf);
+		return;
+	}
+
+	(void)benchmod_sweep(dist, bench, tau, kappa, w, nbvar, vprop, vdiff, vindex, opt->algo.rho, nbdist, nbbench, out);
+
+	print_comparison(opt, labels, ratio, out, nbvar, dist, nbdist);
+
+	free(out);
+}
+
+
+
+/**********
+ *
+ * void rho_study(struct s_options *opt, double *bench, double *dist,
+ *                int *tau, int *kappa, double *w, int nbdist, int nbbench,
+ *                int prop, int diff, int index)
+ *
+ * benchmarks the series already read with every value of rho listed in
+ * Q_RHOGRID, ex: "0.729 0.9 0.99999999", and prints the comparison
+ * table.  Values outside ]0,1[ are ignored.  The target series of the
+ * job is not changed.
+ *
+ **********/
+
+#define MAX_RHOS 16
+
+void rho_study(struct s_options *opt, double *bench, double *dist, int *tau, int *kappa, double *w, int nbdist, int nbbench, int prop, int diff, int index)
+{
+	double *out;
+	double *cor;
+	double  rho[MAX_RHOS];
+	bool    ratio[MAX_RHOS];
+	char    code[MAX_RHOS][16];
+	char   *labels[MAX_RHOS];
+	char   *pnt;
+	char   *end;
+	int     nbrho, v;
+	int     tprop, tdiff, tindex;
+	char    short_buf[SHORT_BUF_SIZE];
+
+	nbrho = 0;
+	pnt = opt->reports.rhogrid;
+
+	while (nbrho < MAX_RHOS)
+	{
+		while (*pnt == ' ' || *pnt == ',')
+			pnt++;
+
+		rho[nbrho] = strtod(pnt, &end);
+		if (end == pnt)
+			break;
+		pnt = end;
+
+		if (rho[nbrho] > 0 && rho[nbrho] < 1)
+		{
+			sprintf(code[nbrho], "%.8g", rho[nbrho]);
+			labels[nbrho] = code[nbrho];
+			ratio[nbrho] = opt->algo.prop;
+			nbrho++;
+		}
+	}
+
+	if (nbrho == 0)
+		return;
+
+	out = (double *)qm_malloc(nbrho * nbdist * sizeof(double));
+	cor = (double *)qm_malloc(nbdist * sizeof(double));
+
+	if (!(out && cor))
+	{
+		if (lang == LANG_FRA)
+			sprintf(short_buf, "Le Program ecrit en C n'a pu allouer assez de memoire. Essayer des series plus courtes");
+		else
+			sprintf(short_buf, "The C program could not allocate memory. You might want to try smaller series");
+
+		send_error(opt, short_buf);
+		free(out);
+		free(cor);
+		return;
+	}
+
+	for (v = 0; v < nbrho; v++)
+	{
+		tprop = prop;
+		tdiff = diff;
+		tindex = index;
+		benchmod(dist, &out[v*nbdist], cor, bench, tau, kappa, w, &tprop, &tdiff, &tindex, rho[v], nbdist, nbbench);
+	}
+
+	print_comparison(opt, labels, ratio, out, nbrho, dist, nbdist);
+
+	free(out);
+	free(cor);
+}
+
+
+
+/**********
+ *
+ * void print_comparison(struct s_options *opt, char **labels, bool *ratio,
+ *                       double *out, int nbvar, double *dist, int nbdist)
+ *
+ * prints one line per benchmarked series of out (nbvar x nbdist):
+ * the root mean square and the largest difference between the growth
+ * rates of the series and the ones of the distributor (movement
+ * preservation, in percentage points, at the lag of Q_LAG) and the
+ * range of the adjustment factors, ratios when ratio[v] is set and
+ * differences otherwise.
+ *
+ **********/
+
+void print_comparison(struct s_options *opt, char **labels, bool *ratio, double *out, int nbvar, double *dist, int nbdist)
+{
+	double *grdist;
+	double *grtrget;
+	double *fac;
+	double  rms, maxd, d;
+	double  fmin, fmax;
+	int     v, i, lag, nbgr;
+	char    title[BUFSIZ];
+	char    short_buf[SHORT_BUF_SIZE];
+	char  **parameter;
+
+	lag = opt->reports.lag;
+	grdist = (double *)malloc(nbdist * sizeof(double));
+	grtrget = (double *)malloc(nbdist * sizeof(double));
+	fac = (double *)malloc(nbdist * sizeof(double));
+	parameter = (char **)malloc(1 * sizeof(char *));
+
+	if (!(grdist && grtrget && fac && parameter))
+	{
+		if (lang == LANG_FRA)
+			sprintf(short_buf, "Le Program ecrit en C n'a pu allouer assez de memoire. Essayer des series plus courtes");
+		else
+			sprintf(short_buf, "The C program could not allocate memory. You might want to try smaller series");
+
+		send_error(opt, short_buf);
+		free(grdist);
+		free(grtrget);
+		free(fac);
+		free(parameter);
+		return;
+	}
+
+	percent(&nbdist, &lag, dist, grdist);
+
+	rep_puts("\n\n\n");
+	parameter[0] = opt->series.targetid;
+	prnt_replace(parameter, 4, lang, 22, title, 1);
+	prnt_replace(parameter, 4, lang, 23, title, 0);
+
+	for (v = 0; v < nbvar; v++)
+	{
+		percent(&nbdist, &lag, &out[v*nbdist], grtrget);
+
+		rms = 0;
+		maxd = 0;
+		nbgr = 0;
+		for (i = lag; i < nbdist; i++)
+		{
+			d = grtrget[i] - grdist[i];
+			rms += d * d;
+			if (fabs(d) > maxd)
+				maxd = fabs(d);
+			nbgr++;
+		}
+		if (nbgr > 0)
+			rms = sqrt(rms / nbgr);
+
+		cal_fac(fac, &out[v*nbdist], dist, nbdist, ratio[v]);
+		fmin = fmax = fac[0];
+		for (i = 1; i < nbdist; i++)
+		{
+			if (fac[i] < fmin)
+				fmin = fac[i];
+			if (fac[i] > fmax)
+				fmax = fac[i];
+		}
+
+		rep_printf(" %-10s %14.4f %16.4f %14.6f %14.6f\n", labels[v], rms, maxd, fmin, fmax);
+	}
+
+	free(grdist);
+	free(grtrget);
+	free(fac);
+	free(parameter);
+	rep_flush();
 }
 
 
@@ -1685,12 +3266,77 @@ void print_reports(double *bench, double *dist, double *trget, int nbdist, int n
  * void prnt_replace(char **parm, int setnum, int langnum, int messnum, char *title,
  *                   int nb_parm)
  *
+ * read_print to the report of the job (rep_puts).
  *
  **********/
 
 void prnt_replace(char **parm, int setnum, int langnum, int messnum, char *title, int nb_parm)
 {
-	read_print(tables, setnum, langnum, messnum, parm, nb_parm, title);
+	format_message(title, BUFSIZ, setnum, langnum, messnum, parm, nb_parm);
+
+	rep_puts(title);
+	rep_puts("\n");
+}
+
+
+
+/**********
+ *
+ * int report_analytics(struct s_analytics *an, double *dist, double *trget,
+ *                      int nbdist, char prop, int lag)
+ *
+ * computes in one pass the measures of the reports for dist and trget:
+ * the adjustment factors (cal_fac), the first differences (firstdiff
+ * at lag 1) and the growth rates at lag (percent).  The arrays are the
+ * parts of one buffer kept from job to job, it grows with the series.
+ * The results are those of the separate functions.
+ *
+ * returns 1 if o.k., 0 if out of memory.
+ *
+ **********/
+
+int report_analytics(struct s_analytics *an, double *dist, double *trget, int nbdist, char prop, int lag)
+{
+	double *buf;
+	double d, t, dl, tl;
+	int i;
+
+	if (nbdist > an->cap)
+	{
+		if ((buf = (double *)realloc(an->buf, 5 * (size_t)nbdist * sizeof(double))) == NULL)
+			return(0);
+		an->buf = buf;
+		an->cap = nbdist;
+	}
+
+	an->fac = an->buf;
+	an->ddist = an->fac + an->cap;
+	an->dtrget = an->ddist + an->cap;
+	an->grdist = an->dtrget + an->cap;
+	an->grtrget = an->grdist + an->cap;
+
+	for (i = 0; i < nbdist; i++)
+	{
+		d = dist[i];
+		t = trget[i];
+		an->fac[i] = prop ? t / d : t - d;
+		an->ddist[i] = (i >= 1) ? d - dist[i-1] : 0;
+		an->dtrget[i] = (i >= 1) ? t - trget[i-1] : 0;
+
+		an->grdist[i] = 0;
+		an->grtrget[i] = 0;
+		if (lag > 0 && i >= lag)
+		{
+			dl = dist[i-lag];
+			tl = trget[i-lag];
+			if (fabs(dl) > 0.00005)
+				an->grdist[i] = ((d - dl) / dl) * 100;
+			if (fabs(tl) > 0.00005)
+				an->grtrget[i] = ((t - tl) / tl) * 100;
+		}
+	}
+
+	return(1);
 }
 
 
@@ -1808,18 +3454,25 @@ int write_ser(char *base, char *targetid, char *from, char *to, int freq, double
 	syear = (syear - sprd) / 100;
 	eyear = (eyear - eprd) / 100;
 
+	STAT_BEGIN(PH_CFMSRNG);
 	cfmsrng(&status, tfreq, &syear, &sprd, &eyear, &eprd, range, &numobs);
+	STAT_END(PH_CFMSRNG);
 	if (status != HSUCC)
 	{
 		return(0);
 	}
 
+	STAT_BEGIN(PH_CFMWRNG);
 	cfmwrng(&status, workkey, tmp_series_name, range, target, HNTMIS, mistt);
+	STAT_END(PH_CFMWRNG);
 	if (status != HSUCC)
 	{
 		return(0);
 	}
 
+	if (stats_on)
+		job_stats.bytes_written += (double)numobs * sizeof(double);
+
 	return(1);
 }
 
@@ -1837,7 +3490,6 @@ int write_ser(char *base, char *targetid, char *from, char *to, int freq, double
 
 void prnt_warnings(double *dist, double *trget, int nbdist, struct s_options *opt, char *bfrom)
 {
-	int i;
 	int per;
 	bool isneg;
 	char optimal[7];
@@ -1883,28 +3535,16 @@ void prnt_warnings(double *dist, double *trget, int nbdist, struct s_options *op
 	/**********
 	* check target for negative values
 	**********/
-	isneg = NO;
-	for (i = 0; i < nbdist && !isneg; i++)
-		isneg = (trget[i] < 0.0);
-
-	if (isneg)
+	if (any_negative(trget, nbdist))
 		prnt_w_mess(opt, 5, "", "", 0);
 
 	/**********
 	* check distributor for values <= 0
 	**********/
-	isneg = NO;
-
 	if (opt->algo.zero)
-	{
-		for (i = 0; i < nbdist && !isneg; i++)
-			isneg = (dist[i] < 0.0);
-	}
+		isneg = any_negative(dist, nbdist);
 	else
- 	{
-		for (i = 0; i < nbdist && !isneg; i++)
-			isneg = (dist[i] <= 0.0);
-	}
+		isneg = any_nonpositive(dist, nbdist);
 
 	if (isneg)
 		prnt_w_mess(opt, 6, "", "", 0);
@@ -1941,1838 +3581,5280 @@ void prnt_w_mess(struct s_options *opt, int num, char *mess1, char *mess2, int n
 
 /**********
  *
- * void send_warning(struct s_options *opt, int setnum, int langnum,
- *                 int messnum, char **parm, int nb_parm);
+ * Diagnostics of the job
  *
- * Send a warning message through Fame warning channel.
+ * The warnings and the errors of a job are kept in diags (severity,
+ * message number and parameters, series of the job) and go to Fame in
+ * one command by flush_diagnostics at the end of the job, once for all
+ * the series of a batch: a signal warning with the warnings, then a
+ * signal continue with the errors; the texts are under the header of
+ * their series.  With Q_DIAG_CODES the codes of the job are
+ * also left in the string scalar WORK'Q_DIAG_CODES: W<set><message>
+ * for a warning of the messages table (W111 is message 11 of set 1),
+ * E for an error.
  *
- *********/
+ **********/
 
-void send_warning(struct s_options *opt, int setnum, int langnum, int messnum, char **parm, int nb_parm)
+#define DIAG_WARNING	0
+#define DIAG_ERROR	1
+#define DIAG_PARMS	2
+
+struct s_diag
 {
-	int status;
-	char short_buf[SHORT_BUF_SIZE];
-	char fame_cmd[BUFSIZ];
+	int  severity;
+	int  setnum;
+	int  langnum;
+	int  messnum;                   /* 0 for an error, its text is parm[0] */
+	int  nb_parm;
+	char parm[DIAG_PARMS][SHORT_BUF_SIZE];
+	char series[3 * 65 + 4];        /* bench, distributor, target */
+};
 
-	strcpy(short_buf, lookup_message(setnum, langnum, messnum));
+struct s_diag *diags = NULL;
+int nbdiags = 0;
+int capdiags = 0;
 
-	if (nb_parm)
-		replace(short_buf, nb_parm, parm);
 
-	if (lang == LANG_FRA)
-		sprintf(fame_cmd, "signal warning : \"MESSAGE QUADMIN pour les series %s, %s, %s : \"", opt->series.benchid,opt->series.distributorid,opt->series.targetid);
-	else
-		sprintf(fame_cmd, "signal warning : \"QUADMIN MESSAGE for %s, %s, %s: \"", opt->series.benchid,opt->series.distributorid,opt->series.targetid);
 
-	cfmfame(&status,fame_cmd);
+/**********
+ *
+ * struct s_diag *add_diag(struct s_options *opt, int severity, struct s_diag *one)
+ *
+ * returns a new diagnostic of the job, or one if there is no memory
+ * to keep it: the caller then sends it at once (signal_diag).
+ *
+ **********/
 
-	sprintf(fame_cmd, "signal warning : \"%s\"",short_buf);
-	cfmfame(&status,fame_cmd);
+struct s_diag *add_diag(struct s_options *opt, int severity, struct s_diag *one)
+{
+	struct s_diag *grown;
+	struct s_diag *d;
+	int n;
+
+	d = one;
+	if (nbdiags == capdiags)
+	{
+		n = (capdiags > 0) ? 2 * capdiags : 8;
+		if ((grown = (struct s_diag *)realloc(diags, n * sizeof(struct s_diag))) != NULL)
+		{
+			diags = grown;
+			capdiags = n;
+		}
+	}
+	if (nbdiags < capdiags)
+		d = &diags[nbdiags++];
+
+	d->severity = severity;
+	d->setnum = 0;
+	d->langnum = lang;
+	d->messnum = 0;
+	d->nb_parm = 0;
+	if (opt != NULL)
+		sprintf(d->series, "%s, %s, %s", opt->series.benchid, opt->series.distributorid, opt->series.targetid);
+	else
+		strcpy(d->series, "");
+
+	return(d);
 }
 
 
 
 /**********
  *
- * void send_error(struct s_options *opt, char *short_buf);
+ * int diag_text(struct s_diag *d, char *buf, size_t size, char *header)
  *
- * Send an error message through Fame error channel.
+ * writes the text of a diagnostic in buf and its header in header
+ * (BUFSIZ).
  *
- *********/
+ **********/
 
-void send_error(struct s_options *opt, char *short_buf)
+int diag_text(struct s_diag *d, char *buf, size_t size, char *header)
 {
-	int status;
-	char fame_cmd[BUFSIZ];
+	char *parameter[DIAG_PARMS];
+	int i;
 
-	if (lang == LANG_FRA)
-		sprintf(fame_cmd, "signal continue : \"MESSAGE QUADMIN pour les series %s, %s, %s: \" +newline + \"%s\" +newline", opt->series.benchid,opt->series.distributorid,opt->series.targetid,short_buf);
+	if (d->severity == DIAG_ERROR)
+	{
+		if (lang == LANG_FRA)
+			sprintf(header, "MESSAGE QUADMIN pour les series %s: ", d->series);
+		else
+			sprintf(header, "QUADMIN MESSAGE for %s: ", d->series);
+	}
 	else
-		sprintf(fame_cmd, "signal continue : \"QUADMIN MESSAGE for %s, %s, %s: \" +newline + \"%s\" +newline", opt->series.benchid,opt->series.distributorid,opt->series.targetid,short_buf);
+	{
+		if (lang == LANG_FRA)
+			sprintf(header, "MESSAGE QUADMIN pour les series %s : ", d->series);
+		else
+			sprintf(header, "QUADMIN MESSAGE for %s: ", d->series);
+	}
 
-	cfmfame(&status,fame_cmd);
+	if (d->messnum == 0)
+		return(snprintf(buf, size, "%s", d->parm[0]));
+
+	for (i = 0; i < DIAG_PARMS; i++)
+		parameter[i] = d->parm[i];
+
+	return(format_message(buf, size, d->setnum, d->langnum, d->messnum, parameter, d->nb_parm));
 }
 
 
 
 /**********
  *
- * void end_fame(void)
+ * void signal_diag(struct s_diag *d)
  *
- * Terminate interaction with Fame
+ * sends one diagnostic alone, when there is no memory to keep it.
  *
  **********/
 
-void end_fame(void)
+void signal_diag(struct s_diag *d)
 {
 	int status;
+	char short_buf[SHORT_BUF_SIZE];
+	char header[BUFSIZ];
+	char fame_cmd[BUFSIZ + SHORT_BUF_SIZE + 64];	/* header, text and the command */
 
-	cfmfin(&status);
+	diag_text(d, short_buf, sizeof(short_buf), header);
+
+	snprintf(fame_cmd, sizeof(fame_cmd), "signal %s : \"%s\" +newline + \"%s\" +newline", (d->severity == DIAG_ERROR) ? "continue" : "warning", header, short_buf);
+	STAT_BEGIN(PH_CFMFAME);
+	cfmfame(&status,fame_cmd);
+	STAT_END(PH_CFMFAME);
 }
 
 
 
-void benchmod(double *x, double *b, double *cor, double *y,
-	int *tau, int *kappa, double *w, int *prop,
-	int *diff, int *index, int tt, int mm);
+/**********
+ *
+ * void flush_diagnostics(struct s_options *opt)
+ *
+ * sends the diagnostics of the job to Fame in one command, the
+ * warnings then the errors in two signals, and empties the list.  opt
+ * is NULL outside of a job: WORK'Q_DIAG_CODES is then left as it is.
+ *
+ **********/
 
-void build_qinvw(double *x2, double *x, double *rquinv, int *tau,
-	int tt, int *kappa, double *w, int prop,
-	double *qinvw, int mm);
+void flush_diagnostics(struct s_options *opt)
+{
+	int status;
+	char short_buf[SHORT_BUF_SIZE];
+	char header[BUFSIZ];
+	char *prev;
+	char *fame_cmd;
+	size_t len;
+	bool codes;
+	int severity;
+	int i;
 
-void build_wqinvw(int *tau, int *kappa, int mm, double *qinvw,
-	double *wqinvw, double *w, int tt);
+	codes = (opt != NULL && opt->reports.diagcodes);
+	if (nbdiags == 0 && !codes)
+		return;
 
-void cal_discrep(double mm, int *tau, int *kappa,
-	double *add_disc, double *pro_disc, double *y,
-	double *x, double *w, int index);
+	if ((fame_cmd = (char *)malloc(BUFSIZ + nbdiags * (2 * SHORT_BUF_SIZE + BUFSIZ))) == NULL)
+	{
+		for (i = 0; i < nbdiags; i++)
+			signal_diag(&diags[i]);
+		nbdiags = 0;
+		return;
+	}
 
-double *cal_inv(int dim, double *mat);
-double *cal_inv2(int dim, double *mat);
-void matmult(double *aa, double *bb, double *cc, int rowb, int colc, int colb);
-void apply_corr(int tt, double *b, double *x, double *cor, int prop);
-void modif_corr(int *kappa, double *cor, int tt, double *b, double *x, int mm, int prop);
-double sumit(double *x, int nbelem);
-void send_out_of_mem(void);
+	len = 0;
+	if (codes)
+	{
+		len += sprintf(&fame_cmd[len], "scalar <overwrite on> WORK'Q_DIAG_CODES : string = \"");
+		for (i = 0; i < nbdiags; i++)
+		{
+			if (diags[i].severity == DIAG_ERROR)
+				len += sprintf(&fame_cmd[len], "%sE", (i > 0) ? " " : "");
+			else
+				len += sprintf(&fame_cmd[len], "%sW%d%02d", (i > 0) ? " " : "", diags[i].setnum, diags[i].messnum);
+		}
+		len += sprintf(&fame_cmd[len], "\"");
+	}
 
+	for (severity = DIAG_WARNING; severity <= DIAG_ERROR; severity++)
+	{
+		prev = NULL;
+		for (i = 0; i < nbdiags; i++)
+		{
+			if (diags[i].severity != severity)
+				continue;
+
+			diag_text(&diags[i], short_buf, sizeof(short_buf), header);
+
+			if (prev == NULL)
+				len += sprintf(&fame_cmd[len], "%ssignal %s : \"%s\" +newline + ", (len > 0) ? "; " : "",
+					(severity == DIAG_ERROR) ? "continue" : "warning", header);
+			else if (strcmp(prev, diags[i].series) != 0)
+				len += sprintf(&fame_cmd[len], " + \"%s\" +newline + ", header);
+			else
+				len += sprintf(&fame_cmd[len], " + ");
+			len += sprintf(&fame_cmd[len], "\"%s\" +newline", short_buf);
+			prev = diags[i].series;
+		}
+	}
+
+	STAT_BEGIN(PH_CFMFAME);
+	cfmfame(&status,fame_cmd);
+	STAT_END(PH_CFMFAME);
+	free(fame_cmd);
+	nbdiags = 0;
+}
 
 
-/* int nbweights = 120; */
 
 /**********
  *
- * this program does the quadratic minimization algorithm
- * it is a c implementation of a sas program given to us by
- * Pierre Cholette. 
- *
- * This version is also fully compatible between micro and hp.
- * there is only one line to add or remove depending when working
- * on hp or micro respectively.  It is the first line of all wich
- * is :
- *    #pragma prototypes on
+ * void send_warning(struct s_options *opt, int setnum, int langnum,
+ *                 int messnum, char **parm, int nb_parm);
  *
+ * Keep a warning message for the Fame warning channel.
  *
- **********/
+ *********/
 
-/*********
+void send_warning(struct s_options *opt, int setnum, int langnum, int messnum, char **parm, int nb_parm)
+{
+	struct s_diag *d;
+	struct s_diag one;
+	int i;
+
+	d = add_diag(opt, DIAG_WARNING, &one);
+	d->setnum = setnum;
+	d->langnum = langnum;
+	d->messnum = messnum;
+	d->nb_parm = (nb_parm < DIAG_PARMS) ? nb_parm : DIAG_PARMS;
+	for (i = 0; i < DIAG_PARMS; i++)
+	{
+		strncpy(d->parm[i], (i < d->nb_parm && parm[i] != NULL) ? parm[i] : "", SHORT_BUF_SIZE - 1);
+		d->parm[i][SHORT_BUF_SIZE - 1] = '\0';
+	}
+
+	if (d == &one)
+		signal_diag(d);
+}
+
+
+
+/**********
  *
- *  main routine that calls all the others to do the quadmin
- *  algorithm
+ * void send_error(struct s_options *opt, char *short_buf);
+ *
+ * Keep an error message for the Fame error channel.
  *
  *********/
 
-void benchmod(double *x, double *b, double *cor, double *y,
-	int *tau, int *kappa, double *w, int *prop,
-	int *diff, int *index, int tt, int mm)
+void send_error(struct s_options *opt, char *short_buf)
 {
-	double  *qinvw;
-	double  *wqinvw;
-	double  *wqinvw2;
-	double  *rquinv;
-	double  *x2;
-	double  *add_disc;
-	double  *pro_disc;
-	double  *invy;
-	size_t   size;
+	struct s_diag *d;
+	struct s_diag one;
 
-	if (*prop != 1)
-		*prop = 0;
-	if (*diff != 2)
-		*diff = 1;
-	if (*index != 1)                  /* index = 1 for index series   */
-		*index = 0;
+	d = add_diag(opt, DIAG_ERROR, &one);
+	strncpy(d->parm[0], short_buf, SHORT_BUF_SIZE - 1);
+	d->parm[0][SHORT_BUF_SIZE - 1] = '\0';
+	d->nb_parm = 1;
 
-	size     = (size_t)sizeof(double);
-	qinvw    = (double *)malloc(size * (size_t)(tt * mm));
-	wqinvw   = (double *)malloc(size * (size_t)(mm * mm));
-	rquinv   = (double *)malloc(size * (size_t)(tt));
-	x2       = (double *)malloc(size * (size_t)(tt));
-	add_disc = (double *)malloc(size * (size_t)(mm));
-	pro_disc = (double *)malloc(size * (size_t)(mm));
-	invy     = (double *)malloc(size * (size_t)(mm));
+	if (d == &one)
+		signal_diag(d);
+}
 
-	if (!(qinvw && wqinvw && rquinv && cor && x2 && add_disc && pro_disc && invy))
-		send_out_of_mem();
 
-	build_qinvw(x2, x, rquinv, tau, tt, kappa, w, *prop, qinvw, mm);
 
-	build_wqinvw(tau, kappa, mm, qinvw, wqinvw, w, tt);
+/**********
+ *
+ * Statistics of the jobs
+ *
+ * With the environment variable QUADMIN_STATS naming a file, the wall
+ * time of the phases of each job (inclusive: get_ser holds the Fame
+ * calls of the reads) and its counts (Fame calls, bytes read and
+ * written, allocations through qm_malloc, tt, mm) are kept, and a
+ * summary of the session is appended to the file by end_fame.
+ * QUADMIN_STATS_CSV names a file that gets one line per job.  Without
+ * them stats_on is 0 and each STAT_BEGIN, STAT_END or qm_malloc costs
+ * one test.
+ *
+ * QUADMIN_TRACE names a file for the trace events (JSON, as read by
+ * chrome://tracing or Perfetto): a span for each job, with its target,
+ * for each phase and each Fame call of the main thread, and for each
+ * report written by the writer thread.  A phase entered again before
+ * its end gives one span.
+ *
+ **********/
 
-	cal_discrep(mm, tau, kappa, add_disc, pro_disc, y, x, w, *index);
+#define TRACE_MAIN	1	/* tid of the threads in the trace */
+#define TRACE_WRITER	2
 
-	wqinvw2 = cal_inv2(mm, wqinvw);
+#ifdef _WIN32
+#define TRACE_LOCK()    EnterCriticalSection(&trace_lock)
+#define TRACE_UNLOCK()  LeaveCriticalSection(&trace_lock)
+CRITICAL_SECTION trace_lock;
+#else
+#define TRACE_LOCK()    pthread_mutex_lock(&trace_lock)
+#define TRACE_UNLOCK()  pthread_mutex_unlock(&trace_lock)
+pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
 
-	matmult(invy, wqinvw2, add_disc, mm, (int)1, mm);
+char *phase_names[NB_PHASES] =
+{
+	"job", "get_ser", "dates", "benchmod", "qinvw", "wqinvw", "inverse",
+	"matmult", "round", "update", "reports",
+	"cfmsinp", "cfmfame", "cfmsrng", "cfmrrng", "cfmwrng"
+};
+
+struct s_stats session_stats;
+int stats_jobs = 0;
+double stats_start[NB_PHASES];
+double stats_stop[NB_PHASES];
+int stats_depth[NB_PHASES];
+FILE *stats_csv = NULL;
+FILE *trace_file = NULL;
+double trace_zero;                      /* clock at the start of the trace */
+long trace_events = 0;
 
-	matmult(cor, qinvw, invy, tt, (int)1, mm);
 
-	apply_corr(tt, b, x, cor, *prop);
-	if (*diff == 2)
-		modif_corr(kappa, cor, tt, b, x, mm, *prop);
 
-	free(qinvw);
-	free(wqinvw);
 /**********
- * next line is needed only if the matrix inversion routine is
- * cal_inv.  If the other one is picked out (cal_inv2),
- * comment out the free statement.
+ *
+ * double stat_clock(void)
+ *
+ * returns a wall clock in seconds.
+ *
  **********/
-/*  free(wqinvw2);   */
-	free(rquinv);
-	free(x2);
-	free(add_disc);
-	free(pro_disc);
-	free(invy);
+
+double stat_clock(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER freq, count;
+
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&count);
+	return((double)count.QuadPart / (double)freq.QuadPart);
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return((double)ts.tv_sec + 1e-9 * (double)ts.tv_nsec);
+#endif
 }
 
-/*********
+
+
+/**********
  *
- * construction of the matrix qinvw.
+ * void stat_init(void)
  *
- * this function takes by far the most time to run of all the
- * functions in this program.  Because of this, it has been rearranged
- * to take a few shortcuts but this is at the expense of readability.
- * Mainly, what was done was to take as much calculation as possible out of
- * the loops.  In order to do so, it was necessary to use some temporary
- * variables which are all declared in the second part of the declaration block.
+ * turns the statistics on if QUADMIN_STATS or QUADMIN_STATS_CSV is set.
  *
  **********/
 
-void build_qinvw(double *x2, double *x, double *rquinv, int *tau,
-	int tt, int *kappa, double *w, int prop,
-	double *qinvw, int mm)
+void stat_init(void)
 {
-	int r,c,m,k;
-	int expo;
-	double tw1;
-	double t1;
-	double xbar;
-	double nperm;
-	double rho;
-
-	double temp;
-	double tpow;
-	double tdiv;
-	double *trquinv;
-	double *tw;
-	double *tx2;
-
-	xbar = sumit(x, tt) / tt;
-	rho  = 0.99999999;
+	char *env;
+	int i;
 
-	for (r = 0; r < tt; r++)
-		x2[r] = (prop == 0) ? x[r] : 1;
+	memset(&job_stats, 0, sizeof(job_stats));
+	memset(&session_stats, 0, sizeof(session_stats));
 
-	for (r = 0; r < tt; r++)
+	if ((env = getenv("QUADMIN_STATS_CSV")) != NULL && env[0] != '\0')
 	{
-		trquinv = rquinv; 
-		tx2 = x2;
-		tdiv = x2[r] / xbar;
-		for (c = 0; c < tt; c++, tx2++, trquinv++)
+		if ((stats_csv = fopen(env, "a")) != NULL)
 		{
-			expo = abs(c-r);
-			tpow = pow(rho, (double)expo);
-			*trquinv = tpow * tdiv * *tx2;
+			fseek(stats_csv, 0, SEEK_END);
+			if (ftell(stats_csv) == 0)
+			{
+				fprintf(stats_csv, "target,tt,mm,fame_calls,bytes_read,bytes_written,allocations");
+				for (i = 0; i < NB_PHASES; i++)
+					fprintf(stats_csv, ",%s", phase_names[i]);
+				fprintf(stats_csv, "\n");
+			}
 		}
+	}
 
-		tw1 = 0;
-		for (m = 0; m < mm; m++)
+	if ((env = getenv("QUADMIN_TRACE")) != NULL && env[0] != '\0')
+	{
+		if ((trace_file = fopen(env, "w")) != NULL)
 		{
-			t1 = tau[m] - 1;
-			nperm = kappa[m] - t1;
-			temp = 0;
-			trquinv = &rquinv[(int)t1];
-			tw = &w[(int)tw1];
-			for (k = 0; k < nperm; k++, trquinv++, tw++)
-				temp += *trquinv * *tw;
-			tw1 = tw1 + nperm;
-			*qinvw = temp;
-			qinvw++;
+#ifdef _WIN32
+			InitializeCriticalSection(&trace_lock);
+#endif
+			trace_zero = stat_clock();
+			fprintf(trace_file, "[\n");
+			fprintf(trace_file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"quadmin\"}},\n", TRACE_MAIN);
+			fprintf(trace_file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"report writer\"}}", TRACE_WRITER);
+			trace_events = 2;
 		}
 	}
+
+	env = getenv("QUADMIN_STATS");
+	stats_on = (stats_csv != NULL || trace_file != NULL || (env != NULL && env[0] != '\0'));
 }
 
+
+
 /**********
  *
- * construction of the matrix wqinvw
+ * void trace_span(const char *name, const char *target, double start,
+ *                 double stop, int tid)
+ *
+ * writes a complete event (ph X) from start to stop (stat_clock) for the
+ * thread tid, with the target of the job if it is not NULL.
  *
  **********/
 
-void build_wqinvw(int *tau, int *kappa, int mm, double *qinvw, double *wqinvw, double *w, int tt)
+void trace_span(const char *name, const char *target, double start, double stop, int tid)
 {
-	double tw1;
-	double t1;
-	double nperr;
-	double temp;
-	int    r,c,k;
+	const char *p;
 
-	tw1 = 0;
-	for (r = 0; r < mm; r++)
-	{
-		t1 = tau[r] - 1;
-		nperr = kappa[r] - t1;
+	if (trace_file == NULL)
+		return;
 
-		for (c = 0; c < mm; c++)
-		{
-			temp = 0;
-			for (k = 0; k < nperr; k++)
-				temp += w[(int)(tw1+k)] * qinvw[(int)(((t1+k)*mm)+c)];
+	TRACE_LOCK();
+	fprintf(trace_file, "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d",
+		(trace_events++ > 0) ? ",\n" : "", name, (strncmp(name, "cfm", 3) == 0) ? "fame" : "quadmin",
+		1e6 * (start - trace_zero), 1e6 * (stop - start), tid);
 
-			*wqinvw = temp;
-			wqinvw++;
+	if (target != NULL)
+	{
+		fprintf(trace_file, ",\"args\":{\"target\":\"");
+		for (p = target; *p; p++)
+		{
+			if (*p == '"' || *p == '\\')
+				fputc('\\', trace_file);
+			if ((unsigned char)*p >= ' ')
+				fputc(*p, trace_file);
 		}
-
-		tw1 += nperr;
+		fprintf(trace_file, "\"}");
 	}
+	fprintf(trace_file, "}");
+	TRACE_UNLOCK();
 }
 
+
+
 /**********
  *
- * calculates the annual discrepancies
+ * void stat_begin(int phase)
+ * void stat_end(int phase)
+ *
+ * start and stop the clock of a phase.  A phase entered again before
+ * its end (benchmod called by a study) is timed once.
  *
  **********/
 
-void cal_discrep(double mm, int *tau, int *kappa,
-	double *add_disc, double *pro_disc, double *y,
-	double *x, double *w, int index)
+void stat_begin(int phase)
 {
-	int r,k;
-	double t1;
-	double tw1;
-	double temp;
-	double nperr;
-	double yr;
-	double sumw;
-	double *tw;
-	double *tx;
+	if (stats_depth[phase]++ == 0)
+		stats_start[phase] = stat_clock();
+	job_stats.calls[phase]++;
+}
 
-	tw1 = 0;
-	for (r = 0; r < mm; r++)
+void stat_end(int phase)
+{
+	if (stats_depth[phase] > 0 && --stats_depth[phase] == 0)
 	{
-		t1 = tau[r] - 1;
-		nperr = kappa[r] - t1;
-		temp = 0;
-		sumw = 0;
-		tw = &w[(int)tw1];
-		tx = &x[(int)t1];
-
-		for (k = 0; k < nperr; k++, tw++, tx++)
-		{
-			sumw += *tw;
-			temp += *tw * *tx;
-		}
-
-		yr = (index == 1) ? y[r] * sumw : y[r];
-		add_disc[r] = yr - temp;
-		pro_disc[r] = yr / temp;
-		tw1 += nperr;
+		stats_stop[phase] = stat_clock();
+		job_stats.time[phase] += stats_stop[phase] - stats_start[phase];
+		if (phase != PH_JOB)
+			trace_span(phase_names[phase], NULL, stats_start[phase], stats_stop[phase], TRACE_MAIN);
 	}
 }
 
+
+
 /**********
  *
- * calculates the inverse of a matrix. 
+ * void *qm_malloc(size_t size)
+ * void *qm_calloc(size_t nb, size_t size)
+ * void *qm_realloc(void *ptr, size_t size)
  *
- * algorithm:
- *     we proceed by the 'triangularisation' of the matrix mat.
- *     we do the same operations on the identity matrix (inv) then on
- *     the mat matrix.  when the 'triangularisation' of mat is done
- *     the inv matrix as become the inverse of the matrix mat.
+ * malloc, calloc and realloc counted in the allocations of the job.
+ * They are used for the series and the work arrays of the job (get_ser,
+ * benchmark, the benchmod functions, the rounding, the studies and
+ * tune_solvers); the reports and the messages use the plain functions.
  *
- * Note: Not used. cal_inv2 is used instead. 
- * 
  **********/
 
-double *cal_inv(int dim, double *mat)
+void *qm_malloc(size_t size)
 {
-	int row,col,row2;
-	int     add;
-	double *inv;
-	double *tempmat;
-	double  pivot;
-
-	inv = (double *)malloc((size_t)(dim * dim * sizeof(double)));
-	tempmat = (double *)malloc((size_t)(dim * dim * sizeof(double)));
+	if (stats_on)
+		job_stats.allocs++;
+	return(malloc(size));
+}
 
-	if (! (inv && tempmat))
-		send_out_of_mem();
+void *qm_calloc(size_t nb, size_t size)
+{
+	if (stats_on)
+		job_stats.allocs++;
+	return(calloc(nb, size));
+}
 
-	for (row = 0; row < dim; row++)
-	{
-		add = row*dim;
-		for (col = 0; col < dim; col++)
-		{
-			tempmat[add+col] = mat[add+col];
-			inv[add+col] = (row == col) ? 1 : 0;
-		}
-	}
+void *qm_realloc(void *ptr, size_t size)
+{
+	if (stats_on)
+		job_stats.allocs++;
+	return(realloc(ptr, size));
+}
 
-	for (row = 0; row < dim; row++)
-	{
-		add = row*dim;
-		pivot = tempmat[add+row];
-		for (col = 0; col < dim; col++)
-		{
-			tempmat[add+col] /= pivot;
-			inv[add+col] /= pivot;
-		}
-		for (row2 = 0; row2 < dim; row2++)
-		{
-			if (row2 != row)
-			{
-				pivot = -tempmat[row2*dim+row];
-				for (col = 0; col < dim; col++)
-				{
-					tempmat[row2*dim+col] += pivot * tempmat[add+col];
-					inv[row2*dim+col] += pivot * inv[add+col];
-				}
-			}
-		}
-	}
 
-	free(tempmat);
-	return(inv);
-}
 
 /**********
- * 
- * calculates the inverse of a matrix.
- * 
- * Finds the invrese of a positive definite symmetrix matrix by the
- * pivotal condensation method. this routine was furnished by
- * P. Cholette it does the same as the function above but is supposed
- * to be more precise.
+ *
+ * void stat_add(void)
+ *
+ * adds the statistics of the job to those of the session and clears them.
  *
  **********/
 
-double *cal_inv2(int dim, double *mat)
+void stat_add(void)
 {
-	int     icol, l, l1;
-	int     add,add2;
-	int     mult;
-	double  pivot;
-	double  t;
+	int i;
 
-	for (icol = 0; icol < dim; icol++)
+	for (i = 0; i < NB_PHASES; i++)
 	{
-		mult = 1;
-		add = icol*dim;
-		pivot = mat[add+icol];
-		mat[add+icol] = 1;
-		if (pivot < 0)
-			mult = -1;
-		if (fabs(pivot) < 1.0e-20)
-			pivot = 1.0e-20 * mult;
-		pivot = 1 / pivot;
-
-		for (l = 0; l < dim; l++)
-			mat[add+l] *=pivot;
-
-		for (l1 = 0; l1 < dim; l1++)
-		{
-			if (l1 != icol)
-			{
-				add2 = l1*dim;
-				t = mat[add2+icol];
-				mat[add2+icol] = 0;
-				for (l = 0; l < dim; l++)
-					mat[add2+l] = mat[add2+l] - mat[add+l] * t;
-			}
-		}
+		session_stats.time[i] += job_stats.time[i];
+		session_stats.calls[i] += job_stats.calls[i];
 	}
+	session_stats.bytes_read += job_stats.bytes_read;
+	session_stats.bytes_written += job_stats.bytes_written;
+	session_stats.allocs += job_stats.allocs;
+	session_stats.tt += job_stats.tt;
+	session_stats.mm += job_stats.mm;
 
-	return(mat);
+	memset(&job_stats, 0, sizeof(job_stats));
 }
 
-/*********
- *
- * this routine does a matrix multiplication of matrix bb and cc and
- * puts the result of the multiplication into matrix aa.
+
+
+/**********
  *
- * the matrixes are passed in parameters as pointers to doubles so
- * we have to calculate each address of the matrixes.
+ * void stat_job(struct s_options *opt)
  *
- * matrix bb as dimensions rowb * colb
- * matrix cc as dimensions colb * colc   (rowc as to be = to colb)
- * matrix aa as dimensions rowb * colc
+ * the job is done: writes its CSV line and its trace span, adds it to
+ * the session and clears its statistics.
  *
  **********/
 
-void matmult(double *aa, double *bb, double *cc, int rowb, int colc, int colb)
+void stat_job(struct s_options *opt)
 {
-	int r,c,k;
-	int add;
-	double sum;
+	long fame;
+	int i;
 
-	for (r = 0; r < rowb; r++)
-	{
-		add = r*colb;
-		for (c = 0; c < colc; c++)
-		{
-			sum = 0.0;
-			for (k = 0; k < colb; k++)
-				sum += bb[add+k] * cc[k*colc+c];
+	if (!stats_on)
+		return;
 
-			*aa = sum;
-			aa++;
-		}
+	fame = 0;
+	for (i = PH_CFMSINP; i < NB_PHASES; i++)
+		fame += job_stats.calls[i];
+
+	trace_span(phase_names[PH_JOB], opt->series.targetid, stats_start[PH_JOB], stats_stop[PH_JOB], TRACE_MAIN);
+
+	if (stats_csv != NULL)
+	{
+		fprintf(stats_csv, "%s,%d,%d,%ld,%.0f,%.0f,%ld", opt->series.targetid, job_stats.tt, job_stats.mm,
+			fame, job_stats.bytes_read, job_stats.bytes_written, job_stats.allocs);
+		for (i = 0; i < NB_PHASES; i++)
+			fprintf(stats_csv, ",%.6f", job_stats.time[i]);
+		fprintf(stats_csv, "\n");
 	}
+
+	stat_add();
+	stats_jobs++;
 }
 
+
+
 /**********
  *
- * applies the corrections to obtain the benchmarked series
+ * void stat_summary(void)
+ *
+ * appends the summary of the session to the file of QUADMIN_STATS and
+ * ends the trace.  The writer thread must be stopped (rep_close).
+ * The calls and the time of the Fame calls made between the jobs
+ * (reading the options) are counted with the session.
  *
  **********/
 
-void apply_corr(int tt, double *b, double *x, double *cor, int prop)
+void stat_summary(void)
 {
-	int r;
+	FILE *out;
+	char *env;
+	long fame;
+	int i;
 
-	for (r = 0; r < tt; r++)
+	if (!stats_on)
+		return;
+
+	stat_add();
+
+	if (stats_csv != NULL)
 	{
-		b[r] = x[r] + cor[r];
-		if (prop == 0)
-			cor[r] = b[r] / x[r];
+		fclose(stats_csv);
+		stats_csv = NULL;
+	}
+
+	if (trace_file != NULL)
+	{
+		fprintf(trace_file, "\n]\n");
+		fclose(trace_file);
+		trace_file = NULL;
 	}
+
+	if ((env = getenv("QUADMIN_STATS")) == NULL || env[0] == '\0' || (out = fopen(env, "a")) == NULL)
+		return;
+
+	fame = 0;
+	for (i = PH_CFMSINP; i < NB_PHASES; i++)
+		fame += session_stats.calls[i];
+
+	fprintf(out, "QUADMIN STATISTICS: %d jobs\n", stats_jobs);
+	fprintf(out, " %-10s %10s %12s %12s\n", "PHASE", "CALLS", "SECONDS", "MS/CALL");
+	for (i = 0; i < NB_PHASES; i++)
+		if (session_stats.calls[i] > 0)
+			fprintf(out, " %-10s %10ld %12.6f %12.4f\n", phase_names[i], session_stats.calls[i], session_stats.time[i],
+				1000.0 * session_stats.time[i] / session_stats.calls[i]);
+	fprintf(out, " FAME CALLS     = %ld\n", fame);
+	fprintf(out, " BYTES READ     = %.0f\n", session_stats.bytes_read);
+	fprintf(out, " BYTES WRITTEN  = %.0f\n", session_stats.bytes_written);
+	fprintf(out, " ALLOCATIONS    = %ld\n", session_stats.allocs);
+	fprintf(out, " PERIODS (TT)   = %d\n", session_stats.tt);
+	fprintf(out, " BENCHMARKS (MM)= %d\n\n", session_stats.mm);
+	fclose(out);
+	stats_on = 0;
 }
 
+
+
 /**********
  *
- * modifies the correction at the end, if second differences chosen.
+ * void end_fame(void)
+ *
+ * Terminate interaction with Fame, after the diagnostics are sent, the
+ * report files are closed and the statistics are written
  *
  **********/
 
-void modif_corr(int *kappa, double *cor, int tt, double *b, double *x, int mm, int prop)
+void end_fame(void)
 {
-	int t2;
-	double last_dif;
-	int   r;
+	int status;
 
-	t2 = kappa[mm-1];
-	if (t2 < tt)
-	{
-		last_dif = cor[(int)t2-1] - cor[(int)(t2-2)];
-		for (r = t2; r < tt; r++)
-		{
-			cor[r] = cor[r-1] + last_dif;
-			if (prop == 0)
-				b[r] = x[r] * cor[r];
-			else
-				b[r] = x[r] + cor[r];
-		}
-	}
+	flush_diagnostics(NULL);
+	free(diags);
+	diags = NULL;
+	capdiags = 0;
+	close_output_files();
+	stat_summary();
+	cfmfin(&status);
 }
 
 
-  
+
 /**********
- *
- * sums the elements of the array x.
- *
+ * SIMD kernels.  They are compiled with the intrinsics of AVX2 and
+ * AVX-512 on x86 compilers and picked at run time from CPUID (see
+ * simd_init), the scalar versions are used everywhere else.
  **********/
 
-double sumit(double *x, int nbelem)
-{
-	int i;
-	double result;
+#if (defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))) || \
+	(defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)))
+#define QM_SIMD
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define QM_TARGET_AVX2
+#define QM_TARGET_AVX512
+#else
+#define QM_TARGET_AVX2   __attribute__((target("avx2")))
+#define QM_TARGET_AVX512 __attribute__((target("avx512f")))
+#endif
+#endif
+
+#define SIMD_SCALAR 0
+#define SIMD_AVX2   1
+#define SIMD_AVX512 2
 
-	for (result = 0, i = 0; i < nbelem; i++)
-		result += x[i];
-	return(result);
-}
+/**********
+* qinvw is kept transposed (mm x tt, qinvw[m*tt + r]) so a window of
+* periods is contiguous.  The tiles are the number of benchmarks (columns
+* of wqinvw) and of periods (cor) done together.
+*
+* Two paths keep another layout.  The solver state of Q_INCREMENTAL and
+* Q_WHATIF is row major (tt x mcap, qinvw[r*mcap + m]): a row of qinvw
+* is the right-hand side that build_infl solves for a row of the
+* influence matrix, and the state file is written row by row.
+* benchmod_batch interleaves the lanes (qinvw[(r*mm + m)*lanes + l]) so
+* that the lanes of an element are contiguous.
+**********/
+
+#define WQ_TILE  16
+#define COR_TILE 512
+
+/**********
+* solvers of wqinvw * invy = add_disc, by buckets of mm (up to 4, 8,
+* ... benchmarks, the last one for more), see solver_for
+**********/
+
+#define SOLVER_DENSE 0
+#define SOLVER_CHOL  1
+#define TUNE_BUCKETS 8
+#define TUNE_MAGIC   "QUADMIN TUNE 1"
+
+void benchmod(double *x, double *b, double *cor, double *y,
+	int *tau, int *kappa, double *w, int *prop,
+	int *diff, int *index, double rho, int tt, int mm);
 
+void build_qinvw(double *x2, double *x, double *rquinv, int *tau,
+	int tt, int *kappa, double *w, int prop,
+	double rho, double *qinvw, int mm);
+
+void build_wqinvw(int *tau, int *kappa, int mm, double *qinvw,
+	double *wqinvw, double *w, int tt);
+
+void cal_discrep(int mm, int *tau, int *kappa,
+	double *add_disc, double *pro_disc, double *y,
+	double *x, double *w, int index);
+
+double *cal_inv(int dim, double *mat);
+double *cal_inv2(int dim, double *mat);
+void matmult(double *aa, double *bb, double *cc, int rowb, int colc, int colb);
+void qinvw_mult(double *cor, double *qinvw, double *invy, int tt, int mm, int ld);
+void apply_corr(int tt, double *b, double *x, double *cor, int prop);
+void modif_corr(int *kappa, double *cor, int tt, double *b, double *x, int mm, int prop);
+double sumit(double *x, int nbelem);
+void send_out_of_mem(void);
+
+int simd_init(void);
+int cpu_simd_level(void);
+double vdot_scalar(double *a, double *b, int n);
+void vaxpy_scalar(double *y, double a, double *x, int n);
+void vmul3_scalar(double *y, double *a, double s, double *b, int n);
+int vneg_scalar(double *x, int n);
+int vnonpos_scalar(double *x, int n);
+int vmiss_scalar(double *x, int n);
+int vnan_scalar(double *x, int n);
+static double (*vdot)(double *a, double *b, int n);
+static void (*vaxpy)(double *y, double a, double *x, int n);
+static void (*vmul3)(double *y, double *a, double s, double *b, int n);
+static int (*vneg)(double *x, int n);
+static int (*vnonpos)(double *x, int n);
+static int (*vmiss)(double *x, int n);
+static int (*vnan)(double *x, int n);
+
+int window_kernel(int *tau, int *kappa, int mm);
 
 /**********
- * 
- * void send_out_of_mem(void);
  *
- * Send error message nor enough memory
+ * inner products over a benchmark window of fixed width: 3 (months in
+ * a quarter), 4 (quarters in a year) and 12 (months in a year).  The
+ * length is a constant and the kernels are inlined in the loops of
+ * build_qinvw, build_wqinvw and cal_discrep through wdot, so the
+ * compiler unrolls them.  The sum is in the order of vdot_scalar.
+ * window_kernel tells which width to use.
  *
  **********/
 
-void send_out_of_mem(void)
-{
-	int  status;
-	char fame_cmd[BUFSIZ];
-
-	sprintf(fame_cmd, "signal continue : \"QUADMIN ERROR: The C program could not allocate enough memory for calculation \" +newline"); 
-	cfmfame(&status, fame_cmd);
-	exit(-1);
-} 
-
-
+#define WINDOW_KERNEL(n)                          \
+static __inline double wdot##n(double *a, double *b) \
+{                                                 \
+	int i;                                        \
+	double sum;                                   \
+                                                  \
+	for (sum = 0, i = 0; i < n; i++)              \
+		sum += a[i] * b[i];                       \
+	return(sum);                                  \
+}
 
-/*
-C      PURPOSE:  CALCULATES THE PERCENTAGE CHANGE OF A SERIES
-C       ON THE BASIS OF EITHER PERIOD TO PERIOD OR PERIOD OVER THE
-C       SAME PERIOD OF THE PRECEEDING YEAR, DEPENDING UPON THE
-C       UNDERLYING SEASONALITY OF THE TIME SERIES DATA.  THE VALUE
-C       0.00005 HAS BEEN ARBITRARILY CHOSEN TO DENOTE DIVISION BY ZERO.
-*/
+WINDOW_KERNEL(3)
+WINDOW_KERNEL(4)
+WINDOW_KERNEL(12)
 
-void percent(int *nopts, int *lag, double *data, double *rslt)
+static __inline double wdot(int n, double *a, double *b)
 {
-	int j, l;
-	l = *lag;
-
-	for (j=0; j < *nopts; j++)
+	switch (n)
 	{
-		rslt[j]=0.0;
-	}
+		case 3:
+			return(wdot3(a, b));
 
-	if (*lag < *nopts)
-	{
-		for (j=l; j< *nopts; j++)
-		{
-			if (fabs(data[j - *lag]) > 0.00005)
-			{
-				rslt[j]=((data[j]-data[j - *lag])/data[j - *lag])*100;
-			}
-		}
+		case 4:
+			return(wdot4(a, b));
 	}
+
+	return(wdot12(a, b));
 }
 
+int solver_for(int mm);
+int save_tune(char *file_name, int *table);
+void tune_solvers(int *table);
+int solve_chol(double *wqinvw, double *add_disc, double *invy, int mm);
+
+int benchmod_inc(struct s_solver_state *st, double *x, double *b, double *cor,
+	double *y, int *tau, int *kappa, double *w, int *prop,
+	int *diff, int *index, double rho, int tt, int mm);
+int state_alloc(struct s_solver_state *st, int tt, int mm);
+void free_state(struct s_solver_state *st);
+void qinvw_block(double *qinvw, int ld, double *x2, double xbar, int *tau,
+	int *kappa, int *woff, double *w, double *rpow, int r0, int r1, int m0, int m1);
+double *rho_powers(double rho, int n);
+int benchmod_d2(double *x, double *b, double *cor, double *y, int *tau,
+	int *kappa, double *w, int prop, int index, int tt, int mm);
+int band_solve(double *a, int n, int bw, double *rhs);
+int chol_extend(double *a, int ld, int m0, int m1);
+void chol_solve(double *l, int ld, int dim, double *b);
+int benchmod_whatif(struct s_solver_state *st, double *x, double *b, double *cor,
+	double *y, int *tau, int *kappa, double *w, int *prop,
+	int *diff, int *index, double rho, int tt, int mm);
+int build_infl(struct s_solver_state *st);
+int benchmod_vintages(double *x, double *y, int *tau, int *kappa, double *w,
+	int prop, int diff, int index, double rho, int tt, int mm, int nbvint, int *ttv,
+	double *out);
+int benchmod_sweep(double *x, double *y, int *tau, int *kappa, double *w,
+	int nbvar, int *vprop, int *vdiff, int *vindex, double rho, int tt, int mm,
+	double *out);
+int batch_lanes(void);
+int benchmod_batch(int nbl, int lanes, double *x, double *b, double *cor,
+	double *y, int *tau, int *kappa, double *w, int prop, int diff, int index,
+	double rho, int tt, int mm);
 
 
-/*
-C       PURPOSE:  CALCULATES FIRST DIFFERENCES EITHER PERIOD TO PERIOD
-C       OR PERIOD OVER THE SAME PERIOD OF THE PRECEEDING YEAR, DEPENDING
-C       UPON THE SEASONALITY OF THE UNDERLYING TIME SERIES.
-C
-C
-C       IN THE EVENT THAT THE NUMBER OF OBSERVATIONS IS LESS
-C       THAN THE LAG THEN THE RESULT VECTOR WILL BE FILLED
-C       WITH ZERO VALUES.
-*/
-
-void firstdiff(int *nopts, int *lag, double *data, double *rslt)
-{
-	int l, i;
-
-	l=*lag;
-	for (i=0; i<*nopts; i++)
-	{
-		rslt[i]=0;
-	}
-
-	for (i=l; i< *nopts; i++)
-	{
-		rslt[i] = data[i] - data[i-*lag];
-	}
-}
-
-
-#define PARM      "\"!\""
-
-void read_print(FILE *out, int setnum, int langnum, int messnum, char **parm, int nb_parm, char * buf);
-char *replace(char *message, int nbtokens, char **tokens);
-
-extern char *lookup_message(int setnum, int lang_num, int messnum);
-extern int errno;
-
 
+/* int nbweights = 120; */
 
 /**********
  *
- * void read_print(FILE *out, int setnum, int langnum,
- *                 int messnum, char **parm, int nb_parm, char * buf);
+ * this program does the quadratic minimization algorithm
+ * it is a c implementation of a sas program given to us by
+ * Pierre Cholette. 
+ *
+ * This version is also fully compatible between micro and hp.
+ * there is only one line to add or remove depending when working
+ * on hp or micro respectively.  It is the first line of all wich
+ * is :
+ *    #pragma prototypes on
  *
- * 1- read a message from the message file
- * 2- if needed, replace parameters in the message
- * 3- print the resulting string to the specied output file
  *
  **********/
 
-void read_print(FILE *out, int setnum, int langnum, int messnum, char **parm, int nb_parm, char * buf)
-{
-	strcpy(buf, lookup_message(setnum, langnum, messnum));
-
-	if (nb_parm > 0)
-		replace(buf, nb_parm, parm);
-
-	fprintf(out, "%s\n", buf); /* newline added by R Puchyr 2003-03-12 */
-}
-
-
-
-/**********
- *
- * char *replace(char *message, int nbtokens, char **tokens)
+/*********
  *
- * takes a messages and replaces each occurence of the string PARM by
- * a token.  Be sure there is enough space to put everything in the
- * string message.
- * returns a pointer to the changed string.
+ *  main routine that calls all the others to do the quadmin
+ *  algorithm
  *
- **********/
+ *********/
 
-char *replace(char *message, int nbtokens, char **tokens)
+void benchmod(double *x, double *b, double *cor, double *y,
+	int *tau, int *kappa, double *w, int *prop,
+	int *diff, int *index, double rho, int tt, int mm)
 {
-	int   nbfound;
-	char *rest;
-	char  rest2[BUFSIZ];
-
-	nbfound = 0;
-
-	while ( (rest = strstr(message, PARM)) && (nbfound < nbtokens) )
-	{
-		rest[0] = '\0';
-		rest += strlen(PARM);
-		strcpy(rest2, rest);
-		strcat(message, tokens[nbfound]);
-		strcat(message, rest2);
-		nbfound++;
-	}
-
-	return(message);
-}
-
-
-
+	double  *qinvw;
+	double  *wqinvw;
+	double  *wqinvw2;
+	double  *rquinv;
+	double  *x2;
+	double  *add_disc;
+	double  *pro_disc;
+	double  *invy;
+	size_t   size;
 
-char *lookup_message(int setnum, int langnum, int messnum)
-{
-	static char ret[1024];
+	if (*prop != 1)
+		*prop = 0;
+	if (*diff != 2 && *diff != 3)     /* 3 = first difference with the */
+		*diff = 1;                    /* last correction extrapolated  */
+	if (*index != 1)                  /* index = 1 for index series   */
+		*index = 0;
 
-	switch (setnum)
-	{
-		case 1:
-			switch (langnum)
-			{
-				case 1:
-					switch (messnum)
-					{
-						case  1:
-							strcpy(ret, "ERREUR 1: ARGUMENT INVALIDE \"!\" ASSOCIE AU MOT CLEF \"!\".");
-							break;
+	if (*diff == 2 && benchmod_d2(x, b, cor, y, tau, kappa, w, *prop, *index, tt, mm))
+		return;
 
-						case  2:
-							strcpy(ret, "ERREUR 2: CONFLIT ENTRE BENCHFREQ ET FREQ.");
-							break;
+	size     = (size_t)sizeof(double);
+	qinvw    = (double *)qm_malloc(size * (size_t)(tt * mm));
+	wqinvw   = (double *)qm_malloc(size * (size_t)(mm * mm));
+	rquinv   = (double *)qm_malloc(size * (size_t)(tt));
+	x2       = (double *)qm_malloc(size * (size_t)(tt));
+	add_disc = (double *)qm_malloc(size * (size_t)(mm));
+	pro_disc = (double *)qm_malloc(size * (size_t)(mm));
+	invy     = (double *)qm_malloc(size * (size_t)(mm));
 
-						case  3:
-							strcpy(ret, "ERREUR 3: DUREE SPECIFIEE EST TROP COURTE.");
-							break;
+	if (!(qinvw && wqinvw && rquinv && cor && x2 && add_disc && pro_disc && invy))
+		send_out_of_mem();
 
-						case  4:
-							strcpy(ret, "ERREUR 4: CONFLIT DE DATES ENTRE UPDATEFROM ET FROM OU TO.");
-							break;
+	STAT_BEGIN(PH_QINVW);
+	build_qinvw(x2, x, rquinv, tau, tt, kappa, w, *prop, rho, qinvw, mm);
+	STAT_END(PH_QINVW);
 
-						case  5:
-							strcpy(ret, "ERREUR 5: DISTRIBUTORID ET TARGETID NE PEUVENT AVOIR LE MEME NOM. VEUILLEZ RE-ENTRER LA VALEUR ASSOCIEE AU MOT CLEF TARGETID.");
-							break;
+	STAT_BEGIN(PH_WQINVW);
+	build_wqinvw(tau, kappa, mm, qinvw, wqinvw, w, tt);
+	STAT_END(PH_WQINVW);
 
-						case  6:
-							strcpy(ret, "ERREUR 6: COMMANDE INCONNUE \"!\" = \"!\".");
-							break;
+	cal_discrep(mm, tau, kappa, add_disc, pro_disc, y, x, w, *index);
 
-						case  7:
-							strcpy(ret, "ERREUR 7: L'ARGUMENT SPECIFIE POUR FISCALLAG DOIT ETRE PLUS PETIT QUE FREQ.");
-							break;
+	STAT_BEGIN(PH_INVERSE);
+	wqinvw2 = NULL;
+	if (solver_for(mm) != SOLVER_CHOL || !solve_chol(wqinvw, add_disc, invy, mm))
+		wqinvw2 = cal_inv2(mm, wqinvw);
+	STAT_END(PH_INVERSE);
 
-						case  8:
-							strcpy(ret, "ERREUR 8: LA COMBINAISON D'OPTIONS: MEAN=Y ET STOCK=Y EST INVALIDE.");
-							break;
+	STAT_BEGIN(PH_MATMULT);
+	if (wqinvw2 != NULL)
+		matmult(invy, wqinvw2, add_disc, mm, (int)1, mm);
 
-						case  9:
-							strcpy(ret, "ERREUR 9: VALEUR MANQUANTE POUR LE MOT-CLEF: \"!\".");
-							break;
+	qinvw_mult(cor, qinvw, invy, tt, mm, tt);
+	STAT_END(PH_MATMULT);
 
-						case 10:
-							strcpy(ret, "ERROR 10: LE MEME DISTRIBUTEUR NE PEUT ETRE EGAL A DEUX JALONS DIFFERENTS.");
-							break;
+	apply_corr(tt, b, x, cor, *prop);
+	if (*diff != 1)
+		modif_corr(kappa, cor, tt, b, x, mm, *prop);
 
-						case 11:
-							strcpy(ret, "IL EST POSSIBLE QU'IL Y AIT DISCONTINUITE DE MOUVEMENT ENTRE LA SERIE CALCULEE ET CELLE QUI LA PRECEDE SUR LA BASE. DATE DE DEBUT (FROM) RECOMMANDEE: \"!\".");
-							break;
+	free(qinvw);
+	free(wqinvw);
+/**********
+ * next line is needed only if the matrix inversion routine is
+ * cal_inv.  If the other one is picked out (cal_inv2),
+ * comment out the free statement.
+ **********/
+/*  free(wqinvw2);   */
+	free(rquinv);
+	free(x2);
+	free(add_disc);
+	free(pro_disc);
+	free(invy);
+}
 
-						case 12:
-							strcpy(ret, "IL EST POSSIBLE QUE LE JALON COUVRANT LA PERIODE \"!\" NE SOIT PAS SATISFAIT. DATE DE DEBUT (FROM) RECOMMANDEE: \"!\".");
-							break;
+/*********
+ *
+ * construction of the matrix qinvw.
+ *
+ * this function takes by far the most time to run of all the
+ * functions in this program.  Because of this, it has been rearranged
+ * to take a few shortcuts but this is at the expense of readability.
+ * Mainly, what was done was to take as much calculation as possible out of
+ * the loops.  In order to do so, it was necessary to use some temporary
+ * variables which are all declared in the second part of the declaration block.
+ * The powers of rho only depend on abs(c-r) and are taken from a table
+ * calculated once.  qinvw is stored transposed, qinvw[m*tt + r].
+ *
+ **********/
 
-						case 13:
-							strcpy(ret, "IL EST POSSIBLE QU'IL Y AIT DISCONTINUITE DE MOUVEMENT ENTRE LA SERIE MISE A JOUR ET LES CHIFFRES QUI PRECEDENT SUR LA BASE. DATE DE MISE A JOUR (UPDATEFROM) RECOMMANDEE: \"!\".");
-							break;
+void build_qinvw(double *x2, double *x, double *rquinv, int *tau,
+	int tt, int *kappa, double *w, int prop,
+	double rho, double *qinvw, int mm)
+{
+	int r,m,k;
+	int tw1;
+	int t1;
+	int nperm;
+	double xbar;
 
-						case 14:
-							strcpy(ret, "IL EST POSSIBLE QUE LE JALON COUVRANT LA PERIODE \"!\" NE SOIT PAS SATISFAIT. DATE DE MISE A JOUR (UPDATEFROM) RECOMMANDEE: \"!\".");
-							break;
+	double tdiv;
+	double *rpow;
+	double *sym;
+	int wn;
 
-						case 15:
-							strcpy(ret, "LA SERIE CIBLE A DES VALEURS NEGATIVES.");
-							break;
+	xbar = sumit(x, tt) / tt;
+	rpow = rho_powers(rho, tt);
+	sym  = (double *)qm_malloc(sizeof(double) * (size_t)(2*tt));
 
-						case 16:
-							strcpy(ret, "LA SERIE DISTRIBUTRICE A DES VALEURS PLUS PETITES OU EGALES A ZERO.");
-							break;
+	if (!(rpow && sym))
+		send_out_of_mem();
 
-						case 17:
-							strcpy(ret, "VALEURS MANQUANTES A LA FIN DE LA SERIE JALON. DISTRIBUTEUR EXTRAPOLE.");
-							break;
+	simd_init();
+	wn = window_kernel(tau, kappa, mm);
 
-						case 18:
-							strcpy(ret, "ERREUR 10:   LA SERIE CIBLE NE PEUT ETRE LUE");
-							break;
+	/**********
+	* sym[k] = rho ** abs(k - (tt-1)), so the powers needed for row r
+	* are sym[tt-1-r] to sym[2*tt-2-r], in order
+	**********/
 
-						case 19:
-							strcpy(ret, "ERREUR 11:   LA SERIE DISTRIBUTRICE NE PEUT ETRE LUE VEUILLEZ VERIFIER LES DATE AINSI QUE LA FREQUENCE ");
-							break;
+	for (k = 0; k < tt; k++)
+	{
+		sym[tt-1+k] = rpow[k];
+		sym[tt-1-k] = rpow[k];
+	}
 
-						case 20:
-							strcpy(ret, "ERROR 10:   LA SERIE JALON NE PEUT ETRE LUE");
-							break;
+	for (r = 0; r < tt; r++)
+		x2[r] = (prop == 0) ? x[r] : 1;
 
-						case 21:
-							strcpy(ret, "SEULEMENT UNE VALEUR JALON UTILISEE.");
-							break;
+	for (r = 0; r < tt; r++)
+	{
+		tdiv = x2[r] / xbar;
+		vmul3(rquinv, &sym[tt-1-r], tdiv, x2, tt);
 
-						default:
-							sprintf(ret, "No message for number s%dm%d", setnum, messnum);
-							break;
+		if (wn != 0)
+		{
+			t1 = tau[0] - 1;
+			switch (wn)
+			{
+				case 3:
+					for (m = 0; m < mm; m++, t1 += 3)
+						qinvw[m*tt + r] = wdot3(&rquinv[t1], &w[m*3]);
+					break;
 
-					}
+				case 4:
+					for (m = 0; m < mm; m++, t1 += 4)
+						qinvw[m*tt + r] = wdot4(&rquinv[t1], &w[m*4]);
+					break;
 
+				case 12:
+					for (m = 0; m < mm; m++, t1 += 12)
+						qinvw[m*tt + r] = wdot12(&rquinv[t1], &w[m*12]);
 					break;
+			}
+			continue;
+		}
 
-				case 2:
-					switch (messnum)
-					{
-						case  1:
-							strcpy(ret, "ÎØÈÁÊÀ 1: ÍÅÄÎÏÓÑÒÈÌÎÅ ÇÍÀ×ÅÍÈÅ \"!\" ÄËß ÊËÞ×ÅÂÎÃÎ ÑËÎÂÀ: \"!\".");
-							break;
+		tw1 = 0;
+		for (m = 0; m < mm; m++)
+		{
+			t1 = tau[m] - 1;
+			nperm = kappa[m] - t1;
+			qinvw[m*tt + r] = vdot(&rquinv[t1], &w[tw1], nperm);
+			tw1 += nperm;
+		}
+	}
 
-						case  2:
-							strcpy(ret, "ERROR 2: ÍÅÑÎÎÒÂÅÒÑÒÂÈÅ ÌÅÆÄÓ BENCHFREQ È FREQ.");
-							break;
+	free(rpow);
+	free(sym);
+}
 
-						case  3:
-							strcpy(ret, "ERROR 3: ÇÀÄÀÍÍÛÉ ÂÐÅÌÅÍÍÎÉ ÄÈÀÏÀÇÎÍ ÍÅÄÎÑÒÀÒÎ×ÍÎ ÂÅËÈÊ.");
-							break;
+/**********
+ *
+ * construction of the matrix wqinvw
+ *
+ **********/
 
-						case  4:
-							strcpy(ret, "ERROR 4: ÍÅÑÎÎÒÂÅÒÑÒÂÈÅ ÌÅÆÄÓ UPDATEFROM È ÄÀÒÀÌÈ FROM ÈËÈ TO.");
-							break;
+void build_wqinvw(int *tau, int *kappa, int mm, double *qinvw, double *wqinvw, double *w, int tt)
+{
+	int    tw1;
+	int    t1;
+	int    nperr;
+	int    r, c, c0, c1;
+	int    wn;
 
-						case  5:
-							strcpy(ret, "ERROR 5: DISTRIBUTORID È TARGETID ÍÅ ÌÎÃÓÒ ÈÌÅÒÜ ÎÄÍÎ È ÒÎ ÆÅ ÈÌß.  ÏÎÆÀËÓÉÑÒÀ, ÏÎÂÒÎÐÈÒÅ ÂÂÎÄ TARGETID.");
-							break;
+	simd_init();
+	wn = window_kernel(tau, kappa, mm);
 
-						case  6:
-							strcpy(ret, "ERROR 6: ÍÅÏÀÑÏÎÇÍÀÍÍÀß ÏÀÐÀ KEYWORD=VALUE: \"!\" = \"!\".");
-							break;
+	/**********
+	* wqinvw[r][c] is the weighted sum of the periods tau[r]-1 to
+	* kappa[r]-1 of column c of qinvw, a contiguous segment of the
+	* transposed storage.  wqinvw is symmetric: only c <= r is
+	* calculated, WQ_TILE columns at a time so that the same segment
+	* of w is used for all the columns of the tile, and the upper
+	* triangle is copied.
+	**********/
 
-						case  7:
-							strcpy(ret, "ERROR 7: ÇÀÄÀÍÍÎÅ ÇÍÀ×ÅÍÈÅ FISCALLAG ÄÎËÆÍÎ ÁÛÒÜ ÌÅÍÜØÅ FREQ.");
-							break;
+	for (c0 = 0; c0 < mm; c0 += WQ_TILE)
+	{
+		c1 = (c0 + WQ_TILE < mm) ? c0 + WQ_TILE : mm;
 
-						case  8:
-							strcpy(ret, "ERROR 8: ÍÅ ÄÎÏÓÑÊÀÅÒÑß ÎÄÍÎÂÐÅÌÅÍÍÎÅ ÇÀÄÀÍÈÅ MEAN=Y AND STOCK=Y.");
-							break;
+		tw1 = 0;
+		for (r = 0; r < mm; r++)
+		{
+			t1 = tau[r] - 1;
+			nperr = kappa[r] - t1;
 
-						case  9:
-							strcpy(ret, "ERROR 9: ÎÒÑÓÒÑÒÂÓÞÙÅÅ ÇÍÀ×ÅÍÈÅ ÄËß ÊËÞ×ÅÂÎÃÎ ÑËÎÂÀ: \"!\".");
-							break;
+			if (wn != 0)
+			{
+				for (c = c0; c < c1 && c <= r; c++)
+					wqinvw[r*mm + c] = wdot(wn, &w[tw1], &qinvw[c*tt + t1]);
+			}
+			else
+			{
+				for (c = c0; c < c1 && c <= r; c++)
+					wqinvw[r*mm + c] = vdot(&w[tw1], &qinvw[c*tt + t1], nperr);
+			}
 
-						case 10:
-							strcpy(ret, "ÍÅÂÎÇÌÎÆÍÎ ÏÐÈÐÀÂÍßÒÜ ÎÄÈÍ È ÒÎÒ ÆÅ ÒÅÊÓÙÈÉ ÏÎÊÀÇÀÒÅËÜ ÄÂÓÌ ÐÀÇËÈ×ÍÛÌ ÊÎÍÒÐÎËÜÍÛÌ ÇÍÀ×ÅÍÈßÌ. ÏÅÐÂÎÅ ÈÇ ÍÈÕ ÈÑÏÎËÜÇÎÂÀÍÎ ÄËß ÓÂßÇÊÈ, ÂÒÎÐÎÅ ÏÐÎÈÃÍÎÐÈÐÎÂÀÍÎ.");
-							break;
+			tw1 += nperr;
+		}
+	}
 
-						case 11:
-							strcpy(ret, "ÅÑÒÜ ÂÅÐÎßÒÍÎÑÒÜ ÐÀÇÐÛÂÀ Â ÄÈÍÀÌÈÊÅ ÌÅÆÄÓ ÊÎÐÐÅÊÒÈÐÓÅÌÛÌ Â ÄÀÍÍÛÉ ÌÎÌÅÍÒ ÐßÄÎÌ È ÏÐÅÄÛÄÓÙÈÌ ÐßÄÎÌ Â ÁÀÇÅ. ÐÅÊÎÌÅÍÄÓÅÒÑß ÍÀ×ÀÒÜ Ñ ÄÀÒÛ: \"!\".");
-							break;
+	for (r = 0; r < mm; r++)
+		for (c = r + 1; c < mm; c++)
+			wqinvw[r*mm + c] = wqinvw[c*mm + r];
+}
 
-						case 12:
-							strcpy(ret, "ÊÎÍÒÐÎËÜÍÛÉ ÏÎÊÀÇÀÒÅËÜ, ÎÕÂÀÒÛÂÀÞÙÈÉ ÏÅÐÈÎÄ \"!\" , ÂÅÐÎßÒÍÎ, ÍÅ ÑÎÃËÀÑÓÅÒÑß Ñ ÊÎÐÐÅÊÒÈÐÓÅÌÛÌ Â ÄÀÍÍÛÉ ÌÎÌÅÍÒ ÐßÄÎÌ. ÐÅÊÎÌÅÍÄÓÅÒÑß ÍÀ×ÀÒÜ Ñ ÄÀÒÛ: \"!\".");
-							break;
+/**********
+ *
+ * calculates the annual discrepancies
+ *
+ **********/
 
-						case 13:
-							strcpy(ret, "ÅÑÒÜ ÂÅÐÎßÒÍÎÑÒÜ ÐÀÇÐÛÂÀ Â ÄÈÍÀÌÈÊÅ ÌÅÆÄÓ ÊÎÐÐÅÊÒÈÐÓÅÌÛÌ Â ÄÀÍÍÛÉ ÌÎÌÅÍÒ ÐßÄÎÌ È ÏÐÅÄÛÄÓÙÈÌ ÐßÄÎÌ Â ÁÀÇÅ. ÐÅÊÎÌÅÍÄÓÅÒÑß UPDATEFROM ÍÀ×ÈÍÀß Ñ ÄÀÒÛ: \"!\".");
-							break;
+void cal_discrep(int mm, int *tau, int *kappa,
+	double *add_disc, double *pro_disc, double *y,
+	double *x, double *w, int index)
+{
+	int r;
+	int t1;
+	int tw1;
+	int nperr;
+	double temp;
+	double yr;
+	double sumw;
+	int wn;
 
-						case 14:
-							strcpy(ret, "ÊÎÍÒÐÎËÜÍÛÉ ÏÎÊÀÇÀÒÅËÜ, ÎÕÂÀÒÛÂÀÞÙÈÉ ÏÅÐÈÎÄ \"!\" , ÂÅÐÎßÒÍÎ, ÍÅ ÑÎÃËÀÑÓÅÒÑß Ñ ÊÎÐÐÅÊÒÈÐÓÅÌÛÌ Â ÄÀÍÍÛÉ ÌÎÌÅÍÒ ÐßÄÎÌ. ÐÅÊÎÌÅÍÄÓÅÒÑß UPDATEFROM ÍÀ×ÈÍÀß Ñ ÄÀÒÛ: \"!\".");
-							break;
+	simd_init();
+	wn = window_kernel(tau, kappa, mm);
 
-						case 15:
-							strcpy(ret, "Â ÖÅËÅÂÎÌ ÐßÄÅ ÏÐÈÑÓÒÑÒÂÓÞÒ ÎÒÐÈÖÀÒÅËÜÍÛÅ ÇÍÀ×ÅÍÈß");
-							break;
+	tw1 = 0;
+	for (r = 0; r < mm; r++)
+	{
+		t1 = tau[r] - 1;
+		nperr = kappa[r] - t1;
+		sumw = sumit(&w[tw1], nperr);
+		temp = (wn != 0) ? wdot(wn, &w[tw1], &x[t1]) : vdot(&w[tw1], &x[t1], nperr);
 
-						case 16:
-							strcpy(ret, "ÐßÄ ÒÅÊÓÙÈÕ ÏÎÊÀÇÀÒÅËÅÉ ÑÎÄÅÐÆÈÒ ÍÓËÅÂÛÅ È/ÈËÈ ÎÒÐÈÖÀÒÅËÜÍÛÅ ÇÍÀ×ÅÍÈß");
-							break;
+		yr = (index == 1) ? y[r] * sumw : y[r];
+		add_disc[r] = yr - temp;
+		pro_disc[r] = yr / temp;
+		tw1 += nperr;
+	}
+}
 
-						case 17:
-							strcpy(ret, "ÎÒÑÓÒÑÒÂÓÞÙÈÅ ÄÀÍÍÛÅ Â ÊÎÍÖÅ ÊÎÍÒÐÎËÜÍÎÃÎ ÐßÄÀ. ÐßÄ ÒÅÊÓÙÈÕ ÏÎÊÀÇÀÒÅËÅÉ ÝÊÑÒÐÀÏÎËÈÐÎÂÀÍ.");
-							break;
+/**********
+ *
+ * calculates the inverse of a matrix. 
+ *
+ * algorithm:
+ *     we proceed by the 'triangularisation' of the matrix mat.
+ *     we do the same operations on the identity matrix (inv) then on
+ *     the mat matrix.  when the 'triangularisation' of mat is done
+ *     the inv matrix as become the inverse of the matrix mat.
+ *
+ * Note: Not used. cal_inv2 is used instead. 
+ * 
+ **********/
 
-						case 18:
-							strcpy(ret, "ERROR 10:   ÍÅÂÎÇÌÎÆÍÎ ÏÐÎ×ÈÒÀÒÜ ÖÅËÅÂÎÉ ÏÎÊÀÇÀÒÅËÜ");
-							break;
+double *cal_inv(int dim, double *mat)
+{
+	int row,col,row2;
+	int     add;
+	double *inv;
+	double *tempmat;
+	double  pivot;
 
-						case 19:
-							strcpy(ret, "ERROR 11:   ÍÅÂÎÇÌÎÆÍÎ ÏÐÎ×ÈÒÀÒÜ ÒÅÊÓÙÈÉ ÏÎÊÀÇÀÒÅËÜ. ÏÎÆÀËÓÉÑÒÀ, ÏÐÎÂÅÐÜÒÅ ÄÀÒÛ È ÏÅÐÈÎÄÈ×ÍÎÑÒÜ");
-							break;
+	inv = (double *)qm_malloc((size_t)(dim * dim * sizeof(double)));
+	tempmat = (double *)qm_malloc((size_t)(dim * dim * sizeof(double)));
 
-						case 20:
-							strcpy(ret, "ERROR 10:   ÍÅÂÎÇÌÎÆÍÎ ÏÐÎ×ÈÒÀÒÜ ÊÎÍÒÐÎËÜÍÛÉ ÏÎÊÀÇÀÒÅËÜ");
-							break;
+	if (! (inv && tempmat))
+		send_out_of_mem();
 
-						case 21:
-							strcpy(ret, "ÈÑÏÎËÜÇÎÂÀÍ ÒÎËÜÊÎ ÎÄÈÍ ÊÎÍÒÐÎËÜÍÛÉ ÏÎÊÀÇÀÒÅËÜ");
-							break;
+	for (row = 0; row < dim; row++)
+	{
+		add = row*dim;
+		for (col = 0; col < dim; col++)
+		{
+			tempmat[add+col] = mat[add+col];
+			inv[add+col] = (row == col) ? 1 : 0;
+		}
+	}
 
-						default:
-							sprintf(ret, "No message for number s%dm%d", setnum, messnum);
-							break;
+	for (row = 0; row < dim; row++)
+	{
+		add = row*dim;
+		pivot = tempmat[add+row];
+		for (col = 0; col < dim; col++)
+		{
+			tempmat[add+col] /= pivot;
+			inv[add+col] /= pivot;
+		}
+		for (row2 = 0; row2 < dim; row2++)
+		{
+			if (row2 != row)
+			{
+				pivot = -tempmat[row2*dim+row];
+				for (col = 0; col < dim; col++)
+				{
+					tempmat[row2*dim+col] += pivot * tempmat[add+col];
+					inv[row2*dim+col] += pivot * inv[add+col];
+				}
+			}
+		}
+	}
 
-					}
+	free(tempmat);
+	return(inv);
+}
 
-					break;
+/**********
+ * 
+ * calculates the inverse of a matrix.
+ * 
+ * Finds the invrese of a positive definite symmetrix matrix by the
+ * pivotal condensation method. this routine was furnished by
+ * P. Cholette it does the same as the function above but is supposed
+ * to be more precise.
+ *
+ **********/
+
+double *cal_inv2(int dim, double *mat)
+{
+	int     icol, l, l1;
+	int     add,add2;
+	int     mult;
+	double  pivot;
+	double  t;
+
+	for (icol = 0; icol < dim; icol++)
+	{
+		mult = 1;
+		add = icol*dim;
+		pivot = mat[add+icol];
+		mat[add+icol] = 1;
+		if (pivot < 0)
+			mult = -1;
+		if (fabs(pivot) < 1.0e-20)
+			pivot = 1.0e-20 * mult;
+		pivot = 1 / pivot;
+
+		for (l = 0; l < dim; l++)
+			mat[add+l] *=pivot;
+
+		for (l1 = 0; l1 < dim; l1++)
+		{
+			if (l1 != icol)
+			{
+				add2 = l1*dim;
+				t = mat[add2+icol];
+				mat[add2+icol] = 0;
+				for (l = 0; l < dim; l++)
+					mat[add2+l] = mat[add2+l] - mat[add+l] * t;
+			}
+		}
+	}
+
+	return(mat);
+}
+
+/*********
+ *
+ * this routine does a matrix multiplication of matrix bb and cc and
+ * puts the result of the multiplication into matrix aa.
+ *
+ * the matrixes are passed in parameters as pointers to doubles so
+ * we have to calculate each address of the matrixes.
+ *
+ * matrix bb as dimensions rowb * colb
+ * matrix cc as dimensions colb * colc   (rowc as to be = to colb)
+ * matrix aa as dimensions rowb * colc
+ *
+ **********/
+
+void matmult(double *aa, double *bb, double *cc, int rowb, int colc, int colb)
+{
+	int r,c,k;
+	int add;
+	double sum;
+
+	if (colc == 1)
+	{
+		simd_init();
+		for (r = 0; r < rowb; r++)
+			aa[r] = vdot(&bb[r*colb], cc, colb);
+		return;
+	}
+
+	for (r = 0; r < rowb; r++)
+	{
+		add = r*colb;
+		for (c = 0; c < colc; c++)
+		{
+			sum = 0.0;
+			for (k = 0; k < colb; k++)
+				sum += bb[add+k] * cc[k*colc+c];
+
+			*aa = sum;
+			aa++;
+		}
+	}
+}
+
+/**********
+ *
+ * cor = qinvw * invy for the first tt periods and the first mm
+ * benchmarks of the transposed qinvw (leading dimension ld).  Done
+ * COR_TILE periods at a time so that the tile of cor stays in cache
+ * while the columns are added.
+ *
+ **********/
+
+void qinvw_mult(double *cor, double *qinvw, double *invy, int tt, int mm, int ld)
+{
+	int r0, n;
+	int r, m;
+
+	simd_init();
+
+	for (r0 = 0; r0 < tt; r0 += COR_TILE)
+	{
+		n = (r0 + COR_TILE < tt) ? COR_TILE : tt - r0;
+
+		for (r = 0; r < n; r++)
+			cor[r0 + r] = 0;
+
+		for (m = 0; m < mm; m++)
+			vaxpy(&cor[r0], invy[m], &qinvw[m*ld + r0], n);
+	}
+}
+
+/**********
+ *
+ * applies the corrections to obtain the benchmarked series
+ *
+ **********/
+
+void apply_corr(int tt, double *b, double *x, double *cor, int prop)
+{
+	int r;
+
+	for (r = 0; r < tt; r++)
+	{
+		b[r] = x[r] + cor[r];
+		if (prop == 0)
+			cor[r] = b[r] / x[r];
+	}
+}
+
+/**********
+ *
+ * modifies the correction at the end, if second differences chosen.
+ *
+ **********/
+
+void modif_corr(int *kappa, double *cor, int tt, double *b, double *x, int mm, int prop)
+{
+	int t2;
+	double last_dif;
+	int   r;
+
+	t2 = kappa[mm-1];
+	if (t2 < tt)
+	{
+		last_dif = cor[(int)t2-1] - cor[(int)(t2-2)];
+		for (r = t2; r < tt; r++)
+		{
+			cor[r] = cor[r-1] + last_dif;
+			if (prop == 0)
+				b[r] = x[r] * cor[r];
+			else
+				b[r] = x[r] + cor[r];
+		}
+	}
+}
+
+/*********
+ *
+ * incremental version of benchmod.
+ *
+ * The state st holds qinvw and the Cholesky factor of wqinvw of the
+ * previous run of the same series.  When the new job only appends
+ * periods and benchmarks to that run (same tau and kappa for the old
+ * benchmarks and, in proportional mode, the same distributor values)
+ * only the new rows and columns of qinvw are built and the factor is
+ * extended by a bordered update, so the O(mm^3) inversion and the
+ * O(tt^2) construction are not redone.  When the benchmark set and the
+ * discrepancies did not change only the corrections of the new periods
+ * are calculated.
+ *
+ * xbar of the first run is kept for the whole life of the state.  It
+ * only scales qinvw and wqinvw and cancels in the correction.
+ *
+ * returns 1 if the state was used, 0 if benchmod had to be called.
+ *
+ *********/
+
+int benchmod_inc(struct s_solver_state *st, double *x, double *b, double *cor,
+	double *y, int *tau, int *kappa, double *w, int *prop,
+	int *diff, int *index, double rho, int tt, int mm)
+{
+	double *x2;
+	double *add_disc;
+	double *pro_disc;
+	double *rpow;
+	double  temp;
+	int    *woff;
+	int     r, c, k, m;
+	int     t0, m0, t1, nperr;
+	size_t  size;
+
+	if (*prop != 1)
+		*prop = 0;
+	if (*diff != 2 && *diff != 3)
+		*diff = 1;
+	if (*index != 1)
+		*index = 0;
+
+	/**********
+	* the second difference model is solved by benchmod in O(tt),
+	* there is nothing to keep
+	**********/
+
+	if (*diff == 2)
+	{
+		benchmod(x, b, cor, y, tau, kappa, w, prop, diff, index, rho, tt, mm);
+		return(0);
+	}
+
+	size = (size_t)sizeof(double);
+
+	/**********
+	* find out how much of the state can be kept
+	**********/
+
+	if (st->valid && st->prop == *prop && st->rho == rho && tt >= st->tt && mm >= st->mm &&
+		memcmp(tau, st->tau, st->mm * sizeof(int)) == 0 &&
+		memcmp(kappa, st->kappa, st->mm * sizeof(int)) == 0 &&
+		(*prop == 1 || memcmp(x, st->x, st->tt * size) == 0))
+	{
+		t0 = st->tt;
+		m0 = st->mm;
+	}
+	else
+	{
+		t0 = 0;
+		m0 = 0;
+		st->tt = 0;
+		st->mm = 0;
+		st->prop = *prop;
+		st->rho = rho;
+		st->xbar = sumit(x, tt) / tt;
+	}
+
+	if (t0 != tt || m0 != mm)
+	{
+		free(st->infl);
+		st->infl = NULL;
+	}
+
+	st->valid = 0;
+	x2       = (double *)qm_malloc(size * (size_t)(tt));
+	add_disc = (double *)qm_malloc(size * (size_t)(mm));
+	pro_disc = (double *)qm_malloc(size * (size_t)(mm));
+	woff     = (int *)qm_malloc(sizeof(int) * (size_t)(mm));
+	rpow     = rho_powers(rho, tt);
+
+	if (!(x2 && add_disc && pro_disc && woff && rpow && state_alloc(st, tt, mm)))
+		send_out_of_mem();
+
+	for (r = 0; r < tt; r++)
+		x2[r] = (*prop == 0) ? x[r] : 1;
+
+	for (m = 0, k = 0; m < mm; m++)
+	{
+		woff[m] = k;
+		k += kappa[m] - tau[m] + 1;
+	}
+
+	/**********
+	* new columns of the old rows, then the new rows of qinvw
+	**********/
+
+	qinvw_block(st->qinvw, st->mcap, x2, st->xbar, tau, kappa, woff, w, rpow, 0, t0, m0, mm);
+	qinvw_block(st->qinvw, st->mcap, x2, st->xbar, tau, kappa, woff, w, rpow, t0, tt, 0, mm);
+	free(rpow);
+
+	/**********
+	* new rows of wqinvw (lower triangle only, it is symmetric) and
+	* bordered update of the factorization
+	**********/
+
+	for (r = m0; r < mm; r++)
+	{
+		t1 = tau[r] - 1;
+		nperr = kappa[r] - t1;
+
+		for (c = 0; c <= r; c++)
+		{
+			temp = 0;
+			for (k = 0; k < nperr; k++)
+				temp += w[woff[r]+k] * st->qinvw[(t1+k)*st->mcap + c];
+
+			st->chol[r*st->mcap + c] = temp;
+		}
+	}
+
+	if (!chol_extend(st->chol, st->mcap, m0, mm))
+	{
+		/**********
+		* not positive definite in floating point, use the
+		* pivotal condensation of benchmod
+		**********/
+
+		st->tt = 0;
+		st->mm = 0;
+		free(x2);
+		free(add_disc);
+		free(pro_disc);
+		free(woff);
+		benchmod(x, b, cor, y, tau, kappa, w, prop, diff, index, rho, tt, mm);
+		return(0);
+	}
+
+	memcpy(st->tau, tau, mm * sizeof(int));
+	memcpy(st->kappa, kappa, mm * sizeof(int));
+	memcpy(st->x, x, tt * size);
+
+	/**********
+	* solve for the new discrepancies.  If nothing changed for the old
+	* benchmarks, the old corrections are still good.
+	**********/
+
+	cal_discrep(mm, tau, kappa, add_disc, pro_disc, y, x, w, *index);
+	chol_solve(st->chol, st->mcap, mm, add_disc);
+
+	if (m0 != mm || memcmp(add_disc, st->invy, mm * size) != 0)
+		t0 = 0;
+
+	for (r = t0; r < tt; r++)
+	{
+		temp = 0;
+		for (m = 0; m < mm; m++)
+			temp += st->qinvw[r*st->mcap + m] * add_disc[m];
+
+		st->cor[r] = temp;
+	}
+
+	memcpy(st->invy, add_disc, mm * size);
+	memcpy(cor, st->cor, tt * size);
+	st->tt = tt;
+	st->mm = mm;
+	st->valid = 1;
+
+	apply_corr(tt, b, x, cor, *prop);
+	if (*diff == 3)
+		modif_corr(kappa, cor, tt, b, x, mm, *prop);
+
+	free(x2);
+	free(add_disc);
+	free(pro_disc);
+	free(woff);
+
+	return(1);
+}
+
+/*********
+ *
+ * what-if version of benchmod.
+ *
+ * For fixed tau, kappa, weights and distributor the correction is linear
+ * in the discrepancies: cor = qinvw * wqinvw^-1 * add_disc.  The first
+ * run on a series builds the state with benchmod_inc and keeps the tt x mm
+ * influence matrix qinvw * wqinvw^-1.  The next runs with the same layout
+ * (any benchmark values) only calculate the discrepancies and one
+ * matrix-vector product.  In additive mode qinvw does not depend on the
+ * distributor, so the distributor values may change as well.
+ *
+ * returns 1 if the state was used, 0 if benchmod had to be called.
+ *
+ *********/
+
+int benchmod_whatif(struct s_solver_state *st, double *x, double *b, double *cor,
+	double *y, int *tau, int *kappa, double *w, int *prop,
+	int *diff, int *index, double rho, int tt, int mm)
+{
+	double *add_disc;
+	double *pro_disc;
+	size_t  size;
+
+	if (*prop != 1)
+		*prop = 0;
+	if (*diff != 2 && *diff != 3)
+		*diff = 1;
+	if (*index != 1)
+		*index = 0;
+
+	if (*diff == 2)
+	{
+		benchmod(x, b, cor, y, tau, kappa, w, prop, diff, index, rho, tt, mm);
+		return(0);
+	}
+
+	if (!(st->infl && st->valid && st->prop == *prop && st->rho == rho && st->tt == tt && st->mm == mm &&
+		memcmp(tau, st->tau, mm * sizeof(int)) == 0 &&
+		memcmp(kappa, st->kappa, mm * sizeof(int)) == 0 &&
+		(*prop == 1 || memcmp(x, st->x, tt * sizeof(double)) == 0)))
+	{
+		if (!benchmod_inc(st, x, b, cor, y, tau, kappa, w, prop, diff, index, rho, tt, mm))
+			return(0);
+
+		if (!build_infl(st))
+			send_out_of_mem();
+
+		return(1);
+	}
+
+	size     = (size_t)sizeof(double);
+	add_disc = (double *)qm_malloc(size * (size_t)(mm));
+	pro_disc = (double *)qm_malloc(size * (size_t)(mm));
+
+	if (!(add_disc && pro_disc))
+		send_out_of_mem();
+
+	cal_discrep(mm, tau, kappa, add_disc, pro_disc, y, x, w, *index);
+
+	matmult(cor, st->infl, add_disc, tt, (int)1, mm);
+
+	apply_corr(tt, b, x, cor, *prop);
+	if (*diff == 3)
+		modif_corr(kappa, cor, tt, b, x, mm, *prop);
+
+	free(add_disc);
+	free(pro_disc);
+
+	return(1);
+}
+
+/**********
+ *
+ * builds the influence matrix of the state, row by row:
+ * since wqinvw is symmetric, row r of qinvw * wqinvw^-1 is the solution
+ * of wqinvw z = (row r of qinvw).
+ *
+ * returns 1 if o.k., 0 if out of memory.
+ *
+ **********/
+
+int build_infl(struct s_solver_state *st)
+{
+	int r;
+	int mm;
+
+	mm = st->mm;
+	free(st->infl);
+	st->infl = (double *)qm_malloc(sizeof(double) * (size_t)st->tt * (size_t)mm);
+
+	if (!st->infl)
+		return(0);
+
+	for (r = 0; r < st->tt; r++)
+	{
+		memcpy(&st->infl[r*mm], &st->qinvw[r*st->mcap], sizeof(double) * mm);
+		chol_solve(st->chol, st->mcap, mm, &st->infl[r*mm]);
+	}
+
+	return(1);
+}
+
+/*********
+ *
+ * benchmarked series for nbvint cutoffs given in increasing order.
+ *
+ * vintage v uses the first ttv[v] periods of x and the benchmarks whose
+ * last period is before the cutoff.  Those benchmarks are a prefix of
+ * the whole set, so qinvw and wqinvw of a vintage are leading blocks of
+ * the ones of the whole span (xbar only scales both and cancels) and so
+ * is the Cholesky factor of wqinvw.  Both are built once and each
+ * vintage only costs a solve and a product.
+ *
+ * out is tt x nbvint, out[r*nbvint + v] is set for r < ttv[v].
+ *
+ * returns 1 if the shared factor was used, 0 if every vintage went
+ * through benchmod (second difference model, solved in O(tt) anyway,
+ * or wqinvw not positive definite).
+ *
+ *********/
+
+int benchmod_vintages(double *x, double *y, int *tau, int *kappa, double *w,
+	int prop, int diff, int index, double rho, int tt, int mm, int nbvint, int *ttv,
+	double *out)
+{
+	double  *qinvw;
+	double  *wqinvw;
+	double  *rquinv;
+	double  *x2;
+	double  *add_disc;
+	double  *pro_disc;
+	double  *invy;
+	double  *cor;
+	double  *b;
+	int      v, k, r;
+	int      vtt, chol;
+	int      tprop, tdiff, tindex;
+	size_t   size;
+
+	if (prop != 1)
+		prop = 0;
+	if (diff != 2 && diff != 3)
+		diff = 1;
+	if (index != 1)
+		index = 0;
+
+	size     = (size_t)sizeof(double);
+	qinvw    = (double *)qm_malloc(size * (size_t)(tt * mm));
+	wqinvw   = (double *)qm_malloc(size * (size_t)(mm * mm));
+	rquinv   = (double *)qm_malloc(size * (size_t)(tt));
+	x2       = (double *)qm_malloc(size * (size_t)(tt));
+	add_disc = (double *)qm_malloc(size * (size_t)(mm));
+	pro_disc = (double *)qm_malloc(size * (size_t)(mm));
+	invy     = (double *)qm_malloc(size * (size_t)(mm));
+	cor      = (double *)qm_malloc(size * (size_t)(tt));
+	b        = (double *)qm_malloc(size * (size_t)(tt));
+
+	if (!(qinvw && wqinvw && rquinv && x2 && add_disc && pro_disc && invy && cor && b))
+		send_out_of_mem();
+
+	if (diff == 2)
+		chol = 0;
+	else
+	{
+		build_qinvw(x2, x, rquinv, tau, tt, kappa, w, prop, rho, qinvw, mm);
+
+		build_wqinvw(tau, kappa, mm, qinvw, wqinvw, w, tt);
+
+		cal_discrep(mm, tau, kappa, add_disc, pro_disc, y, x, w, index);
+
+		chol = chol_extend(wqinvw, mm, 0, mm);
+	}
+
+	for (v = 0; v < nbvint; v++)
+	{
+		vtt = ttv[v];
+		for (k = 0; k < mm && kappa[k] <= vtt; k++)
+			;
+
+		if (k == 0)
+		{
+			for (r = 0; r < vtt; r++)
+				b[r] = x[r];
+		}
+		else if (chol)
+		{
+			memcpy(invy, add_disc, size * (size_t)k);
+			chol_solve(wqinvw, mm, k, invy);
+
+			qinvw_mult(cor, qinvw, invy, vtt, k, tt);
+
+			apply_corr(vtt, b, x, cor, prop);
+			if (diff == 3)
+				modif_corr(kappa, cor, vtt, b, x, k, prop);
+		}
+		else
+		{
+			tprop = prop;
+			tdiff = diff;
+			tindex = index;
+			benchmod(x, b, cor, y, tau, kappa, w, &tprop, &tdiff, &tindex, rho, vtt, k);
+		}
+
+		for (r = 0; r < vtt; r++)
+			out[r*nbvint + v] = b[r];
+	}
+
+	free(qinvw);
+	free(wqinvw);
+	free(rquinv);
+	free(x2);
+	free(add_disc);
+	free(pro_disc);
+	free(invy);
+	free(cor);
+	free(b);
+
+	return(chol);
+}
+
+/*********
+ *
+ * benchmarked series for nbvar variants of (prop, diff, index).
+ *
+ * qinvw, wqinvw and its Cholesky factor only depend on prop, so they
+ * are built once for each value of prop used; the discrepancies only
+ * depend on index and diff 3 only adds modif_corr.  Second difference
+ * variants (diff 2) are banded solves done by benchmod.  The additive
+ * factorization does not depend on the distributor at all.
+ *
+ * out is nbvar x tt, variant v is in out[v*tt] to out[v*tt + tt-1].
+ *
+ * returns the number of factorizations done.
+ *
+ *********/
+
+int benchmod_sweep(double *x, double *y, int *tau, int *kappa, double *w,
+	int nbvar, int *vprop, int *vdiff, int *vindex, double rho, int tt, int mm,
+	double *out)
+{
+	double  *qinvw;
+	double  *wqinvw;
+	double  *rquinv;
+	double  *x2;
+	double  *add_disc[2];
+	double  *pro_disc;
+	double  *invy;
+	double  *cor;
+	bool     done[2];
+	int      p, v, i;
+	int      chol, nbfact;
+	int      tprop, tdiff, tindex;
+	size_t   size;
+
+	size        = (size_t)sizeof(double);
+	qinvw       = (double *)qm_malloc(size * (size_t)(tt * mm));
+	wqinvw      = (double *)qm_malloc(size * (size_t)(mm * mm));
+	rquinv      = (double *)qm_malloc(size * (size_t)(tt));
+	x2          = (double *)qm_malloc(size * (size_t)(tt));
+	add_disc[0] = (double *)qm_malloc(size * (size_t)(mm));
+	add_disc[1] = (double *)qm_malloc(size * (size_t)(mm));
+	pro_disc    = (double *)qm_malloc(size * (size_t)(mm));
+	invy        = (double *)qm_malloc(size * (size_t)(mm));
+	cor         = (double *)qm_malloc(size * (size_t)(tt));
+
+	if (!(qinvw && wqinvw && rquinv && x2 && add_disc[0] && add_disc[1] && pro_disc && invy && cor))
+		send_out_of_mem();
+
+	done[0] = done[1] = NO;
+	nbfact = 0;
+
+	for (p = 0; p <= 1; p++)
+	{
+		for (v = 0; v < nbvar && (vprop[v] == 1) != (p == 1); v++)
+			;
+		if (v == nbvar)
+			continue;
+
+		build_qinvw(x2, x, rquinv, tau, tt, kappa, w, p, rho, qinvw, mm);
+
+		build_wqinvw(tau, kappa, mm, qinvw, wqinvw, w, tt);
+
+		chol = chol_extend(wqinvw, mm, 0, mm);
+		nbfact++;
+
+		for (v = 0; v < nbvar; v++)
+		{
+			if ((vprop[v] == 1) != (p == 1))
+				continue;
+
+			i = (vindex[v] == 1);
+
+			if (!chol || vdiff[v] == 2)
+			{
+				tprop = p;
+				tdiff = vdiff[v];
+				tindex = i;
+				benchmod(x, &out[v*tt], cor, y, tau, kappa, w, &tprop, &tdiff, &tindex, rho, tt, mm);
+				continue;
+			}
+
+			if (!done[i])
+			{
+				cal_discrep(mm, tau, kappa, add_disc[i], pro_disc, y, x, w, i);
+				done[i] = YES;
+			}
+
+			memcpy(invy, add_disc[i], size * (size_t)mm);
+			chol_solve(wqinvw, mm, mm, invy);
+
+			qinvw_mult(cor, qinvw, invy, tt, mm, tt);
+
+			apply_corr(tt, &out[v*tt], x, cor, p);
+			if (vdiff[v] == 3)
+				modif_corr(kappa, cor, tt, &out[v*tt], x, mm, p);
+		}
+	}
+
+	free(qinvw);
+	free(wqinvw);
+	free(rquinv);
+	free(x2);
+	free(add_disc[0]);
+	free(add_disc[1]);
+	free(pro_disc);
+	free(invy);
+	free(cor);
+
+	return(nbfact);
+}
+
+/*********
+ *
+ * number of series solved together by benchmod_batch: one per lane of
+ * the vector registers of the kernels in use.
+ *
+ *********/
+
+int batch_lanes(void)
+{
+	return(simd_init() == SIMD_AVX512 ? 8 : 4);
+}
+
+/*********
+ *
+ * benchmarked series for a batch of series with the same benchmark
+ * layout (tau, kappa, w) and options.  The series are interleaved:
+ * period r of lane l is x[r*lanes + l] (b, cor likewise, y[m*lanes + l]
+ * for the benchmarks), so that every step of benchmod works on a whole
+ * vector of series at once without horizontal sums.  Only the first nbl
+ * lanes are used; the others are calculated but must hold valid data.
+ *
+ * Every lane does the operations of benchmod in the same order, so a
+ * series gets the same result, to the last bit, as when it is
+ * benchmarked alone.  wqinvw is factored by Cholesky in every lane; a
+ * lane where it is not positive definite is done again by benchmod on
+ * that lane alone.  All the lanes are done by benchmod when benchmod
+ * would not use the same operations: second differences (diff 2), a
+ * size where solver_for does not choose Cholesky, and benchmark
+ * windows of varying width when vdot is not the scalar kernel (its
+ * partial sums are in another order than the sums of the lanes).
+ *
+ * returns the number of lanes that had to be done by benchmod.
+ *
+ *********/
+
+int benchmod_batch(int nbl, int lanes, double *x, double *b, double *cor,
+	double *y, int *tau, int *kappa, double *w, int prop, int diff, int index,
+	double rho, int tt, int mm)
+{
+	double  *qinvw;
+	double  *wqinvw;
+	double  *rquinv;
+	double  *x2;
+	double  *add_disc;
+	double  *sym;
+	double  *rpow;
+	double  *ax;
+	double  *ab;
+	double  *acor;
+	double  *ay;
+	double  *xbar;
+	double  *tdiv;
+	double  *sum;
+	bool    *ok;
+	double   sumw;
+	int      r, c, m, k, l;
+	int      t1, tw1, nper, t2;
+	int      tprop, tdiff, tindex;
+	int      nbback;
+	bool     same;
+	size_t   size;
+
+	size     = (size_t)sizeof(double);
+	qinvw    = (double *)qm_malloc(size * (size_t)(tt * mm * lanes));
+	wqinvw   = (double *)qm_malloc(size * (size_t)(mm * mm * lanes));
+	rquinv   = (double *)qm_malloc(size * (size_t)(tt * lanes));
+	x2       = (double *)qm_malloc(size * (size_t)(tt * lanes));
+	add_disc = (double *)qm_malloc(size * (size_t)(mm * lanes));
+	sym      = (double *)qm_malloc(size * (size_t)(2 * tt));
+	ax       = (double *)qm_malloc(size * (size_t)(tt));
+	ab       = (double *)qm_malloc(size * (size_t)(tt));
+	acor     = (double *)qm_malloc(size * (size_t)(tt));
+	ay       = (double *)qm_malloc(size * (size_t)(mm));
+	xbar     = (double *)qm_malloc(size * (size_t)(lanes));
+	tdiv     = (double *)qm_malloc(size * (size_t)(lanes));
+	sum      = (double *)qm_malloc(size * (size_t)(lanes));
+	ok       = (bool *)qm_malloc(sizeof(bool) * (size_t)(lanes));
+	rpow     = rho_powers(rho, tt);
+
+	if (!(qinvw && wqinvw && rquinv && x2 && add_disc && sym && ax && ab && acor && ay && xbar && tdiv && sum && ok && rpow))
+		send_out_of_mem();
+
+	if (prop != 1)
+		prop = 0;
+	if (index != 1)
+		index = 0;
+
+	same = (diff != 2 && solver_for(mm) == SOLVER_CHOL &&
+		(window_kernel(tau, kappa, mm) != 0 || simd_init() == SIMD_SCALAR));
+
+	for (l = 0; l < lanes; l++)
+		ok[l] = same;
+
+	if (same)
+	{
+		for (k = 0; k < tt; k++)
+		{
+			sym[tt-1+k] = rpow[k];
+			sym[tt-1-k] = rpow[k];
+		}
+
+		/**********
+		* x2 and the mean of every lane (sums in period order, as sumit)
+		**********/
+
+		for (l = 0; l < lanes; l++)
+			sum[l] = 0;
+		for (r = 0; r < tt; r++)
+			for (l = 0; l < lanes; l++)
+				sum[l] += x[r*lanes + l];
+		for (l = 0; l < lanes; l++)
+			xbar[l] = sum[l] / tt;
+
+		for (r = 0; r < tt * lanes; r++)
+			x2[r] = (prop == 0) ? x[r] : 1;
+
+		/**********
+		* qinvw, one row of rquinv at a time as in build_qinvw.  Each
+		* element of the row is a vector of lanes scaled by the same power
+		* of rho; the sums over the window are in period order, as vdot.
+		**********/
+
+		for (r = 0; r < tt; r++)
+		{
+			for (l = 0; l < lanes; l++)
+				tdiv[l] = x2[r*lanes + l] / xbar[l];
+
+			for (c = 0; c < tt; c++)
+				for (l = 0; l < lanes; l++)
+					rquinv[c*lanes + l] = sym[tt-1-r+c] * tdiv[l] * x2[c*lanes + l];
+
+			tw1 = 0;
+			for (m = 0; m < mm; m++)
+			{
+				t1 = tau[m] - 1;
+				nper = kappa[m] - t1;
+				for (l = 0; l < lanes; l++)
+					sum[l] = 0;
+				for (k = 0; k < nper; k++)
+					for (l = 0; l < lanes; l++)
+						sum[l] += rquinv[(t1+k)*lanes + l] * w[tw1+k];
+				for (l = 0; l < lanes; l++)
+					qinvw[(r*mm + m)*lanes + l] = sum[l];
+				tw1 += nper;
+			}
+		}
+
+		/**********
+		* wqinvw and the discrepancies, as build_wqinvw and cal_discrep.
+		* Only the lower triangle of wqinvw is used by the factorization.
+		**********/
+
+		tw1 = 0;
+		for (r = 0; r < mm; r++)
+		{
+			t1 = tau[r] - 1;
+			nper = kappa[r] - t1;
+
+			for (c = 0; c <= r; c++)
+			{
+				for (l = 0; l < lanes; l++)
+					sum[l] = 0;
+				for (k = 0; k < nper; k++)
+					for (l = 0; l < lanes; l++)
+						sum[l] += w[tw1+k] * qinvw[((t1+k)*mm + c)*lanes + l];
+				for (l = 0; l < lanes; l++)
+					wqinvw[(r*mm + c)*lanes + l] = sum[l];
+			}
+
+			for (l = 0; l < lanes; l++)
+				sum[l] = 0;
+			for (k = 0; k < nper; k++)
+				for (l = 0; l < lanes; l++)
+					sum[l] += w[tw1+k] * x[(t1+k)*lanes + l];
+			sumw = sumit(&w[tw1], nper);
+
+			for (l = 0; l < lanes; l++)
+				add_disc[r*lanes + l] = ((index == 1) ? y[r*lanes + l] * sumw : y[r*lanes + l]) - sum[l];
+
+			tw1 += nper;
+		}
+
+		/**********
+		* Cholesky factorization of wqinvw in every lane (chol_extend),
+		* then the solve (chol_solve), in place in add_disc
+		**********/
+
+		for (r = 0; r < mm; r++)
+		{
+			for (c = 0; c <= r; c++)
+			{
+				for (l = 0; l < lanes; l++)
+					sum[l] = wqinvw[(r*mm + c)*lanes + l];
+				for (k = 0; k < c; k++)
+					for (l = 0; l < lanes; l++)
+						sum[l] -= wqinvw[(r*mm + k)*lanes + l] * wqinvw[(c*mm + k)*lanes + l];
+
+				if (c < r)
+				{
+					for (l = 0; l < lanes; l++)
+						wqinvw[(r*mm + c)*lanes + l] = sum[l] / wqinvw[(c*mm + c)*lanes + l];
+				}
+				else
+				{
+					for (l = 0; l < lanes; l++)
+					{
+						if (sum[l] <= 0.0)
+						{
+							ok[l] = NO;
+							sum[l] = 1.0;
+						}
+						wqinvw[(r*mm + r)*lanes + l] = sqrt(sum[l]);
+					}
+				}
+			}
+		}
+
+		for (r = 0; r < mm; r++)
+		{
+			for (k = 0; k < r; k++)
+				for (l = 0; l < lanes; l++)
+					add_disc[r*lanes + l] -= wqinvw[(r*mm + k)*lanes + l] * add_disc[k*lanes + l];
+			for (l = 0; l < lanes; l++)
+				add_disc[r*lanes + l] /= wqinvw[(r*mm + r)*lanes + l];
+		}
+
+		for (r = mm - 1; r >= 0; r--)
+		{
+			for (k = r + 1; k < mm; k++)
+				for (l = 0; l < lanes; l++)
+					add_disc[r*lanes + l] -= wqinvw[(k*mm + r)*lanes + l] * add_disc[k*lanes + l];
+			for (l = 0; l < lanes; l++)
+				add_disc[r*lanes + l] /= wqinvw[(r*mm + r)*lanes + l];
+		}
+
+		/**********
+		* corrections, apply_corr and modif_corr
+		**********/
+
+		for (r = 0; r < tt; r++)
+		{
+			for (l = 0; l < lanes; l++)
+				sum[l] = 0;
+			for (m = 0; m < mm; m++)
+				for (l = 0; l < lanes; l++)
+					sum[l] += qinvw[(r*mm + m)*lanes + l] * add_disc[m*lanes + l];
+
+			for (l = 0; l < lanes; l++)
+			{
+				c = r*lanes + l;
+				b[c] = x[c] + sum[l];
+				cor[c] = (prop == 0) ? b[c] / x[c] : sum[l];
+			}
+		}
+
+		t2 = kappa[mm-1];
+		if (diff == 3 && t2 < tt)
+		{
+			for (l = 0; l < lanes; l++)
+				tdiv[l] = cor[(t2-1)*lanes + l] - cor[(t2-2)*lanes + l];
+
+			for (r = t2; r < tt; r++)
+			{
+				for (l = 0; l < lanes; l++)
+				{
+					c = r*lanes + l;
+					cor[c] = cor[c - lanes] + tdiv[l];
+					b[c] = (prop == 0) ? x[c] * cor[c] : x[c] + cor[c];
+				}
+			}
+		}
+	}
+
+	/**********
+	* lanes left to benchmod
+	**********/
+
+	nbback = 0;
+	for (l = 0; l < nbl; l++)
+	{
+		if (ok[l])
+			continue;
+
+		for (r = 0; r < tt; r++)
+			ax[r] = x[r*lanes + l];
+		for (m = 0; m < mm; m++)
+			ay[m] = y[m*lanes + l];
+
+		tprop = prop;
+		tdiff = diff;
+		tindex = index;
+		benchmod(ax, ab, acor, ay, tau, kappa, w, &tprop, &tdiff, &tindex, rho, tt, mm);
+
+		for (r = 0; r < tt; r++)
+		{
+			b[r*lanes + l] = ab[r];
+			cor[r*lanes + l] = acor[r];
+		}
+		nbback++;
+	}
+
+	free(qinvw);
+	free(wqinvw);
+	free(rquinv);
+	free(x2);
+	free(add_disc);
+	free(sym);
+	free(rpow);
+	free(ax);
+	free(ab);
+	free(acor);
+	free(ay);
+	free(xbar);
+	free(tdiv);
+	free(sum);
+	free(ok);
+
+	return(nbback);
+}
+
+/**********
+ *
+ * makes room in the state for tt periods and mm benchmarks, keeping
+ * what is already calculated.
+ *
+ * returns 1 if o.k., 0 if out of memory.
+ *
+ **********/
+
+int state_alloc(struct s_solver_state *st, int tt, int mm)
+{
+	double *qinvw;
+	double *chol;
+	int     r;
+	int     tcap, mcap;
+	size_t  size;
+
+	if (tt <= st->tcap && mm <= st->mcap)
+		return(1);
+
+	/**********
+	* leave some room, series usually grow by a few periods at a time
+	**********/
+
+	tcap = (tt > st->tcap) ? tt + tt / 4 : st->tcap;
+	mcap = (mm > st->mcap) ? mm + mm / 4 + 1 : st->mcap;
+	size = (size_t)sizeof(double);
+
+	qinvw = (double *)qm_malloc(size * (size_t)tcap * (size_t)mcap);
+	chol  = (double *)qm_malloc(size * (size_t)mcap * (size_t)mcap);
+
+	if (!(qinvw && chol))
+	{
+		free(qinvw);
+		free(chol);
+		return(0);
+	}
+
+	for (r = 0; r < st->tt; r++)
+		memcpy(&qinvw[r*mcap], &st->qinvw[r*st->mcap], size * st->mm);
+
+	for (r = 0; r < st->mm; r++)
+		memcpy(&chol[r*mcap], &st->chol[r*st->mcap], size * st->mm);
+
+	free(st->qinvw);
+	free(st->chol);
+	st->qinvw = qinvw;
+	st->chol  = chol;
+	st->tau   = (int *)qm_realloc(st->tau, sizeof(int) * (size_t)mcap);
+	st->kappa = (int *)qm_realloc(st->kappa, sizeof(int) * (size_t)mcap);
+	st->invy  = (double *)qm_realloc(st->invy, size * (size_t)mcap);
+	st->x     = (double *)qm_realloc(st->x, size * (size_t)tcap);
+	st->cor   = (double *)qm_realloc(st->cor, size * (size_t)tcap);
+	st->tcap  = tcap;
+	st->mcap  = mcap;
+
+	if (!(st->tau && st->kappa && st->invy && st->x && st->cor))
+		return(0);
+
+	return(1);
+}
+
+/**********
+ *
+ * releases the memory of a state and marks it empty.
+ *
+ **********/
+
+void free_state(struct s_solver_state *st)
+{
+	free(st->tau);
+	free(st->kappa);
+	free(st->x);
+	free(st->qinvw);
+	free(st->chol);
+	free(st->invy);
+	free(st->cor);
+	free(st->infl);
+	memset(st, 0, sizeof(struct s_solver_state));
+}
+
+/*********
+ *
+ * builds rows r0 to r1-1 and columns m0 to m1-1 of qinvw directly,
+ * without the full rquinv row of build_qinvw.  The operations are done
+ * in the same order as in build_qinvw so the entries are identical
+ * for the same xbar.  woff gives the position of each benchmark in w
+ * and rpow the powers of rho (rho_powers).
+ *
+ **********/
+
+void qinvw_block(double *qinvw, int ld, double *x2, double xbar, int *tau,
+	int *kappa, int *woff, double *w, double *rpow, int r0, int r1, int m0, int m1)
+{
+	int    r, m, k;
+	int    t1, nperm;
+	double tdiv;
+	double temp;
+
+	for (r = r0; r < r1; r++)
+	{
+		tdiv = x2[r] / xbar;
+		for (m = m0; m < m1; m++)
+		{
+			t1 = tau[m] - 1;
+			nperm = kappa[m] - t1;
+			temp = 0;
+			for (k = 0; k < nperm; k++)
+				temp += rpow[abs(t1+k-r)] * tdiv * x2[t1+k] * w[woff[m]+k];
+
+			qinvw[r*ld + m] = temp;
+		}
+	}
+}
+
+/*********
+ *
+ * table of the powers of rho, rpow[d] = rho ** d for d = 0 to n-1.
+ * Each entry is calculated by pow so the matrices are the same as when
+ * pow was called for every element.
+ *
+ * returns the table (to be freed by the caller) or NULL if out of memory.
+ *
+ **********/
+
+double *rho_powers(double rho, int n)
+{
+	double *rpow;
+	int     d;
+
+	rpow = (double *)qm_malloc(sizeof(double) * (size_t)(n > 0 ? n : 1));
+
+	if (rpow)
+		for (d = 0; d < n; d++)
+			rpow[d] = pow(rho, (double)d);
+
+	return(rpow);
+}
+
+#define D2_RIDGE	1e-8	/* ridge of benchmod_d2, relative to D2'D2 */
+
+/*********
+ *
+ * second difference model.
+ *
+ * With u the correction divided by x2/xbar (the scaling of qinvw), the
+ * first difference model of benchmod minimizes u' R^-1 u, R being the
+ * AR(1) correlation matrix, under the benchmark constraints.  Here the
+ * objective is the sum of the squared second differences of u plus a
+ * ridge of D2_RIDGE times the diagonal of D2'D2 (1 where it is 0), so
+ * it does not depend on rho.  The ridge only matters when the
+ * benchmarks do not fix a trend (a single benchmark): it keeps the
+ * system regular and picks the smallest correction.  Past the last
+ * benchmark the correction then continues nearly in a straight line,
+ * which is what modif_corr approximated.
+ *
+ * The optimality conditions are a symmetric indefinite system in u and
+ * the multipliers.  The multiplier of each benchmark is placed right
+ * after the last period of its reference period so the matrix is
+ * banded, with a half bandwidth of about the number of periods of a
+ * benchmark, and it is solved by band_solve in O(tt).
+ *
+ * returns 1 if o.k., 0 if the system is singular.
+ *
+ *********/
+
+int benchmod_d2(double *x, double *b, double *cor, double *y, int *tau,
+	int *kappa, double *w, int prop, int index, int tt, int mm)
+{
+	double *a;
+	double *rhs;
+	double *scale;
+	double *add_disc;
+	double *pro_disc;
+	double  xbar;
+	double  d2[3];
+	int    *pos;
+	int    *lpos;
+	int    *woff;
+	int     n, bw, ld;
+	int     r, m, k, i, j, t;
+	int     ok;
+
+	d2[0] = 1;
+	d2[1] = -2;
+	d2[2] = 1;
+
+	n        = tt + mm;
+	scale    = (double *)qm_malloc(sizeof(double) * (size_t)(tt));
+	add_disc = (double *)qm_malloc(sizeof(double) * (size_t)(mm));
+	pro_disc = (double *)qm_malloc(sizeof(double) * (size_t)(mm));
+	rhs      = (double *)qm_malloc(sizeof(double) * (size_t)(n));
+	pos      = (int *)qm_malloc(sizeof(int) * (size_t)(tt));
+	lpos     = (int *)qm_malloc(sizeof(int) * (size_t)(mm));
+	woff     = (int *)qm_malloc(sizeof(int) * (size_t)(mm));
+
+	if (!(scale && add_disc && pro_disc && rhs && pos && lpos && woff))
+		send_out_of_mem();
+
+	xbar = sumit(x, tt) / tt;
+	for (r = 0; r < tt; r++)
+		scale[r] = ((prop == 0) ? x[r] : 1) / xbar;
+
+	for (m = 0, k = 0; m < mm; m++)
+	{
+		woff[m] = k;
+		k += kappa[m] - tau[m] + 1;
+	}
+
+	/**********
+	* order of the unknowns: the periods, each multiplier after the
+	* last period of its benchmark
+	**********/
+
+	for (r = 0, m = 0, i = 0; r < tt; r++)
+	{
+		pos[r] = i++;
+		for (; m < mm && kappa[m] - 1 <= r; m++)
+			lpos[m] = i++;
+	}
+	for (; m < mm; m++)
+		lpos[m] = i++;
+
+	bw = 1;
+	for (r = 0; r + 2 < tt; r++)
+		if (pos[r+2] - pos[r] > bw)
+			bw = pos[r+2] - pos[r];
+	for (m = 0; m < mm; m++)
+		if (lpos[m] - pos[tau[m]-1] > bw)
+			bw = lpos[m] - pos[tau[m]-1];
+
+	ld = 3*bw + 1;
+	a  = (double *)qm_calloc((size_t)n * (size_t)ld, sizeof(double));
+
+	if (!a)
+		send_out_of_mem();
+
+	/**********
+	* a(i,j) is a[i*ld + j-i+bw]
+	**********/
+
+	for (r = 0; r + 2 < tt; r++)
+		for (i = 0; i < 3; i++)
+			for (j = 0; j < 3; j++)
+				a[pos[r+i]*ld + pos[r+j]-pos[r+i]+bw] += d2[i] * d2[j];
+
+	for (r = 0; r < tt; r++)
+		a[pos[r]*ld + bw] += D2_RIDGE * ((a[pos[r]*ld + bw] > 0) ? a[pos[r]*ld + bw] : 1);
+
+	cal_discrep(mm, tau, kappa, add_disc, pro_disc, y, x, w, index);
+
+	for (r = 0; r < tt; r++)
+		rhs[pos[r]] = 0;
+
+	for (m = 0; m < mm; m++)
+	{
+		i = lpos[m];
+		rhs[i] = add_disc[m];
+		for (k = 0, t = tau[m]-1; t < kappa[m]; k++, t++)
+		{
+			j = pos[t];
+			a[i*ld + j-i+bw] = w[woff[m]+k] * scale[t];
+			a[j*ld + i-j+bw] = w[woff[m]+k] * scale[t];
+		}
+	}
+
+	ok = band_solve(a, n, bw, rhs);
+
+	if (ok)
+	{
+		for (r = 0; r < tt; r++)
+			cor[r] = scale[r] * rhs[pos[r]];
+
+		apply_corr(tt, b, x, cor, prop);
+	}
+
+	free(a);
+	free(scale);
+	free(add_disc);
+	free(pro_disc);
+	free(rhs);
+	free(pos);
+	free(lpos);
+	free(woff);
+
+	return(ok);
+}
+
+/**********
+ *
+ * solves a x = rhs for a band matrix of half bandwidth bw by Gauss
+ * elimination with partial pivoting.  Row i of a holds a(i,j) for j
+ * from i-bw to i+2*bw at a[i*(3*bw+1) + j-i+bw]; the last bw places
+ * are for the fill-in of the row exchanges and must be zero on entry.
+ * a is destroyed and the solution is returned in rhs.
+ *
+ * returns 1 if o.k., 0 if the matrix is singular.
+ *
+ **********/
+
+int band_solve(double *a, int n, int bw, double *rhs)
+{
+	int    i, j, k, p;
+	int    ld, last, jlast;
+	double big, f, temp;
+
+	ld = 3*bw + 1;
+
+	for (k = 0; k < n; k++)
+	{
+		last  = (k + bw < n) ? k + bw : n - 1;
+		jlast = (k + 2*bw < n) ? k + 2*bw : n - 1;
+
+		p = k;
+		big = fabs(a[k*ld + bw]);
+		for (i = k + 1; i <= last; i++)
+		{
+			if (fabs(a[i*ld + k-i+bw]) > big)
+			{
+				big = fabs(a[i*ld + k-i+bw]);
+				p = i;
+			}
+		}
+
+		if (big == 0)
+			return(0);
+
+		if (p != k)
+		{
+			for (j = k; j <= jlast; j++)
+			{
+				temp = a[k*ld + j-k+bw];
+				a[k*ld + j-k+bw] = a[p*ld + j-p+bw];
+				a[p*ld + j-p+bw] = temp;
+			}
+			temp = rhs[k];
+			rhs[k] = rhs[p];
+			rhs[p] = temp;
+		}
+
+		for (i = k + 1; i <= last; i++)
+		{
+			f = a[i*ld + k-i+bw] / a[k*ld + bw];
+			if (f == 0)
+				continue;
+
+			for (j = k + 1; j <= jlast; j++)
+				a[i*ld + j-i+bw] -= f * a[k*ld + j-k+bw];
+			rhs[i] -= f * rhs[k];
+		}
+	}
+
+	for (k = n - 1; k >= 0; k--)
+	{
+		jlast = (k + 2*bw < n) ? k + 2*bw : n - 1;
+		temp = rhs[k];
+		for (j = k + 1; j <= jlast; j++)
+			temp -= a[k*ld + j-k+bw] * rhs[j];
+		rhs[k] = temp / a[k*ld + bw];
+	}
+
+	return(1);
+}
+
+/**********
+ *
+ * Cholesky factorization, done in place on the lower triangle of a
+ * (leading dimension ld).  Rows 0 to m0-1 must already hold the factor
+ * of the leading m0 x m0 block; rows m0 to m1-1 are factored against
+ * them.  This is the bordered update used when benchmarks are added.
+ * Called with m0 = 0 it is the usual factorization.
+ *
+ * returns 1 if o.k., 0 if the matrix is not positive definite.
+ *
+ **********/
+
+int chol_extend(double *a, int ld, int m0, int m1)
+{
+	int    i, j, k;
+	double s;
+
+	for (i = m0; i < m1; i++)
+	{
+		for (j = 0; j <= i; j++)
+		{
+			s = a[i*ld+j];
+			for (k = 0; k < j; k++)
+				s -= a[i*ld+k] * a[j*ld+k];
+
+			if (j < i)
+				a[i*ld+j] = s / a[j*ld+j];
+			else
+			{
+				if (s <= 0.0)
+					return(0);
+				a[i*ld+i] = sqrt(s);
+			}
+		}
+	}
+
+	return(1);
+}
+
+/**********
+ *
+ * solves (l l') z = b with the Cholesky factor l of leading dimension
+ * ld.  Only the leading dim x dim block of l is used, so the factor of
+ * a set of benchmarks also solves for any prefix of that set.
+ * b is replaced by z.
+ *
+ **********/
+
+void chol_solve(double *l, int ld, int dim, double *b)
+{
+	int    i, k;
+	double s;
+
+	for (i = 0; i < dim; i++)
+	{
+		s = b[i];
+		for (k = 0; k < i; k++)
+			s -= l[i*ld+k] * b[k];
+		b[i] = s / l[i*ld+i];
+	}
+
+	for (i = dim - 1; i >= 0; i--)
+	{
+		s = b[i];
+		for (k = i + 1; k < dim; k++)
+			s -= l[k*ld+i] * b[k];
+		b[i] = s / l[i*ld+i];
+	}
+}
+
+
+  
+/**********
+ *
+ * sums the elements of the array x.
+ *
+ **********/
+
+double sumit(double *x, int nbelem)
+{
+	int i;
+	double result;
+
+	for (result = 0, i = 0; i < nbelem; i++)
+		result += x[i];
+	return(result);
+}
+
+/**********
+ *
+ * SIMD kernels used by build_qinvw, build_wqinvw, cal_discrep and
+ * matmult:
+ *
+ *    vdot(a, b, n)          returns the inner product of a and b
+ *    vaxpy(y, a, x, n)      y += a * x
+ *    vmul3(y, a, s, b, n)   y = a * s * b, element by element
+ *
+ * and the predicates of prnt_warnings and read_series, which stop at the
+ * first block of 8 values holding a match:
+ *
+ *    vneg(x, n)             x[i] < 0 for some i
+ *    vnonpos(x, n)          x[i] <= 0 for some i
+ *    vmiss(x, n)            x[i] is MISSNC, MISSND or MISSNA for some i
+ *    vnan(x, n)             x[i] is a NaN for some i (QUADMIN_MISSING=NAN)
+ *
+ * vaxpy and vmul3 do the same operations as the scalar loops (no fused
+ * multiply-add) and give the same bits on every path, so rquinv does
+ * not depend on the kernel.  vdot sums
+ * in 4 (AVX2) or 8 (AVX-512) partial sums and only agrees with the
+ * scalar sum to a few units in the last place.  wqinvw is
+ * ill-conditioned for rho near 1 and the benchmarked series agree with
+ * the scalar path to about 1e-7 relative; with Q_ROUND a value that
+ * close to a rounding boundary may be rounded the other way.
+ *
+ * simd_init picks the kernels the first time it is called: the widest
+ * set the processor and the operating system support, or the one
+ * named in the environment variable QUADMIN_SIMD (SCALAR, AVX2 or
+ * AVX512) if it is supported.  returns the level used.
+ *
+ **********/
+
+static double (*vdot)(double *a, double *b, int n) = vdot_scalar;
+static void (*vaxpy)(double *y, double a, double *x, int n) = vaxpy_scalar;
+static void (*vmul3)(double *y, double *a, double s, double *b, int n) = vmul3_scalar;
+static int (*vneg)(double *x, int n) = vneg_scalar;
+static int (*vnonpos)(double *x, int n) = vnonpos_scalar;
+static int (*vmiss)(double *x, int n) = vmiss_scalar;
+static int (*vnan)(double *x, int n) = vnan_scalar;
+
+double vdot_scalar(double *a, double *b, int n)
+{
+	int i;
+	double sum;
+
+	for (sum = 0, i = 0; i < n; i++)
+		sum += a[i] * b[i];
+	return(sum);
+}
+
+void vaxpy_scalar(double *y, double a, double *x, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		y[i] += a * x[i];
+}
+
+void vmul3_scalar(double *y, double *a, double s, double *b, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		y[i] = a[i] * s * b[i];
+}
+
+int vneg_scalar(double *x, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		if (x[i] < 0.0)
+			return(1);
+	return(0);
+}
+
+int vnonpos_scalar(double *x, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		if (x[i] <= 0.0)
+			return(1);
+	return(0);
+}
+
+int vmiss_scalar(double *x, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		if (x[i] == MISSNC || x[i] == MISSND || x[i] == MISSNA)
+			return(1);
+	return(0);
+}
+
+int vnan_scalar(double *x, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		if (x[i] != x[i])
+			return(1);
+	return(0);
+}
+
+#ifdef QM_SIMD
+
+QM_TARGET_AVX2 double vdot_avx2(double *a, double *b, int n)
+{
+	__m256d s0, s1;
+	double  part[4];
+	double  sum;
+	int     i;
+
+	s0 = _mm256_setzero_pd();
+	s1 = _mm256_setzero_pd();
+	for (i = 0; i + 8 <= n; i += 8)
+	{
+		s0 = _mm256_add_pd(s0, _mm256_mul_pd(_mm256_loadu_pd(&a[i]), _mm256_loadu_pd(&b[i])));
+		s1 = _mm256_add_pd(s1, _mm256_mul_pd(_mm256_loadu_pd(&a[i+4]), _mm256_loadu_pd(&b[i+4])));
+	}
+	if (i + 4 <= n)
+	{
+		s0 = _mm256_add_pd(s0, _mm256_mul_pd(_mm256_loadu_pd(&a[i]), _mm256_loadu_pd(&b[i])));
+		i += 4;
+	}
+	_mm256_storeu_pd(part, _mm256_add_pd(s0, s1));
+	sum = (part[0] + part[1]) + (part[2] + part[3]);
+
+	for (; i < n; i++)
+		sum += a[i] * b[i];
+	return(sum);
+}
+
+QM_TARGET_AVX2 void vaxpy_avx2(double *y, double a, double *x, int n)
+{
+	__m256d va;
+	int     i;
+
+	va = _mm256_set1_pd(a);
+	for (i = 0; i + 4 <= n; i += 4)
+		_mm256_storeu_pd(&y[i], _mm256_add_pd(_mm256_loadu_pd(&y[i]), _mm256_mul_pd(va, _mm256_loadu_pd(&x[i]))));
+	for (; i < n; i++)
+		y[i] += a * x[i];
+}
+
+QM_TARGET_AVX2 void vmul3_avx2(double *y, double *a, double s, double *b, int n)
+{
+	__m256d vs;
+	int     i;
+
+	vs = _mm256_set1_pd(s);
+	for (i = 0; i + 4 <= n; i += 4)
+		_mm256_storeu_pd(&y[i], _mm256_mul_pd(_mm256_mul_pd(_mm256_loadu_pd(&a[i]), vs), _mm256_loadu_pd(&b[i])));
+	for (; i < n; i++)
+		y[i] = a[i] * s * b[i];
+}
+
+/**********
+* the predicates compare 8 values (two vectors) per step
+**********/
+
+#define VCMP_AVX2(name, test, op)                                        \
+QM_TARGET_AVX2 int name(double *x, int n)                                \
+{                                                                        \
+	__m256d zero;                                                        \
+	int     i;                                                           \
+                                                                         \
+	zero = _mm256_setzero_pd();                                          \
+	for (i = 0; i + 8 <= n; i += 8)                                      \
+		if (_mm256_movemask_pd(_mm256_or_pd(                             \
+				_mm256_cmp_pd(_mm256_loadu_pd(&x[i]), zero, op),         \
+				_mm256_cmp_pd(_mm256_loadu_pd(&x[i+4]), zero, op))))     \
+			return(1);                                                   \
+	for (; i < n; i++)                                                   \
+		if (x[i] test 0.0)                                               \
+			return(1);                                                   \
+	return(0);                                                           \
+}
+
+VCMP_AVX2(vneg_avx2, <, _CMP_LT_OQ)
+VCMP_AVX2(vnonpos_avx2, <=, _CMP_LE_OQ)
+
+QM_TARGET_AVX2 int vnan_avx2(double *x, int n)
+{
+	__m256d a, b;
+	int     i;
+
+	for (i = 0; i + 8 <= n; i += 8)
+	{
+		a = _mm256_loadu_pd(&x[i]);
+		b = _mm256_loadu_pd(&x[i+4]);
+		if (_mm256_movemask_pd(_mm256_or_pd(_mm256_cmp_pd(a, a, _CMP_UNORD_Q), _mm256_cmp_pd(b, b, _CMP_UNORD_Q))))
+			return(1);
+	}
+	for (; i < n; i++)
+		if (x[i] != x[i])
+			return(1);
+	return(0);
+}
+
+QM_TARGET_AVX2 int vmiss_avx2(double *x, int n)
+{
+	__m256d nc, nd, na, a, b;
+	int     i;
+
+	nc = _mm256_set1_pd(MISSNC);
+	nd = _mm256_set1_pd(MISSND);
+	na = _mm256_set1_pd(MISSNA);
+	for (i = 0; i + 8 <= n; i += 8)
+	{
+		a = _mm256_loadu_pd(&x[i]);
+		b = _mm256_loadu_pd(&x[i+4]);
+		if (_mm256_movemask_pd(_mm256_or_pd(
+				_mm256_or_pd(_mm256_or_pd(_mm256_cmp_pd(a, nc, _CMP_EQ_OQ), _mm256_cmp_pd(a, nd, _CMP_EQ_OQ)), _mm256_cmp_pd(a, na, _CMP_EQ_OQ)),
+				_mm256_or_pd(_mm256_or_pd(_mm256_cmp_pd(b, nc, _CMP_EQ_OQ), _mm256_cmp_pd(b, nd, _CMP_EQ_OQ)), _mm256_cmp_pd(b, na, _CMP_EQ_OQ)))))
+			return(1);
+	}
+	for (; i < n; i++)
+		if (x[i] == MISSNC || x[i] == MISSND || x[i] == MISSNA)
+			return(1);
+	return(0);
+}
+
+QM_TARGET_AVX512 double vdot_avx512(double *a, double *b, int n)
+{
+	__m512d s0;
+	double  part[8];
+	double  sum;
+	int     i;
+
+	s0 = _mm512_setzero_pd();
+	for (i = 0; i + 8 <= n; i += 8)
+		s0 = _mm512_add_pd(s0, _mm512_mul_pd(_mm512_loadu_pd(&a[i]), _mm512_loadu_pd(&b[i])));
+	_mm512_storeu_pd(part, s0);
+	sum = ((part[0] + part[1]) + (part[2] + part[3])) + ((part[4] + part[5]) + (part[6] + part[7]));
+
+	for (; i < n; i++)
+		sum += a[i] * b[i];
+	return(sum);
+}
+
+QM_TARGET_AVX512 void vaxpy_avx512(double *y, double a, double *x, int n)
+{
+	__m512d va;
+	int     i;
+
+	va = _mm512_set1_pd(a);
+	for (i = 0; i + 8 <= n; i += 8)
+		_mm512_storeu_pd(&y[i], _mm512_add_pd(_mm512_loadu_pd(&y[i]), _mm512_mul_pd(va, _mm512_loadu_pd(&x[i]))));
+	for (; i < n; i++)
+		y[i] += a * x[i];
+}
+
+QM_TARGET_AVX512 void vmul3_avx512(double *y, double *a, double s, double *b, int n)
+{
+	__m512d vs;
+	int     i;
+
+	vs = _mm512_set1_pd(s);
+	for (i = 0; i + 8 <= n; i += 8)
+		_mm512_storeu_pd(&y[i], _mm512_mul_pd(_mm512_mul_pd(_mm512_loadu_pd(&a[i]), vs), _mm512_loadu_pd(&b[i])));
+	for (; i < n; i++)
+		y[i] = a[i] * s * b[i];
+}
+
+#define VCMP_AVX512(name, test, op)                                      \
+QM_TARGET_AVX512 int name(double *x, int n)                              \
+{                                                                        \
+	__m512d zero;                                                        \
+	int     i;                                                           \
+                                                                         \
+	zero = _mm512_setzero_pd();                                          \
+	for (i = 0; i + 8 <= n; i += 8)                                      \
+		if (_mm512_cmp_pd_mask(_mm512_loadu_pd(&x[i]), zero, op))        \
+			return(1);                                                   \
+	for (; i < n; i++)                                                   \
+		if (x[i] test 0.0)                                               \
+			return(1);                                                   \
+	return(0);                                                           \
+}
+
+VCMP_AVX512(vneg_avx512, <, _CMP_LT_OQ)
+VCMP_AVX512(vnonpos_avx512, <=, _CMP_LE_OQ)
+
+QM_TARGET_AVX512 int vnan_avx512(double *x, int n)
+{
+	__m512d a;
+	int     i;
+
+	for (i = 0; i + 8 <= n; i += 8)
+	{
+		a = _mm512_loadu_pd(&x[i]);
+		if (_mm512_cmp_pd_mask(a, a, _CMP_UNORD_Q))
+			return(1);
+	}
+	for (; i < n; i++)
+		if (x[i] != x[i])
+			return(1);
+	return(0);
+}
+
+QM_TARGET_AVX512 int vmiss_avx512(double *x, int n)
+{
+	__m512d nc, nd, na, a;
+	int     i;
+
+	nc = _mm512_set1_pd(MISSNC);
+	nd = _mm512_set1_pd(MISSND);
+	na = _mm512_set1_pd(MISSNA);
+	for (i = 0; i + 8 <= n; i += 8)
+	{
+		a = _mm512_loadu_pd(&x[i]);
+		if (_mm512_cmp_pd_mask(a, nc, _CMP_EQ_OQ) | _mm512_cmp_pd_mask(a, nd, _CMP_EQ_OQ) | _mm512_cmp_pd_mask(a, na, _CMP_EQ_OQ))
+			return(1);
+	}
+	for (; i < n; i++)
+		if (x[i] == MISSNC || x[i] == MISSND || x[i] == MISSNA)
+			return(1);
+	return(0);
+}
+
+#endif
+
+/**********
+ *
+ * returns the widest set of SIMD instructions usable: the processor
+ * must have them and the operating system must save the registers.
+ *
+ **********/
+
+int cpu_simd_level(void)
+{
+#if defined(QM_SIMD) && defined(_MSC_VER)
+	int info[4];
+	unsigned __int64 xcr0;
+
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return(SIMD_SCALAR);
+
+	__cpuid(info, 1);
+	if (!(info[2] & (1 << 27)) || !(info[2] & (1 << 28)))   /* OSXSAVE, AVX */
+		return(SIMD_SCALAR);
+
+	xcr0 = _xgetbv(0);
+	if ((xcr0 & 0x6) != 0x6)
+		return(SIMD_SCALAR);
+
+	__cpuidex(info, 7, 0);
+	if ((info[1] & (1 << 16)) && (xcr0 & 0xe6) == 0xe6)     /* AVX512F */
+		return(SIMD_AVX512);
+	if (info[1] & (1 << 5))                                   /* AVX2 */
+		return(SIMD_AVX2);
+	return(SIMD_SCALAR);
+#elif defined(QM_SIMD)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f"))
+		return(SIMD_AVX512);
+	if (__builtin_cpu_supports("avx2"))
+		return(SIMD_AVX2);
+	return(SIMD_SCALAR);
+#else
+	return(SIMD_SCALAR);
+#endif
+}
+
+int simd_init(void)
+{
+	static int level = -1;
+	char *env;
+	int   want;
+
+	if (level >= 0)
+		return(level);
+
+	level = cpu_simd_level();
+
+	if ((env = getenv("QUADMIN_SIMD")) != NULL)
+	{
+		want = level;
+		if (strcmp(env, "SCALAR") == 0)
+			want = SIMD_SCALAR;
+		else if (strcmp(env, "AVX2") == 0)
+			want = SIMD_AVX2;
+		else if (strcmp(env, "AVX512") == 0)
+			want = SIMD_AVX512;
+
+		if (want < level)
+			level = want;
+	}
+
+#ifdef QM_SIMD
+	if (level == SIMD_AVX512)
+	{
+		vdot  = vdot_avx512;
+		vaxpy = vaxpy_avx512;
+		vmul3 = vmul3_avx512;
+		vneg  = vneg_avx512;
+		vnonpos = vnonpos_avx512;
+		vmiss = vmiss_avx512;
+		vnan  = vnan_avx512;
+	}
+	else if (level == SIMD_AVX2)
+	{
+		vdot  = vdot_avx2;
+		vaxpy = vaxpy_avx2;
+		vmul3 = vmul3_avx2;
+		vneg  = vneg_avx2;
+		vnonpos = vnonpos_avx2;
+		vmiss = vmiss_avx2;
+		vnan  = vnan_avx2;
+	}
+#endif
+
+	return(level);
+}
+
+/**********
+ *
+ * int any_negative(double *x, int n)
+ * int any_nonpositive(double *x, int n)
+ * int any_missing(double *x, int n)
+ *
+ * the predicates for the checks of the series (vneg, vnonpos, and vmiss
+ * or vnan for the missing values).
+ *
+ **********/
+
+int any_negative(double *x, int n)
+{
+	simd_init();
+	return(vneg(x, n));
+}
+
+int any_nonpositive(double *x, int n)
+{
+	simd_init();
+	return(vnonpos(x, n));
+}
+
+int any_missing(double *x, int n)
+{
+	simd_init();
+	return(nan_missing ? vnan(x, n) : vmiss(x, n));
+}
+
+/**********
+ *
+ * returns the solver to use for mm benchmarks.
+ *
+ * The two solvers differ in the last digits, so the choice is fixed
+ * by solver_table and a job gives the same result on every machine.
+ * The table comes from the timings of tune_solvers on the reference
+ * machine, where Cholesky was the faster for every size: when the
+ * environment variable QUADMIN_TUNE names a file that does not exist,
+ * the solvers are timed on this machine and the results are saved in
+ * it, to update the table.  They do not change the solver.  The
+ * banded solver (second differences) and the saved factorizations
+ * (Q_INCREMENTAL, Q_WHATIF) are not concerned: they depend on the
+ * options, not on the size.
+ *
+ **********/
+
+static const int solver_table[TUNE_BUCKETS] =
+{
+	SOLVER_CHOL, SOLVER_CHOL, SOLVER_CHOL, SOLVER_CHOL,
+	SOLVER_CHOL, SOLVER_CHOL, SOLVER_CHOL, SOLVER_CHOL
+};
+
+int solver_for(int mm)
+{
+	static int done = NO;
+	int   table[TUNE_BUCKETS];
+	char *env;
+	FILE *fp;
+	int   b;
+
+	if (!done)
+	{
+		done = YES;
+		if ((env = getenv("QUADMIN_TUNE")) != NULL)
+		{
+			if ((fp = fopen(env, "r")) != NULL)
+				fclose(fp);
+			else
+			{
+				tune_solvers(table);
+				(void)save_tune(env, table);
+			}
+		}
+	}
+
+	for (b = 0; b < TUNE_BUCKETS - 1 && mm > (4 << b); b++)
+		;
+
+	return(solver_table[b]);
+}
+
+/**********
+ *
+ * writes the timings of tune_solvers: a title line, then one line per
+ * bucket with the largest mm of the bucket and the faster solver
+ * (DENSE or CHOL).
+ *
+ * returns 1 if o.k., 0 else.
+ *
+ **********/
+
+int save_tune(char *file_name, int *table)
+{
+	FILE *fp;
+	int   b;
+	int   ok;
+
+	if ((fp = fopen(file_name, "w")) == NULL)
+		return(0);
+
+	ok = (fprintf(fp, "%s\n", TUNE_MAGIC) > 0);
+	for (b = 0; b < TUNE_BUCKETS; b++)
+		ok = ok && fprintf(fp, "%d %s\n", 4 << b, (table[b] == SOLVER_CHOL ? "CHOL" : "DENSE")) > 0;
+
+	ok = (fclose(fp) == 0) && ok;
+
+	return(ok);
+}
+
+/**********
+ *
+ * times the two solvers of wqinvw * invy = add_disc for the largest
+ * mm of every bucket, on a positive definite matrix like wqinvw, and
+ * keeps the faster one.  Each solver is repeated until it has run for
+ * a few hundredths of a second.
+ *
+ **********/
+
+void tune_solvers(int *table)
+{
+	double *mat;
+	double *work;
+	double *rhs;
+	double *invy;
+	double  cost[2];
+	clock_t start, used;
+	long    reps, n;
+	int     b, s, i, j, mm;
+	size_t  size;
+
+	size = (size_t)sizeof(double);
+	mm   = 4 << (TUNE_BUCKETS - 1);
+	mat  = (double *)qm_malloc(size * (size_t)(mm * mm));
+	work = (double *)qm_malloc(size * (size_t)(mm * mm));
+	rhs  = (double *)qm_malloc(size * (size_t)(mm));
+	invy = (double *)qm_malloc(size * (size_t)(mm));
+
+	if (!(mat && work && rhs && invy))
+		send_out_of_mem();
+
+	for (b = 0; b < TUNE_BUCKETS; b++)
+	{
+		mm = 4 << b;
+		for (i = 0; i < mm; i++)
+		{
+			rhs[i] = 1.0 + i % 7;
+			for (j = 0; j < mm; j++)
+				mat[i*mm + j] = pow(0.5, (double)abs(i - j)) + (i == j);
+		}
+
+		for (s = SOLVER_DENSE; s <= SOLVER_CHOL; s++)
+		{
+			reps = 1;
+			do
+			{
+				start = clock();
+				for (n = 0; n < reps; n++)
+				{
+					memcpy(work, mat, size * (size_t)(mm * mm));
+					if (s == SOLVER_CHOL)
+						(void)solve_chol(work, rhs, invy, mm);
+					else
+						matmult(invy, cal_inv2(mm, work), rhs, mm, (int)1, mm);
+				}
+				used = clock() - start;
+				reps *= 2;
+			} while (used < CLOCKS_PER_SEC / 50);
+
+			cost[s] = (double)used / (double)(reps / 2);
+		}
+
+		table[b] = (cost[SOLVER_CHOL] < cost[SOLVER_DENSE]) ? SOLVER_CHOL : SOLVER_DENSE;
+	}
+
+	free(mat);
+	free(work);
+	free(rhs);
+	free(invy);
+}
+
+/**********
+ *
+ * solves wqinvw * invy = add_disc by Cholesky on a copy of wqinvw.
+ *
+ * returns 1 if o.k., 0 if wqinvw is not positive definite (or out of
+ * memory); wqinvw is unchanged and the dense inverse can be used.
+ *
+ **********/
+
+int solve_chol(double *wqinvw, double *add_disc, double *invy, int mm)
+{
+	double *l;
+	int     ok;
+	size_t  size;
+
+	size = (size_t)sizeof(double);
+	if ((l = (double *)qm_malloc(size * (size_t)(mm * mm))) == NULL)
+		return(0);
+
+	memcpy(l, wqinvw, size * (size_t)(mm * mm));
+
+	ok = chol_extend(l, mm, 0, mm);
+	if (ok)
+	{
+		memcpy(invy, add_disc, size * (size_t)mm);
+		chol_solve(l, mm, mm, invy);
+	}
+
+	free(l);
+
+	return(ok);
+}
+
+/**********
+ *
+ * returns the width of the fixed width kernel (wdot) to use for the
+ * benchmarks when all the windows have the same width and follow each
+ * other, as cal_tau_kappa gives them for a flow series; 0 for any other
+ * layout, which keeps vdot.  Windows of 3 and 4 are too short for the
+ * vector steps of vdot and always use wdot; windows of 12 use it only
+ * with the scalar kernels, the AVX2 and AVX-512 vdot being faster.
+ *
+ **********/
+
+int window_kernel(int *tau, int *kappa, int mm)
+{
+	int m, n;
+
+	if (mm <= 0)
+		return(0);
+
+	n = kappa[0] - tau[0] + 1;
+	for (m = 1; m < mm; m++)
+		if (kappa[m] - tau[m] + 1 != n || tau[m] != kappa[m-1] + 1)
+			return(0);
+
+	switch (n)
+	{
+		case 3:
+		case 4:
+			return(n);
+
+		case 12:
+			return(simd_init() == SIMD_SCALAR ? n : 0);
+	}
+
+	return(0);
+}
+
+
+/**********
+ * 
+ * void send_out_of_mem(void);
+ *
+ * Send error message nor enough memory
+ * The diagnostics of the job are sent first (flush_diagnostics) and
+ * the reports left are written (rep_close) before the exit.
+ *
+ **********/
+
+void send_out_of_mem(void)
+{
+	int  status;
+	char fame_cmd[BUFSIZ];
+
+	flush_diagnostics(NULL);
+	sprintf(fame_cmd, "signal continue : \"QUADMIN ERROR: The C program could not allocate enough memory for calculation \" +newline"); 
+	STAT_BEGIN(PH_CFMFAME);
+	cfmfame(&status, fame_cmd);
+	STAT_END(PH_CFMFAME);
+	rep_close();
+	exit(-1);
+} 
+
+
+
+/*
+C      PURPOSE:  CALCULATES THE PERCENTAGE CHANGE OF A SERIES
+C       ON THE BASIS OF EITHER PERIOD TO PERIOD OR PERIOD OVER THE
+C       SAME PERIOD OF THE PRECEEDING YEAR, DEPENDING UPON THE
+C       UNDERLYING SEASONALITY OF THE TIME SERIES DATA.  THE VALUE
+C       0.00005 HAS BEEN ARBITRARILY CHOSEN TO DENOTE DIVISION BY ZERO.
+*/
+
+void percent(int *nopts, int *lag, double *data, double *rslt)
+{
+	int j, l;
+	l = *lag;
+
+	for (j=0; j < *nopts; j++)
+	{
+		rslt[j]=0.0;
+	}
+
+	if (*lag < *nopts)
+	{
+		for (j=l; j< *nopts; j++)
+		{
+			if (fabs(data[j - *lag]) > 0.00005)
+			{
+				rslt[j]=((data[j]-data[j - *lag])/data[j - *lag])*100;
+			}
+		}
+	}
+}
+
+
+
+/*
+C       PURPOSE:  CALCULATES FIRST DIFFERENCES EITHER PERIOD TO PERIOD
+C       OR PERIOD OVER THE SAME PERIOD OF THE PRECEEDING YEAR, DEPENDING
+C       UPON THE SEASONALITY OF THE UNDERLYING TIME SERIES.
+C
+C
+C       IN THE EVENT THAT THE NUMBER OF OBSERVATIONS IS LESS
+C       THAN THE LAG THEN THE RESULT VECTOR WILL BE FILLED
+C       WITH ZERO VALUES.
+*/
+
+void firstdiff(int *nopts, int *lag, double *data, double *rslt)
+{
+	int l, i;
+
+	l=*lag;
+	for (i=0; i<*nopts; i++)
+	{
+		rslt[i]=0;
+	}
+
+	for (i=l; i< *nopts; i++)
+	{
+		rslt[i] = data[i] - data[i-*lag];
+	}
+}
+
+
+void read_print(FILE *out, int setnum, int langnum, int messnum, char **parm, int nb_parm, char * buf);
+const char *find_message(int setnum, int langnum, int messnum);
+int format_message(char *buf, size_t size, int setnum, int langnum, int messnum, char **parm, int nb_parm);
+const char *lookup_message(int setnum, int langnum, int messnum);
+
+extern int errno;
+
+
+
+/**********
+ *
+ * Message catalog
+ *
+ * messages[set][language][number] is the text of a message, NULL if
+ * there is none.  The language 0 is the default one (english), 1 is
+ * french and 2 russian; message_rows tells which languages a set has,
+ * the others get the default one.  The parameters of a message are
+ * written PARM and are put in by format_message.
+ *
+ **********/
+
+#define PARM      "\"!\""
+
+#define MESS_SETS   5
+#define MESS_LANGS  3
+#define MESS_NUMS   24
+
+const char message_rows[MESS_SETS][MESS_LANGS] =
+{
+	{NO,  NO,  NO },
+	{YES, YES, YES},
+	{NO,  NO,  NO },
+	{YES, NO,  NO },
+	{YES, YES, YES}
+};
+
+const char *const messages[MESS_SETS][MESS_LANGS][MESS_NUMS] =
+{
+	{{NULL}},	/* set 0 */
+	{	/* set 1 */
+		{	/* default, english */
+			NULL,
+			"ERROR 1: INVALID VALUE \"!\" FOR KEYWORD: \"!\"",
+			"ERROR 2: CONFLICT BETWEEN BENCHFREQ AND FREQ.",
+			"ERROR 3: SPECIFIED TIME SPAN NOT LONG ENOUGH.",
+			"ERROR 4: CONFLICT BETWEEN UPDATEFROM AND FROM OR TO DATES.",
+			"ERROR 5: DISTRIBUTORID AND TARGETID ARE NOT ALLOWED TO\nHAVE THE SAME NAME.  PLEASE RE-ENTER TARGETID.",
+			"ERROR 6: UNKNOWN KEYWORD=VALUE PAIR : \"!\" = \"!\".",
+			"ERROR 7: SPECIFIED FISCALLAG MUST BE SMALLER THAN FREQ.",
+			"ERROR 8: CANNOT HAVE MEAN=Y AND STOCK=Y AT THE SAME TIME.",
+			"ERROR 9: MISSING VALUE FOR KEYWORD: \"!\".",
+			"CANNOT MAKE SAME DISTRIBUTOR EQUAL TO TWO DIFFERENT BENCHMARKS. FIRST BENCHMARK IS LINK POINT VALUE. OTHER VALUE DROPPED.",
+			"IT IS LIKELY THAT A DISCONTINUITY IN MOVEMENT IS PRESENT BETWEEN THE ADJUSTED SERIES CALCULATED HERE AND THAT WHICH PRECEDES ON THE BASE. RECOMMENDED FROM DATE: \"!\".",
+			"IT IS LIKELY THAT THE BENCHMARK COVERING PERIOD \"!\" IS NOT SATISFIED BY THE ADJUSTED SERIES CALCULATED HERE. RECOMMENDED FROM DATE: \"!\".",
+			"IT IS LIKELY THAT A DISCONTINUITY IN MOVEMENT IS PRESENT BETWEEN THE UPDATED ADJUSTED SERIES CALCULATED HERE AND THAT WHICH PRECEDES ON THE BASE. RECOMMENDED UPDATEFROM DATE: \"!\".",
+			"IT IS LIKELY THAT THE BENCHMARK COVERING PERIOD \"!\" IS NOT SATISFIED BY THE UPDATED ADJUSTED SERIES CALCULATED HERE. RECOMMENDED UPDATEFROM DATE: \"!\".",
+			"TARGET SERIES HAS SOME NEGATIVE VALUES",
+			"DISTRIBUTOR SERIES HAS SOME VALUES SMALLER OR EQUAL TO 0",
+			"MISSING DATA AT THE END OF BENCHMARK SERIES. DISTRIBUTOR EXTRAPOLATED.",
+			"ERROR 10:   COULD NOT READ TARGET",
+			"ERROR 11:   COULD NOT READ DISTRIBUTOR PLEASE CHECK THE DATES AND THE FREQUENCY",
+			"ERROR 10:   COULD NOT READ BENCHMARK",
+			"ONLY ONE BENCHMARK USED"
+		},
+		{	/* french */
+			NULL,
+			"ERREUR 1: ARGUMENT INVALIDE \"!\" ASSOCIE AU MOT CLEF \"!\".",
+			"ERREUR 2: CONFLIT ENTRE BENCHFREQ ET FREQ.",
+			"ERREUR 3: DUREE SPECIFIEE EST TROP COURTE.",
+			"ERREUR 4: CONFLIT DE DATES ENTRE UPDATEFROM ET FROM OU TO.",
+			"ERREUR 5: DISTRIBUTORID ET TARGETID NE PEUVENT AVOIR LE MEME NOM. VEUILLEZ RE-ENTRER LA VALEUR ASSOCIEE AU MOT CLEF TARGETID.",
+			"ERREUR 6: COMMANDE INCONNUE \"!\" = \"!\".",
+			"ERREUR 7: L'ARGUMENT SPECIFIE POUR FISCALLAG DOIT ETRE PLUS PETIT QUE FREQ.",
+			"ERREUR 8: LA COMBINAISON D'OPTIONS: MEAN=Y ET STOCK=Y EST INVALIDE.",
+			"ERREUR 9: VALEUR MANQUANTE POUR LE MOT-CLEF: \"!\".",
+			"ERROR 10: LE MEME DISTRIBUTEUR NE PEUT ETRE EGAL A DEUX JALONS DIFFERENTS.",
+			"IL EST POSSIBLE QU'IL Y AIT DISCONTINUITE DE MOUVEMENT ENTRE LA SERIE CALCULEE ET CELLE QUI LA PRECEDE SUR LA BASE. DATE DE DEBUT (FROM) RECOMMANDEE: \"!\".",
+			"IL EST POSSIBLE QUE LE JALON COUVRANT LA PERIODE \"!\" NE SOIT PAS SATISFAIT. DATE DE DEBUT (FROM) RECOMMANDEE: \"!\".",
+			"IL EST POSSIBLE QU'IL Y AIT DISCONTINUITE DE MOUVEMENT ENTRE LA SERIE MISE A JOUR ET LES CHIFFRES QUI PRECEDENT SUR LA BASE. DATE DE MISE A JOUR (UPDATEFROM) RECOMMANDEE: \"!\".",
+			"IL EST POSSIBLE QUE LE JALON COUVRANT LA PERIODE \"!\" NE SOIT PAS SATISFAIT. DATE DE MISE A JOUR (UPDATEFROM) RECOMMANDEE: \"!\".",
+			"LA SERIE CIBLE A DES VALEURS NEGATIVES.",
+			"LA SERIE DISTRIBUTRICE A DES VALEURS PLUS PETITES OU EGALES A ZERO.",
+			"VALEURS MANQUANTES A LA FIN DE LA SERIE JALON. DISTRIBUTEUR EXTRAPOLE.",
+			"ERREUR 10:   LA SERIE CIBLE NE PEUT ETRE LUE",
+			"ERREUR 11:   LA SERIE DISTRIBUTRICE NE PEUT ETRE LUE VEUILLEZ VERIFIER LES DATE AINSI QUE LA FREQUENCE ",
+			"ERROR 10:   LA SERIE JALON NE PEUT ETRE LUE",
+			"SEULEMENT UNE VALEUR JALON UTILISEE."
+		},
+		{	/* russian */
+			NULL,
+			"ÎØÈÁÊÀ 1: ÍÅÄÎÏÓÑÒÈÌÎÅ ÇÍÀ×ÅÍÈÅ \"!\" ÄËß ÊËÞ×ÅÂÎÃÎ ÑËÎÂÀ: \"!\".",
+			"ERROR 2: ÍÅÑÎÎÒÂÅÒÑÒÂÈÅ ÌÅÆÄÓ BENCHFREQ È FREQ.",
+			"ERROR 3: ÇÀÄÀÍÍÛÉ ÂÐÅÌÅÍÍÎÉ ÄÈÀÏÀÇÎÍ ÍÅÄÎÑÒÀÒÎ×ÍÎ ÂÅËÈÊ.",
+			"ERROR 4: ÍÅÑÎÎÒÂÅÒÑÒÂÈÅ ÌÅÆÄÓ UPDATEFROM È ÄÀÒÀÌÈ FROM ÈËÈ TO.",
+			"ERROR 5: DISTRIBUTORID È TARGETID ÍÅ ÌÎÃÓÒ ÈÌÅÒÜ ÎÄÍÎ È ÒÎ ÆÅ ÈÌß.  ÏÎÆÀËÓÉÑÒÀ, ÏÎÂÒÎÐÈÒÅ ÂÂÎÄ TARGETID.",
+			"ERROR 6: ÍÅÏÀÑÏÎÇÍÀÍÍÀß ÏÀÐÀ KEYWORD=VALUE: \"!\" = \"!\".",
+			"ERROR 7: ÇÀÄÀÍÍÎÅ ÇÍÀ×ÅÍÈÅ FISCALLAG ÄÎËÆÍÎ ÁÛÒÜ ÌÅÍÜØÅ FREQ.",
+			"ERROR 8: ÍÅ ÄÎÏÓÑÊÀÅÒÑß ÎÄÍÎÂÐÅÌÅÍÍÎÅ ÇÀÄÀÍÈÅ MEAN=Y AND STOCK=Y.",
+			"ERROR 9: ÎÒÑÓÒÑÒÂÓÞÙÅÅ ÇÍÀ×ÅÍÈÅ ÄËß ÊËÞ×ÅÂÎÃÎ ÑËÎÂÀ: \"!\".",
+			"ÍÅÂÎÇÌÎÆÍÎ ÏÐÈÐÀÂÍßÒÜ ÎÄÈÍ È ÒÎÒ ÆÅ ÒÅÊÓÙÈÉ ÏÎÊÀÇÀÒÅËÜ ÄÂÓÌ ÐÀÇËÈ×ÍÛÌ ÊÎÍÒÐÎËÜÍÛÌ ÇÍÀ×ÅÍÈßÌ. ÏÅÐÂÎÅ ÈÇ ÍÈÕ ÈÑÏÎËÜÇÎÂÀÍÎ ÄËß ÓÂßÇÊÈ, ÂÒÎÐÎÅ ÏÐÎÈÃÍÎÐÈÐÎÂÀÍÎ.",
+			"ÅÑÒÜ ÂÅÐÎßÒÍÎÑÒÜ ÐÀÇÐÛÂÀ Â ÄÈÍÀÌÈÊÅ ÌÅÆÄÓ ÊÎÐÐÅÊÒÈÐÓÅÌÛÌ Â ÄÀÍÍÛÉ ÌÎÌÅÍÒ ÐßÄÎÌ È ÏÐÅÄÛÄÓÙÈÌ ÐßÄÎÌ Â ÁÀÇÅ. ÐÅÊÎÌÅÍÄÓÅÒÑß ÍÀ×ÀÒÜ Ñ ÄÀÒÛ: \"!\".",
+			"ÊÎÍÒÐÎËÜÍÛÉ ÏÎÊÀÇÀÒÅËÜ, ÎÕÂÀÒÛÂÀÞÙÈÉ ÏÅÐÈÎÄ \"!\" , ÂÅÐÎßÒÍÎ, ÍÅ ÑÎÃËÀÑÓÅÒÑß Ñ ÊÎÐÐÅÊÒÈÐÓÅÌÛÌ Â ÄÀÍÍÛÉ ÌÎÌÅÍÒ ÐßÄÎÌ. ÐÅÊÎÌÅÍÄÓÅÒÑß ÍÀ×ÀÒÜ Ñ ÄÀÒÛ: \"!\".",
+			"ÅÑÒÜ ÂÅÐÎßÒÍÎÑÒÜ ÐÀÇÐÛÂÀ Â ÄÈÍÀÌÈÊÅ ÌÅÆÄÓ ÊÎÐÐÅÊÒÈÐÓÅÌÛÌ Â ÄÀÍÍÛÉ ÌÎÌÅÍÒ ÐßÄÎÌ È ÏÐÅÄÛÄÓÙÈÌ ÐßÄÎÌ Â ÁÀÇÅ. ÐÅÊÎÌÅÍÄÓÅÒÑß UPDATEFROM ÍÀ×ÈÍÀß Ñ ÄÀÒÛ: \"!\".",
+			"ÊÎÍÒÐÎËÜÍÛÉ ÏÎÊÀÇÀÒÅËÜ, ÎÕÂÀÒÛÂÀÞÙÈÉ ÏÅÐÈÎÄ \"!\" , ÂÅÐÎßÒÍÎ, ÍÅ ÑÎÃËÀÑÓÅÒÑß Ñ ÊÎÐÐÅÊÒÈÐÓÅÌÛÌ Â ÄÀÍÍÛÉ ÌÎÌÅÍÒ ÐßÄÎÌ. ÐÅÊÎÌÅÍÄÓÅÒÑß UPDATEFROM ÍÀ×ÈÍÀß Ñ ÄÀÒÛ: \"!\".",
+			"Â ÖÅËÅÂÎÌ ÐßÄÅ ÏÐÈÑÓÒÑÒÂÓÞÒ ÎÒÐÈÖÀÒÅËÜÍÛÅ ÇÍÀ×ÅÍÈß",
+			"ÐßÄ ÒÅÊÓÙÈÕ ÏÎÊÀÇÀÒÅËÅÉ ÑÎÄÅÐÆÈÒ ÍÓËÅÂÛÅ È/ÈËÈ ÎÒÐÈÖÀÒÅËÜÍÛÅ ÇÍÀ×ÅÍÈß",
+			"ÎÒÑÓÒÑÒÂÓÞÙÈÅ ÄÀÍÍÛÅ Â ÊÎÍÖÅ ÊÎÍÒÐÎËÜÍÎÃÎ ÐßÄÀ. ÐßÄ ÒÅÊÓÙÈÕ ÏÎÊÀÇÀÒÅËÅÉ ÝÊÑÒÐÀÏÎËÈÐÎÂÀÍ.",
+			"ERROR 10:   ÍÅÂÎÇÌÎÆÍÎ ÏÐÎ×ÈÒÀÒÜ ÖÅËÅÂÎÉ ÏÎÊÀÇÀÒÅËÜ",
+			"ERROR 11:   ÍÅÂÎÇÌÎÆÍÎ ÏÐÎ×ÈÒÀÒÜ ÒÅÊÓÙÈÉ ÏÎÊÀÇÀÒÅËÜ. ÏÎÆÀËÓÉÑÒÀ, ÏÐÎÂÅÐÜÒÅ ÄÀÒÛ È ÏÅÐÈÎÄÈ×ÍÎÑÒÜ",
+			"ERROR 10:   ÍÅÂÎÇÌÎÆÍÎ ÏÐÎ×ÈÒÀÒÜ ÊÎÍÒÐÎËÜÍÛÉ ÏÎÊÀÇÀÒÅËÜ",
+			"ÈÑÏÎËÜÇÎÂÀÍ ÒÎËÜÊÎ ÎÄÈÍ ÊÎÍÒÐÎËÜÍÛÉ ÏÎÊÀÇÀÒÅËÜ"
+		}
+	},
+	{{NULL}},	/* set 2 */
+	{	/* set 3 */
+		{	/* default, english */
+			NULL,
+			"BENCHFREQ=  1,4                                      1\nFREQ     =  4,12                                     4\nFROM     =  YY, YYQQ or YYMM                         NONE\nTO       =  YY, YYQQ or YYMM                         NONE\nFISCALLAG=  -FREQ < FISCALLAG < FREQ                 0\n",
+			"LINKED    = Y-YES, N-NO                              N\nROUND     = Y-YES, N-NO                              N\nDECS      = 0, 1, 2, 3, 4, 5                         1\nPROP      = Y-YES, N-NO      PROPORTIONAL ADJUST.    Y\nFIRST     = Y-YES, N-NO      FIRST DIFF   ADJUST.    Y\nUPDATE    = Y-YES, N-NO                              N\nUPDATEFROM= YY, YYQQ, YYMM                           FROM date\nMEAN      = Y-YES, N-NO      INDEX SERIES            N\nSTOCK     = Y-YES, N-NO      STOCK SERIES            N\n",
+			"ARATES =    Y-YES, N-NO                              N\nDIFF   =    Y-YES, N-NO      FIRST DIFFERENCES       N\nFACT   =    Y-YES, N-NO      ADJUSTMENT FACTORS      N\nGR     =    Y-YES, N-NO      GROWTH RATE             N\nLAG    =    1,FREQ                                   1 OR FREQ\n",
+			"BENCHID       = VALID SERIES NAME                    NONE\nDISTRIBUTORID = VALID SERIES NAME                    NONE\nTARGETID      = VALID SERIES NAME                    NONE\n"
+		}
+	},
+	{	/* set 4 */
+		{	/* default, english */
+			NULL,
+			"CONTROL INFORMATION\n\nKEYWORDS    VALUES                                   DEFAULT",
+			"QUADRATIC MINIMIZATION ALGORITHM\n\nKEYWORDS    VALUES                                   DEFAULT",
+			"REPORTS\n\nKEYWORDS    VALUES                                   DEFAULT",
+			"SERIES IDENTIFICATORS",
+			"ENTER \"KEYWORD=VALUE,....\", \"CONTROL\" OR \"E\" TO EXIT PROGRAM",
+			"UNADJUSTED SERIES: \"!\"\n\n                TOTAL               I            II           III            IV",
+			"BENCHMARK ADJUSTMENT USING QUADRATIC MINIMIZATION TECHNIQUE VERSION: 28 NOV. 90\n\n\n",
+			"FISCAL PERIOD REPORT:\n\nPERIOD                  VALUES FOR THE SERIES               DISCREPANCIES\n                       ADJUSTED      UNADJUSTED   PROPORTIONAL   AND   ADDITIVE",
+			"ADJUSTED SERIES: \"!\"\n\n                TOTAL               I            II           III            IV",
+			"ADJUSTMENT FACTORS:\n\n                                    I            II           III            IV",
+			"FIRST DIFFERENCES OF",
+			"PERCENTAGE CHANGES OF",
+			"i INDICATES AN INCOMPLETE PERIOD TOTAL.",
+			"i INDICATES AN INCOMPLETE PERIOD TOTAL.\nb INDICATES THAT NO BENCHMARK COVERS THIS PERIOD.",
+			"**** CURRENT SETTINGS ****",
+			"CALENDAR PERIOD REPORT:\n\nPERIOD                  VALUES FOR THE SERIES               DISCREPANCIES\n                       ADJUSTED      UNADJUSTED   PROPORTIONAL   AND   ADDITIVE",
+			"RUN NUMBER: \"!\"",
+			"UNADJUSTED SERIES: \"!\"\n\n                                    I            II           III            IV",
+			"ADJUSTED SERIES: \"!\"\n\n                                    I            II           III            IV",
+			"REVISION STUDY OF \"!\" BY CUTOFF DATE:\n",
+			"REVISIONS WITH RESPECT TO THE LAST CUTOFF:\n",
+			"COMPARISON OF THE VARIANTS FOR \"!\":\n",
+			" VARIANT       RMS GROWTH  MAX GROWTH DIFF     FACTOR MIN     FACTOR MAX"
+		},
+		{	/* french */
+			NULL,
+			"ENTREZ LES INFORMATIONS SUR LES SERIES\n\nMOT CLEF    VALEURS                                  VALEURS DE DEFAULT",
+			"ENTREZ LES OPTIONS DE L'ALGORITHME\n\nMOT CLEF    VALEURS                                  VALEURS DE DEFAULT",
+			"CHOISISSEZ LES RAPPORTS\n\nMOT CLEF    VALEURS                                  VALEURS DE DEFAULT",
+			"ENTREZ LE NOM DES SERIES A TRAITER",
+			"ENTREZ \"MOT-CLE=VALEUR,....\" OU \"E\" POUR TERMINER",
+			"SERIE NON AJUSTEE: \"!\"\n\n                TOTAL               I            II           III            IV",
+			"AJUSTEMENT DE JALONS UTILISANT LA TECHNIQUE DE MINIMISATION QUADRATIQUE: VERSION DU 28 NOV 90\n\n\n",
+			"RAPPORT RELATIF AUX PERIODES FISCALES:\n\nPERIODE           VALEURS CORRESPONDANTES DES                  ECARTS\n                SERIES  AJUSTEE     NON-AJUSTEE  PROPORTIONNELS   ET     ADDITIF",
+			"SERIE AJUSTEE: \"!\"\n\n                TOTAL               I            II           III            IV",
+			"FACTEUR D'AJUSTEMENTS:\n\n                                    I            II           III            IV",
+			"PREMIERES DIFFERENCES DE LA",
+			"FACTEUR DE CROISSANCE DE LA",
+			"i INDIQUE UNE PERIODE INCOMPLETE.",
+			"i INDIQUE UNE PERIODE INCOMPLETE.\nb INDIQUE QU'IL N'Y A PAS DE JALON COUVRANT LA PERIODE.",
+			"**** OPTIONS COURANTES ****",
+			"RAPPORT RELATIF AUX PERIODES CIVILES:\n\nPERIODE           VALEURS CORRESPONDANTES DES                  ECARTS\n                SERIES  AJUSTEE     NON-AJUSTEE  PROPORTIONNELS   ET     ADDITIF",
+			"SEQUENCE NUMERO: \"!\"",
+			"SERIE NON AJUSTEE: \"!\"\n\n                                    I            II           III            IV",
+			"SERIE AJUSTEE: \"!\"\n\n                                    I            II           III            IV",
+			"ETUDE DES REVISIONS DE \"!\" PAR DATE DE FIN:\n",
+			"REVISIONS PAR RAPPORT A LA DERNIERE DATE DE FIN:\n",
+			"COMPARAISON DES VARIANTES POUR \"!\":\n",
+			" VARIANTE      E.T. TAUX   ECART MAX TAUX    FACTEUR MIN    FACTEUR MAX"
+		},
+		{	/* russian */
+			NULL,
+			"ÓÏÐÀÂËßÞÙÀß ÈÍÔÎÐÌÀÖÈß\n\nÊËÞ×ÅÂÛÅ ÑËÎÂÀ    ÇÍÀ×ÅÍÈß                                   ÏÎ ÓÌÎË×ÀÍÈÞ",
+			"ÀËÃÎÐÈÒÌ ÊÂÀÄÐÀÒÍÎÉ ÌÈÍÈÌÈÇÀÖÈÈ\n\nÊËÞ×ÅÂÛÅ ÑËÎÂÀ    ÇÍÀ×ÅÍÈß                                   ÏÎ ÓÌÎË×ÀÍÈÞ",
+			"ÎÒ×ÅÒÛ\n\nÊËÞ×ÅÂÛÅ ÑËÎÂÀ    ÇÍÀ×ÅÍÈß                                   ÏÎ ÓÌÎË×ÀÍÈÞ",
+			"ÈÄÅÍÒÈÔÈÊÀÒÎÐÛ ÐßÄÎÂ",
+			"ÂÂÅÄÈÒÅ \"KEYWORD=VALUE,....\", \"CONTROL\" ÈËÈ \"E\" ÄËß ÂÛÕÎÄÀ ÈÇ ÏÐÎÃÐÀÌÌÛ",
+			"ÍÅÑÊÎÐÐÅÊÒÈÐÎÂÀÍÍÛÉ ÐßÄ: \"!\"\n\n                ÂÑÅÃÎ               I            II           III            IV",
+			"ÓÂßÇÛÂÀÍÈÅ ÌÅÒÎÄÎÌ ÊÂÀÄÐÀÒÍÎÉ ÌÈÍÈÌÈÇÀÖÈÈ ÂÅÐÑÈß: 28 ÍÎßÁÐß 1990\n\n\n",
+			"ÎÒ×ÅÒ ÇÀ ÔÈÍÀÍÑÎÂÛÉ ÏÅÐÈÎÄ:\n\nÏÅÐÈÎÄ                  ÇÍÀ×ÅÍÈß ÐßÄÎÂ               ÐÀÑÕÎÆÄÅÍÈß\n                       ÑÊÎÐÐÅÊÒÈÐ. ÍÅÑÊÎÐÐ.   ÏÐÎÏÎÐÖÈÎÍÀËÜÍÛÅ   È   ÀÄÄÈÒÈÂÍÛÅ",
+			"ÑÊÎÐÐÅÊÒÈÐÎÂÀÍÍÛÉ ÐßÄ: \"!\"\n\n                ÂÑÅÃÎ               I            II           III            IV",
+			"ÊÎÝÔÔÈÖÈÅÍÒÛ ÏÎÏÐÀÂÎÊ:\n\n                                    I            II           III            IV",
+			"ÐÀÑÕÎÆÄÅÍÈÅ ÏÅÐÂÎÃÎ ÏÎÐßÄÊÀ  ",
+			"ÏÐÎÖÅÍÒÍÛÅ ÈÇÌÅÍÅÍÈß",
+			"i ÑÂÈÄÅÒÅËÜÑÒÂÓÅÒ Î ÍÅÏÎËÍÎÌ ÈÒÎÃÎÂÎÌ ÏÎÊÀÇÀÒÅËÅ ÇÀ ÏÅÐÈÎÄ.",
+			"i ÑÂÈÄÅÒÅËÜÑÒÂÓÅÒ Î ÍÅÏÎËÍÎÌ ÈÒÎÃÎÂÎÌ ÏÎÊÀÇÀÒÅËÅ ÇÀ ÏÅÐÈÎÄ.\nb ÓÊÀÇÛÂÀÅÒ, ×ÒÎ ÄËß ÄÀÍÍÎÃÎ ÏÅÐÈÎÄÀ ÎÒÑÓÒÑÒÂÓÅÒ ÊÎÍÒÐÎËÜÍÛÉ ÏÎÊÀÇÀÒÅËÜ.",
+			"**** ÒÅÊÓÙÈÅ ÓÑÒÀÍÎÂÊÈ ****",
+			"ÎÒ×ÅÒ ÇÀ ÊÀËÅÍÄÀÐÍÛÉ ÏÅÐÈÎÄ:\n\nÏÅÐÈÎÄ                  ÇÍÀ×ÅÍÈß ÐßÄÎÂ               ÐÀÑÕÎÆÄÅÍÈß\n                       ÑÊÎÐÐÅÊÒÈÐ. ÍÅÑÊÎÐÐ.   ÏÐÎÏÎÐÖÈÎÍÀËÜÍÛÅ   È   ÀÄÄÈÒÈÂÍÛÅ",
+			"ÍÎÌÅÐ ÈÒÅÐÀÖÈÈ: \"!\"",
+			"ÍÅÑÊÎÐÐÅÊÒÈÐÎÂÀÍÍÛÉ ÐßÄ: \"!\"\n\n                                    I            II           III            IV",
+			"ÑÊÎÐÐÅÊÒÈÐÎÂÀÍÍÛÉ ÐßÄ: \"!\"\n\n                                    I            II           III            IV"
+		}
+	}
+};
+
+
+
+/**********
+ *
+ * void read_print(FILE *out, int setnum, int langnum,
+ *                 int messnum, char **parm, int nb_parm, char * buf);
+ *
+ * 1- read a message from the message file
+ * 2- if needed, replace parameters in the message
+ * 3- print the resulting string to the specied output file
+ *
+ * buf must hold BUFSIZ characters.
+ *
+ **********/
+
+void read_print(FILE *out, int setnum, int langnum, int messnum, char **parm, int nb_parm, char * buf)
+{
+	format_message(buf, BUFSIZ, setnum, langnum, messnum, parm, nb_parm);
+
+	fprintf(out, "%s\n", buf); /* newline added by R Puchyr 2003-03-12 */
+}
+
+
+
+/**********
+ *
+ * const char *find_message(int setnum, int langnum, int messnum)
+ *
+ * returns the text of a message in the catalog, NULL if there is none.
+ *
+ **********/
+
+const char *find_message(int setnum, int langnum, int messnum)
+{
+	int l;
+
+	if (setnum < 0 || setnum >= MESS_SETS || !message_rows[setnum][0])
+		return(NULL);
+
+	if (messnum < 0 || messnum >= MESS_NUMS)
+		return(NULL);
+
+	l = (langnum > 0 && langnum < MESS_LANGS && message_rows[setnum][langnum]) ? langnum : 0;
+
+	return(messages[setnum][l][messnum]);
+}
+
+
+
+/**********
+ *
+ * int format_message(char *buf, size_t size, int setnum, int langnum,
+ *                    int messnum, char **parm, int nb_parm)
+ *
+ * writes a message in buf, of size characters with the ending null,
+ * its nb_parm first PARM replaced by the tokens of parm.  The message
+ * is cut if it is too long.  The function only writes to buf, so it
+ * can be used by several threads.
+ *
+ * returns the length of the message written.
+ *
+ **********/
+
+int format_message(char *buf, size_t size, int setnum, int langnum, int messnum, char **parm, int nb_parm)
+{
+	const char *text;
+	const char *tok;
+	size_t len;
+	int nbfound;
+	int n;
+
+	if (size == 0)
+		return(0);
+
+	if ((text = find_message(setnum, langnum, messnum)) == NULL)
+	{
+		if (setnum < 0 || setnum >= MESS_SETS || !message_rows[setnum][0])
+			n = snprintf(buf, size, "No messages for set s%d", setnum);
+		else
+			n = snprintf(buf, size, "No message for number s%dm%d", setnum, messnum);
+
+		return((n < 0 || (size_t)n < size) ? n : (int)size - 1);
+	}
+
+	len = 0;
+	nbfound = 0;
+	while (*text && len + 1 < size)
+	{
+		if (nbfound < nb_parm && strncmp(text, PARM, sizeof(PARM) - 1) == 0)
+		{
+			for (tok = parm[nbfound++]; *tok && len + 1 < size; tok++)
+				buf[len++] = *tok;
+			text += sizeof(PARM) - 1;
+		}
+		else
+			buf[len++] = *text++;
+	}
+	buf[len] = '\0';
+
+	return((int)len);
+}
+
+
+
+/**********
+ *
+ * const char *lookup_message(int setnum, int langnum, int messnum)
+ *
+ * returns the text of a message without its parameters.  The text of
+ * a message that is not in the catalog is made in a static buffer.
+ *
+ **********/
+
+const char *lookup_message(int setnum, int langnum, int messnum)
+{
+	static char ret[64];
+	const char *text;
+
+	if ((text = find_message(setnum, langnum, messnum)) != NULL)
+		return(text);
+
+	format_message(ret, sizeof(ret), setnum, langnum, messnum, NULL, 0);
+
+	return(ret);
+}
+
+
+
+void print_default(double *dist, double *trget, char from[], int freq,
+	int benchfreq, int nbpoints, int ndecs, int div, char stock, char *prnt);
+void print_fisc(double *dist, double *trget, int *tau, int *kappa, int nbpoints,
+	int nbbench, int ndecs, int freq, int benchfreq, char from[],
+	int div, char stock, char *prnt);
+void cal_print(double distsum, double trgetsum, char *format,
+	char date[], int ndecs, int freq, int dateinc);
+double sumf(double *in, int nb);
+void printem(int ndecs, double trgets, double dists, double fac, double dif);
+void prnt_data(char start[], int nbpoints, int freq, int nbdecs,
+	double *series, char arates, char printsum);
+void rep_write(const char *s, size_t n);
+void rep_puts(const char *s);
+void rep_printf(const char *format, ...);
+void rep_fixed(double value, int width, int ndec);
+void rep_flush(void);
+void rep_close(void);
+void rep_drain(void);
+int rep_start(void);
+void rep_record(char *kind, char *from, char *to, char *flag, int ndecs, double dist, double trget, double fac, double dif, double *gr);
+void rep_field(double value, int ndec);
+
+extern void add_date(char *date, int freq, int val);
+extern void output_text(void);
+extern FILE *tables;
+extern FILE *text_file;
+extern int report_format;
+extern char *report_kind;
+extern char *report_series;
+
+
+
+
+/**********
+ *
+ * void print_default(double *dist, double *trget, char from[], int freq,
+ *                    int benchfreq, int nbpoints, int ndecs, int div)
+ *
+ * Routine to print the default report.
+ * It's done in three parts
+ * - Print the total of the first incomplete year or quarter.
+ * - Print the totals of complete years or quarters
+ * - Print the remaining year or quarter
+ *
+ * The div parameter is used to represent by which number we should divide
+ * the sum of target.  We need to do this when the mean=y option has
+ * been choosen, because all the resulting numbers have been multiplied
+ * by the frequency.  We need to divide by the frequency to produce
+ * result.  When mean=n then the div parameter will be one.
+ *
+ * Only numbers are printed in this routine.  Titles and legend are
+ * printed by the calling function (print_report).
+ *
+ **********/
+
+void print_default(double *dist, double *trget, char from[], int freq,
+	int benchfreq, int nbpoints, int ndecs, int div, char stock, char *prnt)
+{
+	double distsum;
+	double trgetsum;
+	char date[7];
+	int year;
+	int per;
+	int nbcal;
+	int dateinc;
+	int inc;
+	int lap;
+	int stockinc;
+
+	*prnt = NO;
+	dateinc = 0;
+	stockinc = 0;
+	strcpy(date, from);
+	lap = 0;
+	nbcal = 0;
+
+	if (benchfreq == 1)
+		inc = (freq == 12 ? 12 : 4);
+	else
+		inc = 3;
+
+	per = atoi(from+4);
+	year = (atoi(from) - per) / 100;
+	lap = (freq - per + 1) % inc;
+
+	if (stock)
+	{
+		if (lap)
+			add_date(date, freq, lap-1);
+		else
+			add_date(date, freq, inc-1);
+	}
 
-				default:
-					switch (messnum)
-					{
-						case  1:
-							strcpy(ret, "ERROR 1: INVALID VALUE \"!\" FOR KEYWORD: \"!\"");
-							break;
+	/**********
+	* first incomplete period.
+	**********/
+	if (lap)
+	{
+		if (stock)
+			stockinc = lap - 1;
+		else
+			dateinc = lap - 1;
+
+		distsum = sumf(&dist[nbcal+stockinc], lap-stockinc) / div;
+		trgetsum = sumf(&trget[nbcal+stockinc], lap-stockinc) / div;
+		cal_print(distsum, trgetsum, " %s - %s  i", date, ndecs, freq, dateinc);
+		nbcal = lap;
+
+		if (stock)
+			add_date(date, freq, inc);
+		else
+			add_date(date, freq, lap);
+
+		*prnt = YES;
+	}
+
+	/**********
+	* complete periods.
+	**********/
+	if (stock)
+		stockinc = inc - 1;
+	else
+		dateinc = inc - 1;
+
+	while (nbcal + inc <= nbpoints)
+	{
+		distsum = sumf(&dist[nbcal+stockinc], inc-stockinc) / div;
+		trgetsum = sumf(&trget[nbcal+stockinc], inc-stockinc) / div;
+		cal_print(distsum, trgetsum, " %s - %s   ", date, ndecs, freq, dateinc);
+		nbcal += inc;
+		add_date(date, freq, inc);
+	}
+
+	/**********
+	* last incomplete period.
+	**********/
+	if (nbcal < nbpoints  && !stock)
+	{
+		inc = nbpoints - nbcal;
+		dateinc = inc - 1;
+		distsum = sumf(&dist[nbcal], inc) / div;
+		trgetsum = sumf(&trget[nbcal], inc) / div;
+		cal_print(distsum, trgetsum, " %s - %s  i", date, ndecs, freq, dateinc);
+		nbcal += inc;
+		*prnt = YES;
+	}
+}
+
+
+
+/**********
+ *
+ * void print_fisc(double *dist, double *trget, int *tau, int *kappa, int nbpoints
+ *	int nbbench, int ndecs, int freq, int benchfreq, char from[],
+ *	int div, char stock)
+ *
+ * Routine to print the fiscal report.
+ * It's done in five parts
+ * - Print the total of the first incomplete year or quarter.
+ * - Print totals of periods for which there is no benchmarks
+ * - Print the totals of complete years or quarters
+ * - Print totals of periods for witch there is no benchmarks
+ * - Print the remaining year or quarter
+ *
+ * Only numbers are printed in this routine.  Titles and legend are
+ * printed by the calling function (print_report).
+ * Tau and Kappa are the reference period of the benchmark over the
+ * distributor.  Tau is start and kappa is end.
+ *
+ **********/
+
+void print_fisc(double *dist, double *trget, int *tau, int *kappa, int nbpoints,
+	int nbbench, int ndecs, int freq, int benchfreq, char from[],
+	int div, char stock, char *prnt)
+{
+	double distsum;
+	double trgetsum;
+	char date[7];
+	int start;
+	int i, stockinc;
+	int inc, dateinc;
+	int nbcal;
+	int lap;
+	int nbref;
+
+	*prnt = NO;
+	dateinc = 0;
+	strcpy(date, from);
+	lap = 0;
+	nbcal = 0;
+
+	if (benchfreq == 1)
+		inc = (freq == 12 ? 12 : 4);
+	else
+		inc = 3;
+
+	lap = (tau[0] - 1) % inc;
+
+	if (lap && !stock)
+	{
+		dateinc = lap - 1;
+		distsum = sumf(&dist[0], lap) / div;
+		trgetsum = sumf(&trget[0], lap) / div;
+		cal_print(distsum, trgetsum, " %s - %s bi", date, ndecs, freq, dateinc);
+		*prnt = YES;
+	}
+
+	add_date(date, freq, lap);
+
+	if (!stock)
+		dateinc = inc - 1;
+
+	while (lap < tau[0] - 1)
+	{
+		stockinc = 0;
+		if (stock)
+			stockinc = inc - 1;
+
+		distsum = sumf(&dist[lap], inc-stockinc) / div;
+		trgetsum = sumf(&trget[lap], inc-stockinc) / div;
+		cal_print(distsum, trgetsum, " %s - %s b ", date, ndecs, freq, dateinc);
+		lap += inc;
+		add_date(date, freq, inc);
+		*prnt = YES;
+	}
+
+	for (i = 0; i < nbbench; i++)
+	{
+		start = tau[i] - 1;
+		nbref = kappa[i] - start;
+		distsum = sumf(&dist[start], nbref) / div;
+		trgetsum = sumf(&trget[start], nbref) / div;
+		cal_print(distsum, trgetsum, " %s - %s   ", date, ndecs, freq, dateinc);
+		add_date(date, freq, inc);
+	}
+
+	lap = kappa[nbbench - 1];
+
+	while (lap + inc <= nbpoints)
+	{
+		distsum = sumf(&dist[lap], inc) / div;
+		trgetsum = sumf(&trget[lap], inc) / div;
+		cal_print(distsum, trgetsum, " %s - %s b ", date, ndecs, freq, dateinc);
+		lap += inc;
+		add_date(date, freq, inc);
+		*prnt = YES;
+	}
+
+
+	if (lap < nbpoints && !stock)
+	{
+		inc = nbpoints - lap;
+		dateinc = inc - 1;
+		distsum = sumf(&dist[lap], inc) / div;
+		trgetsum = sumf(&trget[lap], inc) / div;
+		cal_print(distsum, trgetsum, " %s - %s bi", date, ndecs, freq, dateinc);
+		*prnt = YES;
+	}
+
+	if (stock)
+	{
+		lap = kappa[nbbench-1] + inc;
+		if (lap < nbpoints)
+		{
+			distsum = dist[lap-1] / div;
+			trgetsum = trget[lap-1] / div;
+			cal_print(distsum, trgetsum, " %s - %s b ", date, ndecs, freq, dateinc);
+			*prnt = YES;
+		}
+	}
+}
+
+
+
+/**********
+ *
+ * void cal_print(double distsum, double trgetsum, char *format,
+ *	char date[], int ndecs, int freq, int dateinc)
+ *
+ * calculates adjustment factor, adjusted differences and prints
+ * the numbers, or their record when the report is not text.
+ *
+ **********/
+
+void cal_print(double distsum, double trgetsum, char *format,
+	char date[], int ndecs, int freq, int dateinc)
+{
+	double adj_fac, adj_dif;
+	char date2[7];
+
+	strcpy(date2, date);
+	add_date(date2, freq, dateinc);
+
+	if (trgetsum && distsum)
+		adj_fac = trgetsum / distsum;
+	else
+		adj_fac = 0;
 
-						case  2:
-							strcpy(ret, "ERROR 2: CONFLICT BETWEEN BENCHFREQ AND FREQ.");
-							break;
+	adj_dif = trgetsum - distsum;
 
-						case  3:
-							strcpy(ret, "ERROR 3: SPECIFIED TIME SPAN NOT LONG ENOUGH.");
-							break;
+	if (report_format != REPORT_TEXT)
+	{
+		rep_record(report_kind, date, date2, &format[strlen(format) - 2], ndecs, distsum, trgetsum, adj_fac, adj_dif, NULL);
+		return;
+	}
 
-						case  4:
-							strcpy(ret, "ERROR 4: CONFLICT BETWEEN UPDATEFROM AND FROM OR TO DATES.");
-							break;
+	rep_printf(format, date, date2);
+	printem(ndecs, trgetsum, distsum, adj_fac, adj_dif);
+}
 
-						case  5:
-							strcpy(ret, "ERROR 5: DISTRIBUTORID AND TARGETID ARE NOT ALLOWED TO\nHAVE THE SAME NAME.  PLEASE RE-ENTER TARGETID.");
-							break;
 
-						case  6:
-							strcpy(ret, "ERROR 6: UNKNOWN KEYWORD=VALUE PAIR : \"!\" = \"!\".");
-							break;
 
-						case  7:
-							strcpy(ret, "ERROR 7: SPECIFIED FISCALLAG MUST BE SMALLER THAN FREQ.");
-							break;
+/**********
+ *
+ * double sumf(double *in, int nb)
+ *
+ * sums up the value of an array of doubles.
+ * the result is put into a double for greater accuracy.
+ *
+ **********/
 
-						case  8:
-							strcpy(ret, "ERROR 8: CANNOT HAVE MEAN=Y AND STOCK=Y AT THE SAME TIME.");
-							break;
+double sumf(double *in, int nb)
+{
+	double total;
+	int   i;
 
-						case  9:
-							strcpy(ret, "ERROR 9: MISSING VALUE FOR KEYWORD: \"!\".");
-							break;
+	total = 0.0;
+	for (i = 0; i < nb; i++)
+		total += in[i];
 
-						case 10:
-							strcpy(ret, "CANNOT MAKE SAME DISTRIBUTOR EQUAL TO TWO DIFFERENT BENCHMARKS. FIRST BENCHMARK IS LINK POINT VALUE. OTHER VALUE DROPPED.");
-							break;
+	return(total);
+}
 
-						case 11:
-							strcpy(ret, "IT IS LIKELY THAT A DISCONTINUITY IN MOVEMENT IS PRESENT BETWEEN THE ADJUSTED SERIES CALCULATED HERE AND THAT WHICH PRECEDES ON THE BASE. RECOMMENDED FROM DATE: \"!\".");
-							break;
 
-						case 12:
-							strcpy(ret, "IT IS LIKELY THAT THE BENCHMARK COVERING PERIOD \"!\" IS NOT SATISFIED BY THE ADJUSTED SERIES CALCULATED HERE. RECOMMENDED FROM DATE: \"!\".");
-							break;
 
-						case 13:
-							strcpy(ret, "IT IS LIKELY THAT A DISCONTINUITY IN MOVEMENT IS PRESENT BETWEEN THE UPDATED ADJUSTED SERIES CALCULATED HERE AND THAT WHICH PRECEDES ON THE BASE. RECOMMENDED UPDATEFROM DATE: \"!\".");
-							break;
+/**********
+ *
+ * void printem(int ndecs, double trgets, double dists, double fac, double dif)
+ *
+ * print four doubles on a line.
+ *
+ **********/
 
-						case 14:
-							strcpy(ret, "IT IS LIKELY THAT THE BENCHMARK COVERING PERIOD \"!\" IS NOT SATISFIED BY THE UPDATED ADJUSTED SERIES CALCULATED HERE. RECOMMENDED UPDATEFROM DATE: \"!\".");
-							break;
+void printem(int ndecs, double trgets, double dists, double fac, double dif)
+{
+	rep_fixed(trgets, 16, ndecs);
+	rep_fixed(dists, 16, ndecs);
+	rep_fixed(fac, 15, 4);
+	rep_fixed(dif, 17, 4);
+	rep_puts("\n");
+}
 
-						case 15:
-							strcpy(ret, "TARGET SERIES HAS SOME NEGATIVE VALUES");
-							break;
 
-						case 16:
-							strcpy(ret, "DISTRIBUTOR SERIES HAS SOME VALUES SMALLER OR EQUAL TO 0");
-							break;
 
-						case 17:
-							strcpy(ret, "MISSING DATA AT THE END OF BENCHMARK SERIES. DISTRIBUTOR EXTRAPOLATED.");
-							break;
+/**********
+ *
+ * void rep_record(char *kind, char *from, char *to, char *flag, int ndecs,
+ *                 double dist, double trget, double fac, double dif,
+ *                 double *gr)
+ *
+ * prints a record of report_series in report_format.  The flag is
+ * the one of the text report without its blanks.  The growth rates
+ * of the distributor and of the target are in gr, NULL if none.  The
+ * numbers go through rep_field.
+ *
+ **********/
 
-						case 18:
-							strcpy(ret, "ERROR 10:   COULD NOT READ TARGET");
-							break;
+void rep_record(char *kind, char *from, char *to, char *flag, int ndecs, double dist, double trget, double fac, double dif, double *gr)
+{
+	char flg[4];
+	int i, n;
 
-						case 19:
-							strcpy(ret, "ERROR 11:   COULD NOT READ DISTRIBUTOR PLEASE CHECK THE DATES AND THE FREQUENCY");
-							break;
+	for (i = 0, n = 0; flag[i] && n < 3; i++)
+		if (flag[i] != ' ')
+			flg[n++] = flag[i];
+	flg[n] = '\0';
 
-						case 20:
-							strcpy(ret, "ERROR 10:   COULD NOT READ BENCHMARK");
-							break;
+	if (report_format == REPORT_CSV)
+	{
+		rep_printf("%s,%s,%s,%s,%s,", report_series, kind, from, to, flg);
+		rep_field(dist, ndecs);
+		rep_puts(",");
+		rep_field(trget, ndecs);
+		rep_puts(",");
+		rep_field(fac, 6);
+		rep_puts(",");
+		rep_field(dif, ndecs);
+		rep_puts(",");
+		if (gr)
+		{
+			rep_field(gr[0], 6);
+			rep_puts(",");
+			rep_field(gr[1], 6);
+		}
+		else
+			rep_puts(",");
+		rep_puts("\n");
+		return;
+	}
 
-						case 21:
-							strcpy(ret, "ONLY ONE BENCHMARK USED");
-							break;
+	rep_printf("{\"series\":\"%s\",\"kind\":\"%s\",\"from\":\"%s\",\"to\":\"%s\",\"flag\":\"%s\",\"dist\":",
+			   report_series, kind, from, to, flg);
+	rep_field(dist, ndecs);
+	rep_puts(",\"trget\":");
+	rep_field(trget, ndecs);
+	rep_puts(",\"factor\":");
+	rep_field(fac, 6);
+	rep_puts(",\"difference\":");
+	rep_field(dif, ndecs);
+	if (gr)
+	{
+		rep_puts(",\"dist_growth\":");
+		rep_field(gr[0], 6);
+		rep_puts(",\"trget_growth\":");
+		rep_field(gr[1], 6);
+	}
+	rep_puts("}\n");
+}
 
-						default:
-							sprintf(ret, "No message for number s%dm%d", setnum, messnum);
-							break;
 
-					}
 
-					break;
-			}
+/**********
+ *
+ * void rep_field(double value, int ndec)
+ *
+ * appends a number of a record with ndec decimals.  A value that is
+ * not finite (the factor of a zero distributor, a NaN of
+ * QUADMIN_MISSING=NAN) gives an empty field in CSV and null in JSON
+ * Lines.
+ *
+ **********/
 
-			break;
+void rep_field(double value, int ndec)
+{
+	if (value - value == 0)
+		rep_fixed(value, 0, ndec);
+	else if (report_format == REPORT_JSONL)
+		rep_puts("null");
+}
 
-		case 3:
-			switch (langnum)
-			{
-				default:
-					switch (messnum)
-					{
-						case  1:
-							strcpy(ret, "BENCHFREQ=  1,4                                      1\nFREQ     =  4,12                                     4\nFROM     =  YY, YYQQ or YYMM                         NONE\nTO       =  YY, YYQQ or YYMM                         NONE\nFISCALLAG=  -FREQ < FISCALLAG < FREQ                 0\n");
-							break;
 
-						case  2:
-							strcpy(ret, "LINKED    = Y-YES, N-NO                              N\nROUND     = Y-YES, N-NO                              N\nDECS      = 0, 1, 2, 3, 4, 5                         1\nPROP      = Y-YES, N-NO      PROPORTIONAL ADJUST.    Y\nFIRST     = Y-YES, N-NO      FIRST DIFF   ADJUST.    Y\nUPDATE    = Y-YES, N-NO                              N\nUPDATEFROM= YY, YYQQ, YYMM                           FROM date\nMEAN      = Y-YES, N-NO      INDEX SERIES            N\nSTOCK     = Y-YES, N-NO      STOCK SERIES            N\n");
-							break;
 
-						case  3:
-							strcpy(ret, "ARATES =    Y-YES, N-NO                              N\nDIFF   =    Y-YES, N-NO      FIRST DIFFERENCES       N\nFACT   =    Y-YES, N-NO      ADJUSTMENT FACTORS      N\nGR     =    Y-YES, N-NO      GROWTH RATE             N\nLAG    =    1,FREQ                                   1 OR FREQ\n");
-							break;
+/**********
+ *
+ * void prnt_data(char start[], int nbpoints, int freq, int nbdecs,
+ *                double *series, char arates, char printsum);
+ *
+ * This procedure prints a series on a line by line format.
+ * It can print a series any frequency (1,4,12).
+ * It prints the series with the numbers of decimals passed in
+ * parameter.  The parameter start gives the start date of which the
+ * series represent. The parameters nbpoints gives the number of
+ * datapoints to be printed.
+ *
+ **********/
 
-						case  4:
-							strcpy(ret, "BENCHID       = VALID SERIES NAME                    NONE\nDISTRIBUTORID = VALID SERIES NAME                    NONE\nTARGETID      = VALID SERIES NAME                    NONE\n");
-							break;
+void prnt_data(char start[], int nbpoints, int freq, int nbdecs,
+	double *series, char arates, char printsum)
+{
+	int per;
+	int year;
+	int num;
+	int num1;
+	int i;
+	int j;
+	int mult;
 
-						default:
-							sprintf(ret, "No message for number s%dm%d", setnum, messnum);
-							break;
-					}
+	mult = (arates ? freq : 1);
+	per = atoi(start+4);
+	year = (atoi(start) - per) / 100;
+	num = 0;
 
-					break;
+	switch (freq)
+	{
+		case 1:
+			for (i = 0; i < nbpoints; i++)
+			{
+				rep_printf(" %4.4d", year++);
+				rep_fixed(series[num++], 16, nbdecs);
+				rep_puts("\n");
 			}
 
 			break;
 
 		case 4:
-			switch (langnum)
-			{
-				case 1:
-					switch (messnum)
-					{
-						case  1:
-							strcpy(ret, "ENTREZ LES INFORMATIONS SUR LES SERIES\n\nMOT CLEF    VALEURS                                  VALEURS DE DEFAULT");
-							break;
-
-						case  2:
-							strcpy(ret, "ENTREZ LES OPTIONS DE L'ALGORITHME\n\nMOT CLEF    VALEURS                                  VALEURS DE DEFAULT");
-							break;
-
-						case  3:
-							strcpy(ret, "CHOISISSEZ LES RAPPORTS\n\nMOT CLEF    VALEURS                                  VALEURS DE DEFAULT");
-							break;
-
-						case  4:
-							strcpy(ret, "ENTREZ LE NOM DES SERIES A TRAITER");
-							break;
-
-						case  5:
-							strcpy(ret, "ENTREZ \"MOT-CLE=VALEUR,....\" OU \"E\" POUR TERMINER");
-							break;
+			/**********
+			* first incomplete period
+			**********/
 
-						case  6:
-							strcpy(ret, "SERIE NON AJUSTEE: \"!\"\n\n                TOTAL               I            II           III            IV");
-							break;
+			if (per != 1)
+			{
+				rep_printf("\n %4.4d%16s  ", year++, " ");
 
-						case  7:
-							strcpy(ret, "AJUSTEMENT DE JALONS UTILISANT LA TECHNIQUE DE MINIMISATION QUADRATIQUE: VERSION DU 28 NOV 90\n\n\n");
-							break;
+				for (i = 0; i < 4; i++)
+				{
+					if (i < per -1 || num >= nbpoints)
+						rep_printf("%14s", "-"); 
+					else
+						rep_fixed(series[num++]*(double)mult, 14, nbdecs);
+				}
 
-						case  8:
-							strcpy(ret, "RAPPORT RELATIF AUX PERIODES FISCALES:\n\nPERIODE           VALEURS CORRESPONDANTES DES                  ECARTS\n                SERIES  AJUSTEE     NON-AJUSTEE  PROPORTIONNELS   ET     ADDITIF");
-							break;
+				rep_puts("\n");
+			}
 
-						case  9:
-							strcpy(ret, "SERIE AJUSTEE: \"!\"\n\n                TOTAL               I            II           III            IV");
-							break;
+			/**********
+			* complete periods
+			**********/
 
-						case 10:
-							strcpy(ret, "FACTEUR D'AJUSTEMENTS:\n\n                                    I            II           III            IV");
-							break;
+			while (num + 4 <= nbpoints)
+			{
+				rep_printf("\n %4.4d", year++);
 
-						case 11:
-							strcpy(ret, "PREMIERES DIFFERENCES DE LA");
-							break;
+				if (printsum)
+				{
+					rep_fixed(sumf(&series[num],4), 16, nbdecs);
+					rep_puts("  ");
+				}
+				else
+					rep_printf("%16s  ", " ");
 
-						case 12:
-							strcpy(ret, "FACTEUR DE CROISSANCE DE LA");
-							break;
+				for (i = 0; i < 4; i ++)
+					rep_fixed(series[num++]*(double)mult, 14, nbdecs);
 
-						case 13:
-							strcpy(ret, "i INDIQUE UNE PERIODE INCOMPLETE.");
-							break;
+				rep_puts("\n");
+			}
 
-						case 14:
-							strcpy(ret, "i INDIQUE UNE PERIODE INCOMPLETE.\nb INDIQUE QU'IL N'Y A PAS DE JALON COUVRANT LA PERIODE.");
-							break;
+			/**********
+			* last incomplete period
+			**********/
 
-						case 15:
-							strcpy(ret, "**** OPTIONS COURANTES ****");
-							break;
+			if (num < nbpoints)
+			{
+				rep_printf("\n %4.4d%16s  ", year++, " ");
+				for (i = 0; i < 4; i++)
+				{
+					if (num < nbpoints)
+						rep_fixed(series[num++]*(double)mult, 14, nbdecs);
+					else
+						rep_printf("%14s", "-");
+				}
 
-						case 16:
-							strcpy(ret, "RAPPORT RELATIF AUX PERIODES CIVILES:\n\nPERIODE           VALEURS CORRESPONDANTES DES                  ECARTS\n                SERIES  AJUSTEE     NON-AJUSTEE  PROPORTIONNELS   ET     ADDITIF");
-							break;
+				rep_puts("\n");
+			}
 
-						case 17:
-							strcpy(ret, "SEQUENCE NUMERO: \"!\"");
-							break;
+			break;
 
-						case 18:
-							strcpy(ret, "SERIE NON AJUSTEE: \"!\"\n\n                                    I            II           III            IV");
-							break;
+		case 12:
+			/**********
+			* first incomplete period
+			**********/
 
-						case 19:
-							strcpy(ret, "SERIE AJUSTEE: \"!\"\n\n                                    I            II           III            IV");
-							break;
+			if (per != 1)
+			{
+				rep_printf("\n %4.4d%16s  ", year++, " ");
 
-						default:
-							sprintf(ret, "No message for number s%dm%d", setnum, messnum);
-							break;
-					}
+				for (i = 0; i < 3; i++)
+				{
+					num1 = i;
 
-					break;
+					if (i != 0)
+						rep_printf(" %4s%16s  ", " ", " ");
 
-				case 2:
-					switch (messnum)
+					for (j = 0; j < 4; j++)
 					{
-						case  1:
-							strcpy(ret, "ÓÏÐÀÂËßÞÙÀß ÈÍÔÎÐÌÀÖÈß\n\nÊËÞ×ÅÂÛÅ ÑËÎÂÀ    ÇÍÀ×ÅÍÈß                                   ÏÎ ÓÌÎË×ÀÍÈÞ");
-							break;
-
-						case  2:
-							strcpy(ret, "ÀËÃÎÐÈÒÌ ÊÂÀÄÐÀÒÍÎÉ ÌÈÍÈÌÈÇÀÖÈÈ\n\nÊËÞ×ÅÂÛÅ ÑËÎÂÀ    ÇÍÀ×ÅÍÈß                                   ÏÎ ÓÌÎË×ÀÍÈÞ");
-							break;
-
-						case  3:
-							strcpy(ret, "ÎÒ×ÅÒÛ\n\nÊËÞ×ÅÂÛÅ ÑËÎÂÀ    ÇÍÀ×ÅÍÈß                                   ÏÎ ÓÌÎË×ÀÍÈÞ");
-							break;
-
-						case  4:
-							strcpy(ret, "ÈÄÅÍÒÈÔÈÊÀÒÎÐÛ ÐßÄÎÂ");
-							break;
+						if (num1 < per - 1 || num1 - per + 2 > nbpoints)
+							rep_printf("%14s", "-");
+						else
+						{
+							rep_fixed(series[num1 - per + 1]*(double)mult, 14, nbdecs);
+							num++;
+						}
 
-						case  5:
-							strcpy(ret, "ÂÂÅÄÈÒÅ \"KEYWORD=VALUE,....\", \"CONTROL\" ÈËÈ \"E\" ÄËß ÂÛÕÎÄÀ ÈÇ ÏÐÎÃÐÀÌÌÛ");
-							break;
+						num1 += 3;
+					}
 
-						case  6:
-							strcpy(ret, "ÍÅÑÊÎÐÐÅÊÒÈÐÎÂÀÍÍÛÉ ÐßÄ: \"!\"\n\n                ÂÑÅÃÎ               I            II           III            IV");
-							break;
+					rep_puts("\n");
+				}
+			}
 
-						case  7:
-							strcpy(ret, "ÓÂßÇÛÂÀÍÈÅ ÌÅÒÎÄÎÌ ÊÂÀÄÐÀÒÍÎÉ ÌÈÍÈÌÈÇÀÖÈÈ ÂÅÐÑÈß: 28 ÍÎßÁÐß 1990\n\n\n");
-							break;
+			/**********
+			* complete periods
+			**********/
 
-						case  8:
-							strcpy(ret, "ÎÒ×ÅÒ ÇÀ ÔÈÍÀÍÑÎÂÛÉ ÏÅÐÈÎÄ:\n\nÏÅÐÈÎÄ                  ÇÍÀ×ÅÍÈß ÐßÄÎÂ               ÐÀÑÕÎÆÄÅÍÈß\n                       ÑÊÎÐÐÅÊÒÈÐ. ÍÅÑÊÎÐÐ.   ÏÐÎÏÎÐÖÈÎÍÀËÜÍÛÅ   È   ÀÄÄÈÒÈÂÍÛÅ");
-							break;
+			while (num + 12 <= nbpoints)
+			{
+				rep_printf("\n %4.4d", year++);
 
-						case  9:
-							strcpy(ret, "ÑÊÎÐÐÅÊÒÈÐÎÂÀÍÍÛÉ ÐßÄ: \"!\"\n\n                ÂÑÅÃÎ               I            II           III            IV");
-							break;
+				if (printsum)
+				{
+					rep_fixed(sumf(&series[num],12), 16, nbdecs);
+					rep_puts("  ");
+				}
+				else
+					rep_printf("%16s  ", " ");
 
-						case 10:
-							strcpy(ret, "ÊÎÝÔÔÈÖÈÅÍÒÛ ÏÎÏÐÀÂÎÊ:\n\n                                    I            II           III            IV");
-							break;
+				for (i = 0; i < 3; i++)
+				{
+					if (i != 0)
+						rep_printf(" %4s%16s  ", " ", " ");
 
-						case 11:
-							strcpy(ret, "ÐÀÑÕÎÆÄÅÍÈÅ ÏÅÐÂÎÃÎ ÏÎÐßÄÊÀ  ");
-							break;
+					num1 = i;
 
-						case 12:
-							strcpy(ret, "ÏÐÎÖÅÍÒÍÛÅ ÈÇÌÅÍÅÍÈß");
-							break;
+					for (j = 0; j < 4; j++)
+					{
+						rep_fixed(series[num+num1]*(double)mult, 14, nbdecs);
+						num1 += 3;
+					}
 
-						case 13:
-							strcpy(ret, "i ÑÂÈÄÅÒÅËÜÑÒÂÓÅÒ Î ÍÅÏÎËÍÎÌ ÈÒÎÃÎÂÎÌ ÏÎÊÀÇÀÒÅËÅ ÇÀ ÏÅÐÈÎÄ.");
-							break;
+					rep_puts("\n");
+				}
 
-						case 14:
-							strcpy(ret, "i ÑÂÈÄÅÒÅËÜÑÒÂÓÅÒ Î ÍÅÏÎËÍÎÌ ÈÒÎÃÎÂÎÌ ÏÎÊÀÇÀÒÅËÅ ÇÀ ÏÅÐÈÎÄ.\nb ÓÊÀÇÛÂÀÅÒ, ×ÒÎ ÄËß ÄÀÍÍÎÃÎ ÏÅÐÈÎÄÀ ÎÒÑÓÒÑÒÂÓÅÒ ÊÎÍÒÐÎËÜÍÛÉ ÏÎÊÀÇÀÒÅËÜ.");
-							break;
+				num += 12;
+			}
 
-						case 15:
-							strcpy(ret, "**** ÒÅÊÓÙÈÅ ÓÑÒÀÍÎÂÊÈ ****");
-							break;
+			/**********
+			* last incomplete period
+			**********/
 
-						case 16:
-							strcpy(ret, "ÎÒ×ÅÒ ÇÀ ÊÀËÅÍÄÀÐÍÛÉ ÏÅÐÈÎÄ:\n\nÏÅÐÈÎÄ                  ÇÍÀ×ÅÍÈß ÐßÄÎÂ               ÐÀÑÕÎÆÄÅÍÈß\n                       ÑÊÎÐÐÅÊÒÈÐ. ÍÅÑÊÎÐÐ.   ÏÐÎÏÎÐÖÈÎÍÀËÜÍÛÅ   È   ÀÄÄÈÒÈÂÍÛÅ");
-							break;
+			if (num < nbpoints)
+			{
+				rep_printf("\n %4.4d%16s  ", year++, " ");
 
-						case 17:
-							strcpy(ret, "ÍÎÌÅÐ ÈÒÅÐÀÖÈÈ: \"!\"");
-							break;
+				for (i = 0; i < 3; i++)
+				{
+					num1 = i;
 
-						case 18:
-							strcpy(ret, "ÍÅÑÊÎÐÐÅÊÒÈÐÎÂÀÍÍÛÉ ÐßÄ: \"!\"\n\n                                    I            II           III            IV");
-							break;
+					if (i != 0)
+						rep_printf(" %4s%16s  ", " ", " ");
 
-						case 19:
-							strcpy(ret, "ÑÊÎÐÐÅÊÒÈÐÎÂÀÍÍÛÉ ÐßÄ: \"!\"\n\n                                    I            II           III            IV");
-							break;
+					for (j = 0; j < 4; j++)
+					{
+						if (num + num1 < nbpoints)
+							rep_fixed(series[num + num1]*(double)mult, 14, nbdecs);
+						else
+							rep_printf("%14s", "-");
 
-						default:
-							sprintf(ret, "No message for number s%dm%d", setnum, messnum);
-							break;
+						num1 += 3;
 					}
 
-					break;
+					rep_puts("\n");
+				}
+			}
 
-				default:
-					switch (messnum)
-					{
-						case  1:
-							strcpy(ret, "CONTROL INFORMATION\n\nKEYWORDS    VALUES                                   DEFAULT");
-							break; 
+			break;
+	}
+}
 
-						case  2:
-							strcpy(ret, "QUADRATIC MINIMIZATION ALGORITHM\n\nKEYWORDS    VALUES                                   DEFAULT");
-							break; 
 
-						case  3:
-							strcpy(ret, "REPORTS\n\nKEYWORDS    VALUES                                   DEFAULT");
-							break; 
+/**********
+ *
+ * Report sink
+ *
+ * The reports of a job are formatted in one buffer (rep_puts,
+ * rep_printf, rep_fixed) instead of a fprintf per number.  rep_flush
+ * hands the buffer of the job to a writer thread that appends the
+ * buffers to their files in job order, so the next job is computed
+ * while the reports are written.  The reports to stdout are written
+ * at once, in order with the messages of the procedure.  If the
+ * thread cannot be started the buffers are written by rep_flush.
+ * rep_close waits for the writer before the end of the program.  When
+ * a buffer cannot be allocated, rep_write waits for the writer
+ * (rep_drain) and writes the text itself.
+ *
+ **********/
 
-						case  4:
-							strcpy(ret, "SERIES IDENTIFICATORS");
-							break; 
+#define REPORT_CHUNK 65536
 
-						case  5:
-							strcpy(ret, "ENTER \"KEYWORD=VALUE,....\", \"CONTROL\" OR \"E\" TO EXIT PROGRAM");
-							break; 
+struct s_report
+{
+	char   *buf;
+	size_t  len;
+	size_t  cap;
+	FILE   *out;
+	struct s_report *next;
+};
 
-						case  6:
-							strcpy(ret, "UNADJUSTED SERIES: \"!\"\n\n                TOTAL               I            II           III            IV");
-							break; 
+#ifdef _WIN32
+#define REP_LOCK()      EnterCriticalSection(&report_lock)
+#define REP_UNLOCK()    LeaveCriticalSection(&report_lock)
+#define REP_WAIT()      SleepConditionVariableCS(&report_cond, &report_lock, INFINITE)
+#define REP_SIGNAL()    WakeConditionVariable(&report_cond)
+#define REP_WAIT_DONE() SleepConditionVariableCS(&report_done, &report_lock, INFINITE)
+#define REP_DONE()      WakeAllConditionVariable(&report_done)
+CRITICAL_SECTION report_lock;
+CONDITION_VARIABLE report_cond;
+CONDITION_VARIABLE report_done;
+HANDLE report_thread;
+#else
+#define REP_LOCK()      pthread_mutex_lock(&report_lock)
+#define REP_UNLOCK()    pthread_mutex_unlock(&report_lock)
+#define REP_WAIT()      pthread_cond_wait(&report_cond, &report_lock)
+#define REP_SIGNAL()    pthread_cond_signal(&report_cond)
+#define REP_WAIT_DONE() pthread_cond_wait(&report_done, &report_lock)
+#define REP_DONE()      pthread_cond_broadcast(&report_done)
+pthread_mutex_t report_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t report_cond = PTHREAD_COND_INITIALIZER;
+pthread_cond_t report_done = PTHREAD_COND_INITIALIZER;
+pthread_t report_thread;
+#endif
+
+struct s_report *report_cur = NULL;     /* report of the job being formatted */
+struct s_report *report_head = NULL;    /* reports waiting for the writer */
+struct s_report *report_tail = NULL;
+int report_writer = 0;                  /* 0 not started, 1 running, -1 none */
+int report_stop = 0;
+int report_busy = 0;                    /* the writer is writing a report */
 
-						case  7:
-							strcpy(ret, "BENCHMARK ADJUSTMENT USING QUADRATIC MINIMIZATION TECHNIQUE VERSION: 28 NOV. 90\n\n\n");
-							break; 
 
-						case  8:
-							strcpy(ret, "FISCAL PERIOD REPORT:\n\nPERIOD                  VALUES FOR THE SERIES               DISCREPANCIES\n                       ADJUSTED      UNADJUSTED   PROPORTIONAL   AND   ADDITIVE");
-							break; 
 
-						case  9:
-							strcpy(ret, "ADJUSTED SERIES: \"!\"\n\n                TOTAL               I            II           III            IV");
-							break; 
+/**********
+ *
+ * void rep_write(const char *s, size_t n)
+ *
+ * appends n characters to the report of the job.  Text written to a
+ * file marks it for output_header.
+ *
+ **********/
 
-						case 10:
-							strcpy(ret, "ADJUSTMENT FACTORS:\n\n                                    I            II           III            IV");
-							break; 
+void rep_write(const char *s, size_t n)
+{
+	struct s_report *r;
+	char *buf;
+	size_t cap;
 
-						case 11:
-							strcpy(ret, "FIRST DIFFERENCES OF");
-							break; 
+	if (report_format == REPORT_TEXT && tables != text_file)
+		output_text();
 
-						case 12:
-							strcpy(ret, "PERCENTAGE CHANGES OF");
-							break; 
+	if (tables == stdout)
+	{
+		fwrite(s, 1, n, tables);
+		return;
+	}
 
-						case 13:
-							strcpy(ret, "i INDICATES AN INCOMPLETE PERIOD TOTAL.");
-							break; 
+	r = report_cur;
+	if (r == NULL || r->out != tables)
+	{
+		rep_flush();
+		if ((r = (struct s_report *)malloc(sizeof(struct s_report))) == NULL)
+		{
+			rep_drain();
+			fwrite(s, 1, n, tables);
+			return;
+		}
+		r->buf = NULL;
+		r->len = 0;
+		r->cap = 0;
+		r->out = tables;
+		r->next = NULL;
+		report_cur = r;
+	}
 
-						case 14:
-							strcpy(ret, "i INDICATES AN INCOMPLETE PERIOD TOTAL.\nb INDICATES THAT NO BENCHMARK COVERS THIS PERIOD.");
-							break; 
+	if (r->len + n > r->cap)
+	{
+		cap = (r->cap > 0) ? 2 * r->cap : REPORT_CHUNK;
+		while (cap < r->len + n)
+			cap *= 2;
 
-						case 15:
-							strcpy(ret, "**** CURRENT SETTINGS ****");
-							break; 
+		if ((buf = (char *)realloc(r->buf, cap)) == NULL)
+		{
+			rep_flush();
+			rep_drain();
+			fwrite(s, 1, n, tables);
+			return;
+		}
+		r->buf = buf;
+		r->cap = cap;
+	}
 
-						case 16:
-							strcpy(ret, "CALENDAR PERIOD REPORT:\n\nPERIOD                  VALUES FOR THE SERIES               DISCREPANCIES\n                       ADJUSTED      UNADJUSTED   PROPORTIONAL   AND   ADDITIVE");
-							break; 
+	memcpy(&r->buf[r->len], s, n);
+	r->len += n;
+}
 
-						case 17:
-							strcpy(ret, "RUN NUMBER: \"!\"");
-							break; 
 
-						case 18:
-							strcpy(ret, "UNADJUSTED SERIES: \"!\"\n\n                                    I            II           III            IV");
-							break; 
 
-						case 19:
-							strcpy(ret, "ADJUSTED SERIES: \"!\"\n\n                                    I            II           III            IV");
-							break; 
+/**********
+ *
+ * void rep_puts(const char *s)
+ *
+ * appends a string to the report of the job.
+ *
+ **********/
 
-						default:
-							sprintf(ret, "No message for number s%dm%d", setnum, messnum);
-							break;
-					}
+void rep_puts(const char *s)
+{
+	rep_write(s, strlen(s));
+}
 
-					break;
-			}
 
-			break;
 
-		default:
-			sprintf(ret, "No messages for set s%d", setnum);
-			break;
+/**********
+ *
+ * void rep_printf(const char *format, ...)
+ *
+ * fprintf to the report of the job.
+ *
+ **********/
 
-	}
+void rep_printf(const char *format, ...)
+{
+	va_list ap;
+	char line[BUFSIZ];
+	char *big;
+	int n;
 
-	return(ret);
-}
+	va_start(ap, format);
+	n = vsnprintf(line, sizeof(line), format, ap);
+	va_end(ap);
 
+	if (n < 0)
+		return;
 
+	if (n < (int)sizeof(line))
+	{
+		rep_write(line, n);
+		return;
+	}
 
-void print_default(double *dist, double *trget, char from[], int freq,
-	int benchfreq, int nbpoints, int ndecs, int div, char stock, char *prnt);
-void print_fisc(double *dist, double *trget, int *tau, int *kappa, int nbpoints,
-	int nbbench, int ndecs, int freq, int benchfreq, char from[],
-	int div, char stock, char *prnt);
-void cal_print(double distsum, double trgetsum, char *format,
-	char date[], int ndecs, int freq, int dateinc);
-double sumf(double *in, int nb);
-void printem(int ndecs, double trgets, double dists, double fac, double dif);
-void prnt_data(char start[], int nbpoints, int freq, int nbdecs,
-	double *series, char arates, char printsum);
+	if ((big = (char *)malloc(n + 1)) == NULL)
+		return;
 
-extern void add_date(char *date, int freq, int val);
-extern FILE *tables;
+	va_start(ap, format);
+	vsnprintf(big, n + 1, format, ap);
+	va_end(ap);
 
+	rep_write(big, n);
+	free(big);
+}
 
 
 
 /**********
  *
- * void print_default(double *dist, double *trget, char from[], int freq,
- *                    int benchfreq, int nbpoints, int ndecs, int div)
- *
- * Routine to print the default report.
- * It's done in three parts
- * - Print the total of the first incomplete year or quarter.
- * - Print the totals of complete years or quarters
- * - Print the remaining year or quarter
- *
- * The div parameter is used to represent by which number we should divide
- * the sum of target.  We need to do this when the mean=y option has
- * been choosen, because all the resulting numbers have been multiplied
- * by the frequency.  We need to divide by the frequency to produce
- * result.  When mean=n then the div parameter will be one.
+ * void rep_fixed(double value, int width, int ndec)
  *
- * Only numbers are printed in this routine.  Titles and legend are
- * printed by the calling function (print_report).
+ * appends value as "%width.ndecf" would.  The digits are those of the
+ * value times 10**ndec rounded to an integer, which is exact as long
+ * as that product is far enough from a half: the values too large,
+ * not finite or too close to a half for the product to decide go
+ * through rep_printf.
  *
  **********/
 
-void print_default(double *dist, double *trget, char from[], int freq,
-	int benchfreq, int nbpoints, int ndecs, int div, char stock, char *prnt)
-{
-	double distsum;
-	double trgetsum;
-	char date[7];
-	int year;
-	int per;
-	int nbcal;
-	int dateinc;
-	int inc;
-	int lap;
-	int stockinc;
-
-	*prnt = NO;
-	dateinc = 0;
-	stockinc = 0;
-	strcpy(date, from);
-	lap = 0;
-	nbcal = 0;
-
-	if (benchfreq == 1)
-		inc = (freq == 12 ? 12 : 4);
-	else
-		inc = 3;
-
-	per = atoi(from+4);
-	year = (atoi(from) - per) / 100;
-	lap = (freq - per + 1) % inc;
+void rep_fixed(double value, int width, int ndec)
+{
+	static const double scale[10] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9};
+	char field[64];
+	char digits[32];
+	double x, r, f;
+	long long units;
+	int nbdig, pos, neg;
+	int i;
 
-	if (stock)
+	if (ndec < 0 || ndec > 9 || width > 40 || !(fabs(value) < 1e15))
 	{
-		if (lap)
-			add_date(date, freq, lap-1);
-		else
-			add_date(date, freq, inc-1);
+		rep_printf("%*.*f", width, ndec, value);
+		return;
 	}
 
-	/**********
-	* first incomplete period.
-	**********/
-	if (lap)
-	{
-		if (stock)
-			stockinc = lap - 1;
-		else
-			dateinc = lap - 1;
+	x = fabs(value) * scale[ndec];
+	r = floor(x);
+	f = x - r;
 
-		distsum = sumf(&dist[nbcal+stockinc], lap-stockinc) / div;
-		trgetsum = sumf(&trget[nbcal+stockinc], lap-stockinc) / div;
-		cal_print(distsum, trgetsum, " %s - %s  i", date, ndecs, freq, dateinc);
-		nbcal = lap;
+	if (x >= 4503599627370496.0 || fabs(f - 0.5) <= x * 2.3e-16)
+	{
+		rep_printf("%*.*f", width, ndec, value);
+		return;
+	}
 
-		if (stock)
-			add_date(date, freq, inc);
-		else
-			add_date(date, freq, lap);
+	if (f > 0.5)
+		r += 1;
 
-		*prnt = YES;
-	}
+	neg = (value < 0 || (value == 0 && 1.0 / value < 0));
 
 	/**********
-	* complete periods.
+	* digits from the last one, at least one before the point
 	**********/
-	if (stock)
-		stockinc = inc - 1;
-	else
-		dateinc = inc - 1;
 
-	while (nbcal + inc <= nbpoints)
+	units = (long long)r;
+	nbdig = 0;
+	do
 	{
-		distsum = sumf(&dist[nbcal+stockinc], inc-stockinc) / div;
-		trgetsum = sumf(&trget[nbcal+stockinc], inc-stockinc) / div;
-		cal_print(distsum, trgetsum, " %s - %s   ", date, ndecs, freq, dateinc);
-		nbcal += inc;
-		add_date(date, freq, inc);
-	}
-
-	/**********
-	* last incomplete period.
-	**********/
-	if (nbcal < nbpoints  && !stock)
+		digits[nbdig++] = (char)('0' + units % 10);
+		units /= 10;
+	} while (units > 0 || nbdig <= ndec);
+
+	pos = nbdig + (ndec > 0) + neg;
+	for (i = 0; i < width - pos; i++)
+		field[i] = ' ';
+	pos = i;
+
+	if (neg)
+		field[pos++] = '-';
+	for (i = nbdig - 1; i >= 0; i--)
 	{
-		inc = nbpoints - nbcal;
-		dateinc = inc - 1;
-		distsum = sumf(&dist[nbcal], inc) / div;
-		trgetsum = sumf(&trget[nbcal], inc) / div;
-		cal_print(distsum, trgetsum, " %s - %s  i", date, ndecs, freq, dateinc);
-		nbcal += inc;
-		*prnt = YES;
+		field[pos++] = digits[i];
+		if (i == ndec && ndec > 0)
+			field[pos++] = '.';
 	}
+
+	rep_write(field, pos);
 }
 
 
 
 /**********
  *
- * void print_fisc(double *dist, double *trget, int *tau, int *kappa, int nbpoints
- *	int nbbench, int ndecs, int freq, int benchfreq, char from[],
- *	int div, char stock)
- *
- * Routine to print the fiscal report.
- * It's done in five parts
- * - Print the total of the first incomplete year or quarter.
- * - Print totals of periods for which there is no benchmarks
- * - Print the totals of complete years or quarters
- * - Print totals of periods for witch there is no benchmarks
- * - Print the remaining year or quarter
+ * void *rep_writer(void *arg)
  *
- * Only numbers are printed in this routine.  Titles and legend are
- * printed by the calling function (print_report).
- * Tau and Kappa are the reference period of the benchmark over the
- * distributor.  Tau is start and kappa is end.
+ * writer thread: writes the reports in the order they were flushed
+ * until rep_close.
  *
  **********/
 
-void print_fisc(double *dist, double *trget, int *tau, int *kappa, int nbpoints,
-	int nbbench, int ndecs, int freq, int benchfreq, char from[],
-	int div, char stock, char *prnt)
+#ifdef _WIN32
+DWORD WINAPI rep_writer(LPVOID arg)
+#else
+void *rep_writer(void *arg)
+#endif
 {
-	double distsum;
-	double trgetsum;
-	char date[7];
-	int start;
-	int i, stockinc;
-	int inc, dateinc;
-	int nbcal;
-	int lap;
-	int nbref;
+	struct s_report *r;
+	double start;
 
-	*prnt = NO;
-	dateinc = 0;
-	strcpy(date, from);
-	lap = 0;
-	nbcal = 0;
+	(void)arg;
 
-	if (benchfreq == 1)
-		inc = (freq == 12 ? 12 : 4);
-	else
-		inc = 3;
+	for (;;)
+	{
+		REP_LOCK();
+		while (report_head == NULL && !report_stop)
+			REP_WAIT();
 
-	lap = (tau[0] - 1) % inc;
+		r = report_head;
+		if (r != NULL)
+		{
+			report_head = r->next;
+			if (report_head == NULL)
+				report_tail = NULL;
+			report_busy = 1;
+		}
+		REP_UNLOCK();
 
-	if (lap && !stock)
-	{
-		dateinc = lap - 1;
-		distsum = sumf(&dist[0], lap) / div;
-		trgetsum = sumf(&trget[0], lap) / div;
-		cal_print(distsum, trgetsum, " %s - %s bi", date, ndecs, freq, dateinc);
-		*prnt = YES;
+		if (r == NULL)
+			break;
+
+		start = (trace_file != NULL) ? stat_clock() : 0.0;
+		fwrite(r->buf, 1, r->len, r->out);
+		fflush(r->out);
+		if (trace_file != NULL)
+			trace_span("write report", NULL, start, stat_clock(), TRACE_WRITER);
+		free(r->buf);
+		free(r);
+
+		REP_LOCK();
+		report_busy = 0;
+		REP_DONE();
+		REP_UNLOCK();
 	}
 
-	add_date(date, freq, lap);
+	return(0);
+}
 
-	if (!stock)
-		dateinc = inc - 1;
 
-	while (lap < tau[0] - 1)
-	{
-		stockinc = 0;
-		if (stock)
-			stockinc = inc - 1;
 
-		distsum = sumf(&dist[lap], inc-stockinc) / div;
-		trgetsum = sumf(&trget[lap], inc-stockinc) / div;
-		cal_print(distsum, trgetsum, " %s - %s b ", date, ndecs, freq, dateinc);
-		lap += inc;
-		add_date(date, freq, inc);
-		*prnt = YES;
-	}
+/**********
+ *
+ * int rep_start(void)
+ *
+ * starts the writer thread.
+ *
+ * returns 1 if o.k., 0 if the reports have to be written by rep_flush.
+ *
+ **********/
 
-	for (i = 0; i < nbbench; i++)
+int rep_start(void)
+{
+	if (report_writer == 0)
 	{
-		start = tau[i] - 1;
-		nbref = kappa[i] - start;
-		distsum = sumf(&dist[start], nbref) / div;
-		trgetsum = sumf(&trget[start], nbref) / div;
-		cal_print(distsum, trgetsum, " %s - %s   ", date, ndecs, freq, dateinc);
-		add_date(date, freq, inc);
+		report_writer = -1;
+#ifdef _WIN32
+		InitializeCriticalSection(&report_lock);
+		InitializeConditionVariable(&report_cond);
+		InitializeConditionVariable(&report_done);
+		if ((report_thread = CreateThread(NULL, 0, rep_writer, NULL, 0, NULL)) != NULL)
+			report_writer = 1;
+#else
+		if (pthread_create(&report_thread, NULL, rep_writer, NULL) == 0)
+			report_writer = 1;
+#endif
 	}
 
-	lap = kappa[nbbench - 1];
+	return(report_writer == 1);
+}
 
-	while (lap + inc <= nbpoints)
-	{
-		distsum = sumf(&dist[lap], inc) / div;
-		trgetsum = sumf(&trget[lap], inc) / div;
-		cal_print(distsum, trgetsum, " %s - %s b ", date, ndecs, freq, dateinc);
-		lap += inc;
-		add_date(date, freq, inc);
-		*prnt = YES;
-	}
 
 
-	if (lap < nbpoints && !stock)
+/**********
+ *
+ * void rep_flush(void)
+ *
+ * the report of the job is complete: it goes to the writer.
+ *
+ **********/
+
+void rep_flush(void)
+{
+	struct s_report *r;
+
+	r = report_cur;
+	report_cur = NULL;
+
+	if (r == NULL)
 	{
-		inc = nbpoints - lap;
-		dateinc = inc - 1;
-		distsum = sumf(&dist[lap], inc) / div;
-		trgetsum = sumf(&trget[lap], inc) / div;
-		cal_print(distsum, trgetsum, " %s - %s bi", date, ndecs, freq, dateinc);
-		*prnt = YES;
+		fflush(tables);
+		return;
 	}
 
-	if (stock)
+	if (!rep_start())
 	{
-		lap = kappa[nbbench-1] + inc;
-		if (lap < nbpoints)
-		{
-			distsum = dist[lap-1] / div;
-			trgetsum = trget[lap-1] / div;
-			cal_print(distsum, trgetsum, " %s - %s b ", date, ndecs, freq, dateinc);
-			*prnt = YES;
-		}
+		fwrite(r->buf, 1, r->len, r->out);
+		fflush(r->out);
+		free(r->buf);
+		free(r);
+		return;
 	}
+
+	REP_LOCK();
+	if (report_tail != NULL)
+		report_tail->next = r;
+	else
+		report_head = r;
+	report_tail = r;
+	REP_SIGNAL();
+	REP_UNLOCK();
 }
 
 
 
 /**********
  *
- * void cal_print(double distsum, double trgetsum, char *format,
- *	char date[], int ndecs, int freq, int dateinc)
+ * void rep_drain(void)
  *
- * calculates adjustment factor, adjusted differences and prints
- * the numbers.
+ * waits until the writer has written every report handed to it.
  *
  **********/
 
-void cal_print(double distsum, double trgetsum, char *format,
-	char date[], int ndecs, int freq, int dateinc)
+void rep_drain(void)
 {
-	double adj_fac, adj_dif;
-	char date2[7];
-
-	strcpy(date2, date);
-	add_date(date2, freq, dateinc);
+	if (report_writer != 1)
+		return;
 
-	if (trgetsum && distsum)
-		adj_fac = trgetsum / distsum;
-	else
-		adj_fac = 0;
-
-	adj_dif = trgetsum - distsum;
-	fprintf(tables, format, date, date2);
-	printem(ndecs, trgetsum, distsum, adj_fac, adj_dif);
+	REP_LOCK();
+	while (report_head != NULL || report_busy)
+		REP_WAIT_DONE();
+	REP_UNLOCK();
 }
 
 
 
 /**********
  *
- * double sumf(double *in, int nb)
+ * void rep_close(void)
  *
- * sums up the value of an array of doubles.
- * the result is put into a double for greater accuracy.
+ * writes what is left and stops the writer.
  *
  **********/
 
-double sumf(double *in, int nb)
+void rep_close(void)
 {
-	double total;
-	int   i;
+	rep_flush();
+
+	if (report_writer != 1)
+		return;
+
+	REP_LOCK();
+	report_stop = 1;
+	REP_SIGNAL();
+	REP_UNLOCK();
+
+#ifdef _WIN32
+	WaitForSingleObject(report_thread, INFINITE);
+	CloseHandle(report_thread);
+#else
+	pthread_join(report_thread, NULL);
+#endif
+	report_writer = 0;
+	report_stop = 0;
+}
 
-	total = 0.0;
-	for (i = 0; i < nb; i++)
-		total += in[i];
 
-	return(total);
-}
+
+int distribround(double *in, double sum, int nvalue, int ndec, double *out, struct s_rank *work);
+int round_segments(double *trget, struct s_segment *seg, int nbseg, int ndec);
+int controlled_round(double **comp, double **bench, int nbcomp, double *agg, int *tau, int *kappa, int nbbench, int nbdist, bool linked, int ndec);
+int controlled_segment(double **comp, double *agg, int nbcomp, int start, int length, double *total, int ndec, char *up, int *cnt, int *lo, int *hi, int *prev, int *via, int *queue, struct s_rank *work);
+int controlled_path(double **comp, int nbcomp, int start, int length, double lshift, char *up, int *cnt, int *lo, int *hi, int *prev, int *via, int *queue, int phase);
+void roundd(int ndec, int npts, double *in, double *out);
+int rank_compare(const void *a, const void *b);
+void select_rank(struct s_rank *work, int n, int k);
+int boundary_tie(struct s_rank *work, int n, int k);
+void shellsort(struct s_rank *work, int n);
 
 
 
 /**********
  *
- * void printem(int ndecs, double trgets, double dists, double fac, double dif)
+ * int round_segments(double *trget, struct s_segment *seg, int nbseg,
+ *                    int ndec)
  *
- * print four doubles on a line.
+ * rounds the segments of trget to their control totals with
+ * distribround, level by level.  The workspace is shared by all the
+ * segments, one per thread.  The segments of a level are done in
+ * parallel when the program is compiled with OpenMP and there are at
+ * least ROUND_PAR_MIN of them.
+ *
+ * returns 1 if o.k., 0 if out of memory (trget is unchanged).
  *
  **********/
 
-void printem(int ndecs, double trgets, double dists, double fac, double dif)
+#define ROUND_PAR_MIN 64
+
+int round_segments(double *trget, struct s_segment *seg, int nbseg, int ndec)
 {
-	fprintf(tables, "%16.*f", ndecs, trgets);
-	fprintf(tables, "%16.*f", ndecs, dists);
-	fprintf(tables, "%15.4f", fac);
-	fprintf(tables, "%17.4f\n", dif);
+	double *result;
+	struct s_rank *work;
+	int maxlen, maxlevel;
+	int nthreads;
+	int level;
+	int i;
+
+	maxlen = 1;
+	maxlevel = 0;
+	for (i = 0; i < nbseg; i++)
+	{
+		if (seg[i].length > maxlen)
+			maxlen = seg[i].length;
+		if (seg[i].level > maxlevel)
+			maxlevel = seg[i].level;
+	}
+
+	nthreads = 1;
+#ifdef _OPENMP
+	if (nbseg >= ROUND_PAR_MIN)
+		nthreads = omp_get_max_threads();
+#endif
+
+	result = (double *)qm_malloc((size_t)nthreads * maxlen * sizeof(double));
+	work = (struct s_rank *)qm_malloc((size_t)nthreads * maxlen * sizeof(struct s_rank));
+
+	if (!(result && work))
+	{
+		free(result);
+		free(work);
+		return(0);
+	}
+
+	for (level = 0; level <= maxlevel; level++)
+	{
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) num_threads(nthreads) if (nthreads > 1)
+#endif
+		for (i = 0; i < nbseg; i++)
+		{
+			double *out;
+			struct s_rank *rank;
+			double sum;
+			int t, j;
+
+			if (seg[i].level != level)
+				continue;
+
+			t = 0;
+#ifdef _OPENMP
+			t = omp_get_thread_num();
+#endif
+			out = &result[t * maxlen];
+			rank = &work[t * maxlen];
+
+			sum = seg[i].total;
+			if (seg[i].sumlen > 0)
+				for (j = 0, sum = 0; j < seg[i].sumlen; j++)
+					sum += trget[seg[i].sumstart + j];
+
+			distribround(&trget[seg[i].start], sum, seg[i].length, ndec, out, rank);
+			for (j = 0; j < seg[i].length; j++)
+				trget[seg[i].start + j] = out[j];
+		}
+	}
+
+	free(result);
+	free(work);
+
+	return(1);
 }
 
 
 
 /**********
  *
- * void prnt_data(char start[], int nbpoints, int freq, int nbdecs,
- *                double *series, char arates, char printsum);
- *
- * This procedure prints a series on a line by line format.
- * It can print a series any frequency (1,4,12).
- * It prints the series with the numbers of decimals passed in
- * parameter.  The parameter start gives the start date of which the
- * series represent. The parameters nbpoints gives the number of
- * datapoints to be printed.
+ * int controlled_round(double **comp, double **bench, int nbcomp,
+ *                      double *agg, int *tau, int *kappa, int nbbench,
+ *                      int nbdist, bool linked, int ndec)
+ *
+ * rounds the nbcomp components comp[i] of the aggregate agg together
+ * (Q_CONTROLLED).  The periods are cut in segments: the benchmark
+ * windows, whose totals are bench[i], and the periods out of the
+ * benchmarks, by groups of the width of the last benchmark, whose
+ * totals are their own sums.  In each segment every component keeps
+ * its total rounded to ndec decimals and the sum of the rounded
+ * components of every period stays within one unit of the sum of the
+ * components, give or take its share of the rounding of the totals.  The aggregate is then replaced by the sum of the
+ * rounded components, so the table is additive both ways.
+ *
+ * Each component is first rounded alone, the units going to the
+ * largest fractions (distribround); the periods whose sum is out of
+ * bounds are then repaired by moving units along the shortest chains
+ * of periods (controlled_path), which keeps the totals of the
+ * components.
+ *
+ * returns the number of periods left more than one unit away, -1 if
+ * out of memory (nothing is changed).
  *
  **********/
 
-void prnt_data(char start[], int nbpoints, int freq, int nbdecs,
-	double *series, char arates, char printsum)
+int controlled_round(double **comp, double **bench, int nbcomp, double *agg, int *tau, int *kappa, int nbbench, int nbdist, bool linked, int ndec)
 {
-	int per;
-	int year;
-	int num;
-	int num1;
-	int i;
-	int j;
-	int mult;
+	double *total;
+	char *up;
+	int *cnt, *lo, *hi, *prev, *via, *queue;
+	struct s_rank *work;
+	int nvalue, maxlen;
+	int first, start, length;
+	int ret_val;
+	int i, k;
 
-	mult = (arates ? freq : 1);
-	per = atoi(start+4);
-	year = (atoi(start) - per) / 100;
-	num = 0;
+	first = linked ? 1 : 0;
+	if (nbbench <= first || nbcomp <= 0)
+		return(0);
 
-	switch (freq)
+	nvalue = kappa[nbbench-1] - tau[nbbench-1] + 1;
+	maxlen = nvalue;
+	for (k = first; k < nbbench; k++)
+		if (kappa[k] - tau[k] + 1 > maxlen)
+			maxlen = kappa[k] - tau[k] + 1;
+
+	total = (double *)qm_malloc(nbcomp * sizeof(double));
+	up = (char *)qm_malloc((size_t)nbcomp * maxlen);
+	cnt = (int *)qm_malloc(maxlen * sizeof(int));
+	lo = (int *)qm_malloc(maxlen * sizeof(int));
+	hi = (int *)qm_malloc(maxlen * sizeof(int));
+	prev = (int *)qm_malloc(maxlen * sizeof(int));
+	via = (int *)qm_malloc(maxlen * sizeof(int));
+	queue = (int *)qm_malloc(maxlen * sizeof(int));
+	work = (struct s_rank *)qm_malloc(maxlen * sizeof(struct s_rank));
+
+	ret_val = -1;
+	if (total && up && cnt && lo && hi && prev && via && queue && work)
 	{
-		case 1:
-			for (i = 0; i < nbpoints; i++)
-				fprintf(tables, " %4.4d%16.*f\n", year++, nbdecs, series[num++]);
+		ret_val = 0;
 
-			break;
+		/**********
+		* periods before the benchmarks, by groups ending at the first
+		* one
+		**********/
 
-		case 4:
-			/**********
-			* first incomplete period
-			**********/
+		for (start = tau[first] - 1; start > 0; start -= length)
+		{
+			length = (start < nvalue) ? start : nvalue;
+			ret_val += controlled_segment(comp, agg, nbcomp, start - length, length, NULL, ndec, up, cnt, lo, hi, prev, via, queue, work);
+		}
 
-			if (per != 1)
-			{
-				fprintf(tables, "\n %4.4d%16s  ", year++, " ");
+		/**********
+		* benchmark windows and the periods between them
+		**********/
 
-				for (i = 0; i < 4; i++)
-				{
-					if (i < per -1 || num >= nbpoints)
-						fprintf(tables, "%14s", "-"); 
-					else
-						fprintf(tables, "%14.*f", nbdecs, series[num++]*(double)mult);
-				}
+		for (k = first; k < nbbench; k++)
+		{
+			for (i = 0; i < nbcomp; i++)
+				total[i] = bench[i][k];
+			ret_val += controlled_segment(comp, agg, nbcomp, tau[k] - 1, kappa[k] - tau[k] + 1, total, ndec, up, cnt, lo, hi, prev, via, queue, work);
 
-				fprintf(tables, "\n");
+			start = kappa[k];
+			while (k + 1 < nbbench && start < tau[k+1] - 1)
+			{
+				length = tau[k+1] - 1 - start;
+				if (length > nvalue)
+					length = nvalue;
+				ret_val += controlled_segment(comp, agg, nbcomp, start, length, NULL, ndec, up, cnt, lo, hi, prev, via, queue, work);
+				start += length;
 			}
+		}
 
-			/**********
-			* complete periods
-			**********/
+		/**********
+		* periods after the benchmarks
+		**********/
 
-			while (num + 4 <= nbpoints)
-			{
-				fprintf(tables, "\n %4.4d", year++);
+		for (start = kappa[nbbench-1]; start < nbdist; start += length)
+		{
+			length = (start + nvalue <= nbdist) ? nvalue : nbdist - start;
+			ret_val += controlled_segment(comp, agg, nbcomp, start, length, NULL, ndec, up, cnt, lo, hi, prev, via, queue, work);
+		}
+	}
 
-				if (printsum)
-					fprintf(tables,"%16.*f  ", nbdecs, sumf(&series[num],4));
-				else
-					fprintf(tables,"%16s  ", " ");
+	free(total);
+	free(up);
+	free(cnt);
+	free(lo);
+	free(hi);
+	free(prev);
+	free(via);
+	free(queue);
+	free(work);
 
-				for (i = 0; i < 4; i ++)
-					fprintf(tables, "%14.*f", nbdecs, series[num++]*(double)mult);
+	return(ret_val);
+}
 
-				fprintf(tables, "\n");
-			}
 
-			/**********
-			* last incomplete period
-			**********/
 
-			if (num < nbpoints)
-			{
-				fprintf(tables, "\n %4.4d%16s  ", year++, " ");
-				for (i = 0; i < 4; i++)
-				{
-					if (num < nbpoints)
-						fprintf(tables, "%14.*f", nbdecs, series[num++]*(double)mult);
-					else
-						fprintf(tables, "%14s", "-");
-				}
+/**********
+ *
+ * int controlled_segment(double **comp, double *agg, int nbcomp, int start,
+ *                        int length, double *total, int ndec,
+ *                        char *up, int *cnt, int *lo, int *hi, int *prev,
+ *                        int *via, int *queue, struct s_rank *work)
+ *
+ * controlled rounding of the periods start to start+length-1 to the
+ * totals total[i], or to the sums of the components over the segment
+ * if total is NULL.  In units of the last decimal, up[i*length+t] tells if
+ * component i is rounded up at period t and cnt[t] counts the
+ * components rounded up, which should stay within lo[t] and hi[t].
+ *
+ * returns the number of periods out of bounds.
+ *
+ **********/
 
-				fprintf(tables, "\n");
-			}
+int controlled_segment(double **comp, double *agg, int nbcomp, int start, int length, double *total, int ndec, char *up, int *cnt, int *lo, int *hi, int *prev, int *via, int *queue, struct s_rank *work)
+{
+	double lshift;
+	double v, units, need, sum;
+	int ret_val;
+	int i, t, c;
 
-			break;
+	lshift = pow(10.0, (double)ndec);
+	for (t = 0; t < length; t++)
+		cnt[t] = 0;
 
-		case 12:
-			/**********
-			* first incomplete period
-			**********/
+	/**********
+	* each component alone: its units go to its largest fractions
+	**********/
 
-			if (per != 1)
-			{
-				fprintf(tables, "\n %4.4d%16s  ", year++, " ");
+	for (i = 0; i < nbcomp; i++)
+	{
+		units = 0;
+		for (t = 0; t < length; t++)
+		{
+			v = comp[i][start + t] * lshift;
+			units += floor(v);
+			work[t].diff = v - floor(v);
+			work[t].seqno = t;
+			up[i*length + t] = NO;
+		}
 
-				for (i = 0; i < 3; i++)
-				{
-					num1 = i;
+		if (total)
+			sum = total[i];
+		else
+			for (t = 0, sum = 0; t < length; t++)
+				sum += comp[i][start + t];
 
-					if (i != 0)
-						fprintf(tables, " %4s%16s  ", " ", " ");
+		roundd(ndec, 1, &sum, &sum);
+		need = floor(sum * lshift + 0.5) - units;
+		c = (need < 0) ? 0 : (need > length) ? length : (int)need;
 
-					for (j = 0; j < 4; j++)
-					{
-						if (num1 < per - 1 || num1 - per + 2 > nbpoints)
-							fprintf(tables, "%14s", "-");
-						else
-						{
-							fprintf(tables, "%14.*f", nbdecs,
-							series[num1 - per + 1]*(double)mult);
-							num++;
-						}
+		select_rank(work, length, c);
+		for (t = 0; t < c; t++)
+		{
+			up[i*length + work[t].seqno] = YES;
+			cnt[work[t].seqno]++;
+		}
+	}
 
-						num1 += 3;
-					}
+	/**********
+	* bounds of the periods: the sum of the rounded components within
+	* one unit of the sum of the components.  The rounding of the
+	* totals changes the total of the segment, the change is spread
+	* evenly over its periods.
+	**********/
 
-					fprintf(tables, "\n");
-				}
-			}
+	need = 0;
+	for (t = 0; t < length; t++)
+	{
+		need += cnt[t];
+		for (i = 0; i < nbcomp; i++)
+			need -= comp[i][start + t] * lshift - floor(comp[i][start + t] * lshift);
+	}
 
-			/**********
-			* complete periods
-			**********/
+	for (t = 0; t < length; t++)
+	{
+		v = need / length;
+		for (i = 0; i < nbcomp; i++)
+			v += comp[i][start + t] * lshift - floor(comp[i][start + t] * lshift);
+
+		lo[t] = (int)ceil(v - 1.0 + 1e-9);
+		hi[t] = (int)floor(v + 1.0 - 1e-9);
+		if (lo[t] < 0)
+			lo[t] = 0;
+		if (hi[t] > nbcomp)
+			hi[t] = nbcomp;
+	}
 
-			while (num + 12 <= nbpoints)
-			{
-				fprintf(tables, "\n %4.4d", year++);
+	/**********
+	* move units out of the periods over their bound, then into the
+	* periods under
+	**********/
 
-				if (printsum)
-					fprintf(tables,"%16.*f  ", nbdecs, sumf(&series[num],12));
-				else
-					fprintf(tables,"%16s  ", " ");
+	while (controlled_path(comp, nbcomp, start, length, lshift, up, cnt, lo, hi, prev, via, queue, 0))
+		;
+	while (controlled_path(comp, nbcomp, start, length, lshift, up, cnt, lo, hi, prev, via, queue, 1))
+		;
 
-				for (i = 0; i < 3; i++)
-				{
-					if (i != 0)
-						fprintf(tables, " %4s%16s  ", " ", " ");
+	ret_val = 0;
+	for (t = 0; t < length; t++)
+	{
+		if (cnt[t] < lo[t] || cnt[t] > hi[t])
+			ret_val++;
 
-					num1 = i;
+		units = 0;
+		for (i = 0; i < nbcomp; i++)
+		{
+			v = floor(comp[i][start + t] * lshift) + up[i*length + t];
+			comp[i][start + t] = v / lshift;
+			units += v;
+		}
+		agg[start + t] = units / lshift;
+	}
 
-					for (j = 0; j < 4; j++)
-					{
-						fprintf(tables, "%14.*f", nbdecs, series[num+num1]*(double)mult);
-						num1 += 3;
-					}
+	return(ret_val);
+}
 
-					fprintf(tables, "\n");
-				}
 
-				num += 12;
-			}
 
-			/**********
-			* last incomplete period
-			**********/
+/**********
+ *
+ * int controlled_path(double **comp, int nbcomp, int start, int length,
+ *                     double lshift, char *up, int *cnt, int *lo, int *hi,
+ *                     int *prev, int *via, int *queue, int phase)
+ *
+ * one repair of controlled_segment.  Phase 0 starts from the periods
+ * over their upper bound and ends at any period under its upper bound,
+ * phase 1 starts from the periods over their lower bound and ends at a
+ * period under its lower bound.  A unit of component i can move from
+ * period a to period b if i is rounded up at a and not at b; a chain
+ * of such moves only changes the counts of its two ends.  The chain is
+ * the shortest found by a breadth first search, each move taking the
+ * component whose fractions are the closest.
+ *
+ * returns 1 if a chain was moved, 0 if there is none.
+ *
+ **********/
 
-			if (num < nbpoints)
-			{
-				fprintf(tables, "\n %4.4d%16s  ", year++, " ");
+int controlled_path(double **comp, int nbcomp, int start, int length, double lshift, char *up, int *cnt, int *lo, int *hi, int *prev, int *via, int *queue, int phase)
+{
+	double fa, fb, cost, best;
+	int head, tail;
+	int a, b, i, sel;
 
-				for (i = 0; i < 3; i++)
-				{
-					num1 = i;
+	head = 0;
+	tail = 0;
+	for (a = 0; a < length; a++)
+	{
+		prev[a] = -2;
+		if ((phase == 0 && cnt[a] > hi[a]) || (phase == 1 && cnt[a] > lo[a]))
+		{
+			prev[a] = -1;
+			queue[tail++] = a;
+		}
+	}
 
-					if (i != 0)
-						fprintf(tables, " %4s%16s  ", " ", " ");
+	if (phase == 1)
+	{
+		for (b = 0; b < length && cnt[b] >= lo[b]; b++)
+			;
+		if (b == length)
+			return(0);
+	}
 
-					for (j = 0; j < 4; j++)
-					{
-						if (num + num1 < nbpoints)
-							fprintf(tables, "%14.*f", nbdecs, series[num + num1]*(double)mult);
-						else
-							fprintf(tables, "%14s", "-");
+	while (head < tail)
+	{
+		a = queue[head++];
+		for (b = 0; b < length; b++)
+		{
+			if (prev[b] != -2)
+				continue;
 
-						num1 += 3;
-					}
+			sel = -1;
+			best = 0;
+			for (i = 0; i < nbcomp; i++)
+			{
+				if (!up[i*length + a] || up[i*length + b])
+					continue;
 
-					fprintf(tables, "\n");
+				fa = comp[i][start + a] * lshift;
+				fb = comp[i][start + b] * lshift;
+				cost = (fa - floor(fa)) - (fb - floor(fb));
+				if (sel < 0 || cost < best)
+				{
+					sel = i;
+					best = cost;
 				}
 			}
 
-			break;
-	}
-}
+			if (sel < 0)
+				continue;
 
+			prev[b] = a;
+			via[b] = sel;
+
+			if ((phase == 0 && cnt[b] < hi[b]) || (phase == 1 && cnt[b] < lo[b]))
+			{
+				cnt[b]++;
+				for (; prev[b] >= 0; b = prev[b])
+				{
+					up[via[b]*length + b] = YES;
+					up[via[b]*length + prev[b]] = NO;
+				}
+				cnt[b]--;
+				return(1);
+			}
 
+			queue[tail++] = b;
+		}
+	}
 
-int distribround(double *in, double sum, int nvalue, int ndec, double *out);
-void roundd(int ndec, int npts, double *in, double *out);
-extern void shellsort(int *n, char *type, double *x, int *nlmnt);
+	return(0);
+}
 
 
 
 /**********
  *
- * int distribround(double *in, double sum, int nvalue, int ndec, double *out)
+ * int distribround(double *in, double sum, int nvalue, int ndec, double *out,
+ *                  struct s_rank *work)
  *
  *     PURPOSE:
  *
@@ -3787,6 +8869,7 @@ extern void shellsort(int *n, char *type, double *x, int *nlmnt);
  *                  THIS VALUE IS NOT NECESSARILY ROUNDED.
  *        NVALUE  - # OF VALUES TO BE ROUNDED & DISTRIBUTED.
  *        NDEC    - # OF DECIMAL PLACES REQUESTED
+ *        WORK    - WORKSPACE OF NVALUE ELEMENTS.
  *        STCROUNDING   .FALSE. - REGULAR ROUNDING METHOD.
  *                      .TRUE.  - STATISTICS CANADA APPROVED METHOD.
  *
@@ -3807,7 +8890,12 @@ extern void shellsort(int *n, char *type, double *x, int *nlmnt);
  *        THE ROUNDED VALUE WITH THE SMALLEST(LARGEST) DEVIATION.
  *        THIS PROCESS IS REPEATED UNTIL ALL OF THE DIFFERENCE BETWEEN
  *        'SUM' AND THE SUM OF THE ROUNDED 'IN' VALUES HAS BEEN
- *        REMOVED.
+ *        REMOVED.  ONLY THE SET OF VALUES ADJUSTED MATTERS, SO THE
+ *        ADJUSTCOUNT VALUES NEEDED ARE SELECTED (SELECT_RANK) INSTEAD
+ *        OF SORTING THEM ALL.  IF A DEVIATION EQUAL TO THE LAST ONE
+ *        ADJUSTED IS LEFT OUT, THE CHOICE AMONG THE EQUAL DEVIATIONS
+ *        IS THE ONE OF THE SHELL SORT ALWAYS USED BEFORE (SHELLSORT),
+ *        SO THE ROUNDED VALUES DO NOT CHANGE.
  *
  *        GIVEN A VECTOR OF N TERMS X(I) AND  A VALUE A TO WHICH
  *        SUMMATION OF X MUST AGREE.  LET ~X(I) BE THE VALUE OF X(I)
@@ -3831,26 +8919,19 @@ extern void shellsort(int *n, char *type, double *x, int *nlmnt);
  *
  **********/
 
-int distribround(double *in, double sum, int nvalue, int ndec, double *out)
+int distribround(double *in, double sum, int nvalue, int ndec, double *out, struct s_rank *work)
 {
 	double lshift, rshift;
 	double roundsum[1];
 	double calsum;
-	double diff[300];
 	double sumdiff;
 	double adjustment;
 	double adjcount;
 	double a, b;
 	int ret_val;
-	int seqno[300];
 	int adjustcount;
-	int i, j, z;
-
-	if (nvalue > 300)
-	{
-		printf("nvalue > 300  = %d\n", nvalue);
-		return(1);
-	}
+	int first;
+	int i;
 
 	ret_val = 0;
 	a = ndec;
@@ -3865,7 +8946,8 @@ int distribround(double *in, double sum, int nvalue, int ndec, double *out)
 	for (i = 0; i < nvalue; i++)
 	{
 		calsum = calsum + out[i];
-		diff[i] = out[i] - in[i];
+		work[i].diff = out[i] - in[i];
+		work[i].seqno = i;
 	}
 	sumdiff = roundsum[0] - calsum;
 
@@ -3886,38 +8968,146 @@ int distribround(double *in, double sum, int nvalue, int ndec, double *out)
 		return(1);
 	}
 
-	shellsort(&nvalue, "D", diff, seqno);
 	adjustment = (sumdiff < 0 ? -1.0 : 1.0);
 	adjustment *= rshift;
 
-	/* DEBUG
-	printf("distribround 5.0: after shellsort: sumdiff=%12.4f adjustment=%12.4f\n",sumdiff,adjustment);
-	for (z=0; z < nvalue; z++) printf("out[%3d]=%12.4f  diff[%3d]=%14.6f  seqno[%3d]=%3d\n",z,out[z],z,diff[z],z,seqno[z]);
-	*/
+	/**********
+	* work is ranked by decreasing deviation: the smallest deviations
+	* are adjusted up, the largest down
+	**********/
+
+	first = (sumdiff > 0) ? nvalue - adjustcount : 0;
+
+	select_rank(work, nvalue, (sumdiff > 0) ? first : adjustcount);
 
-	if (sumdiff > 0)
+	if (boundary_tie(work, nvalue, (sumdiff > 0) ? first : adjustcount))
 	{
-		j = nvalue - 1;
-		for (i = 0; i < adjustcount; i++)
+		for (i = 0; i < nvalue; i++)
 		{
-			out[seqno[j]] = out[seqno[j]] + adjustment;
-			j--;
+			work[i].diff = out[i] - in[i];
+			work[i].seqno = i;
 		}
+		shellsort(work, nvalue);
 	}
-	else
+
+	for (i = first; i < first + adjustcount; i++)
+		out[work[i].seqno] = out[work[i].seqno] + adjustment;
+
+	return(ret_val);
+}
+
+
+
+/**********
+ *
+ * int rank_compare(const void *a, const void *b)
+ *
+ * order of the deviations for distribround: decreasing deviation,
+ * then increasing position.
+ *
+ **********/
+
+int rank_compare(const void *a, const void *b)
+{
+	const struct s_rank *ra = (const struct s_rank *)a;
+	const struct s_rank *rb = (const struct s_rank *)b;
+
+	if (ra->diff != rb->diff)
+		return(ra->diff > rb->diff ? -1 : 1);
+
+	return(ra->seqno - rb->seqno);
+}
+
+
+
+/**********
+ *
+ * int boundary_tie(struct s_rank *work, int n, int k)
+ *
+ * after select_rank(work, n, k): returns 1 if a deviation of the k
+ * first is equal to one of the others, 0 else.
+ *
+ **********/
+
+int boundary_tie(struct s_rank *work, int n, int k)
+{
+	double low, high;
+	int i;
+
+	if (k <= 0 || k >= n)
+		return(0);
+
+	low = work[0].diff;
+	for (i = 1; i < k; i++)
+		if (work[i].diff < low)
+			low = work[i].diff;
+
+	high = work[k].diff;
+	for (i = k + 1; i < n; i++)
+		if (work[i].diff > high)
+			high = work[i].diff;
+
+	return(low == high);
+}
+
+
+
+/**********
+ *
+ * void select_rank(struct s_rank *work, int n, int k)
+ *
+ * puts the k first elements of work, in the order of rank_compare, in
+ * work[0] to work[k-1] (in any order) and the others after.  Small
+ * windows are simply sorted; otherwise the partition is done by
+ * quickselect, in time proportional to n.
+ *
+ **********/
+
+void select_rank(struct s_rank *work, int n, int k)
+{
+	struct s_rank pivot;
+	struct s_rank temp;
+	int lo, hi, i, j;
+
+	if (k <= 0 || k >= n)
+		return;
+
+	if (n <= 32)
 	{
-		for (i = 0; i < adjustcount; i++)
-		{
-			out[seqno[i]] = out[seqno[i]] + adjustment;
-		}
+		qsort(work, (size_t)n, sizeof(struct s_rank), rank_compare);
+		return;
 	}
 
-	/* DEBUG
-	printf("distribround 6.0:\n");
-	for (z=0; z < nvalue; z++) printf("out[%3d]=%12.4f\n",z,out[z]);
-	*/
+	lo = 0;
+	hi = n - 1;
+	while (lo < hi)
+	{
+		pivot = work[lo + (hi - lo) / 2];
+		i = lo;
+		j = hi;
+		while (i <= j)
+		{
+			while (rank_compare(&work[i], &pivot) < 0)
+				i++;
+			while (rank_compare(&work[j], &pivot) > 0)
+				j--;
+			if (i <= j)
+			{
+				temp = work[i];
+				work[i] = work[j];
+				work[j] = temp;
+				i++;
+				j--;
+			}
+		}
 
-	return(ret_val);
+		if (k - 1 <= j)
+			hi = j;
+		else if (k - 1 >= i)
+			lo = i;
+		else
+			break;
+	}
 }
 
 
@@ -3942,9 +9132,15 @@ int distribround(double *in, double sum, int nvalue, int ndec, double *out)
  *     OUTPUT:
  *        OUT  - VECTOR CONTAINING THE ROUNDED DATA VALUES
  *
+ *     THE FRACTION WAS ONCE PRINTED WITH 6 DECIMALS AND READ BACK
+ *     BEFORE IT WAS COMPARED TO .5, TO IGNORE THE NOISE OF THE
+ *     FLOATING POINT.  THAT IS THE SAME AS COMPARING IT TO ROUND_HALF,
+ *     THE SMALLEST DOUBLE ABOVE .4999995.
  *
  **********/
 
+#define ROUND_HALF 0.49999950000000004
+
 void roundd(int ndec, int npts, double *in, double *out)
 {
 	double realnum;
@@ -3952,7 +9148,6 @@ void roundd(int ndec, int npts, double *in, double *out)
 	double dfactor;
 	double lshift;
 	double rshift;
-	char cfactor[128];
 	int i;
 
 
@@ -3967,10 +9162,8 @@ void roundd(int ndec, int npts, double *in, double *out)
 			intnum++;
 
 		dfactor = fabs(realnum - intnum);
-		sprintf(cfactor, "%lf", dfactor);
-		dfactor = atof(cfactor);
 
-		if (dfactor >= 0.5)
+		if (dfactor >= ROUND_HALF)
 		{
 			if (realnum < 0)
 				intnum--;
@@ -3984,72 +9177,41 @@ void roundd(int ndec, int npts, double *in, double *out)
 
 
 
+
 /*
 C
-C THIS SUBROUTINE PERFORMS A SHELL SORT OF A DATA SERIES
-C where nlmnt contains the sorted index of the data in
-C the x array.
-C IF TYPE EQUALS "A", ROUTINE SORTS IN ASCENDING ORDER
-C IF TYPE EQUALS "D", ROUTINE SORTS IN DESCENDING ORDER
+C THIS SUBROUTINE PERFORMS A SHELL SORT OF THE DEVIATIONS OF
+C DISTRIBROUND IN DESCENDING ORDER.  THE ELEMENTS OF WORK ARE
+C EXCHANGED IN THE SAME ORDER AS THE INDEXES OF THE ORIGINAL
+C ROUTINE, WHICH DECIDES BETWEEN EQUAL DEVIATIONS.
 C
 */
 
-void shellsort(int *n, char *type, double *x, int *nlmnt)
+void shellsort(struct s_rank *work, int n)
 {
-	int igap, imax, iex, iplusg, temp, i;
+	int igap, imax, iex, iplusg, i;
+	struct s_rank temp;
 
-	for (i=0; i<*n; i++)
-	{
-		nlmnt[i]=i;
-	}
+	igap = n;
 
-	igap=*n;
-
-	if (strcmp(type, "A") == 0)
-	{
-		while (igap > 1)
-		{
-			igap = igap/2;
-			imax = *n-igap;
-			do
-			{
-				iex=0;
-				for (i=0; i<imax; i++)
-				{
-					iplusg = i + igap;
-					if (x[nlmnt[i]] > x[nlmnt[iplusg]])
-					{
-						temp = nlmnt[i];
-						nlmnt[i] = nlmnt[iplusg];
-						nlmnt[iplusg] = temp;
-						iex++;
-					}
-				}
-			} while (iex > 0);
-		}
-	}
-	else
+	while (igap > 1)
 	{
-		while (igap > 1)
+		igap = igap/2;
+		imax = n-igap;
+		do
 		{
-			igap = igap/2;
-			imax = *n-igap;
-			do
+			iex=0;
+			for (i=0; i<imax; i++)
 			{
-				iex=0;
-				for (i=0; i<imax; i++)
+				iplusg = i + igap;
+				if (work[i].diff < work[iplusg].diff)
 				{
-					iplusg = i + igap;
-					if (x[nlmnt[i]] < x[nlmnt[iplusg]])
-					{
-						temp = nlmnt[i];
-						nlmnt[i] = nlmnt[iplusg];
-						nlmnt[iplusg] = temp;
-						iex++;
-					}
+					temp = work[i];
+					work[i] = work[iplusg];
+					work[iplusg] = temp;
+					iex++;
 				}
-			} while (iex > 0);
-		}
+			}
+		} while (iex > 0);
 	}
 }
-